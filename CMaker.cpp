@@ -1,29 +1,68 @@
 #include "CMaker.h"
 
+#include "CaptureLog.h"
+#include "CbpCache.h"
+#include "CbpFileApi.h"
+#include "CbpManifest.h"
+#include "CbpPatchRules.h"
+#include "CbpPatchSession.h"
 #include "CbpPatcher.h"
+#include "CbpRewriteCache.h"
+#include "CbpRewriteRoots.h"
+#include "CbpStreamPatcher.h"
+#include "CompileCommandsPatcher.h"
 #include "file_system.h"
+#include "parallel.h"
+#include "process.h"
 
-#include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <deque>
 #include <fstream>
+#include <iomanip>
 #include <sstream>
 #include <thread>
 
 namespace gatools {
 
-inline std::vector<const char *> vecToRaw(const std::vector<std::string> &in) {
+/// @brief the argv or envp of the values, the views of a CmdLineArgs are null terminated.
+inline std::vector<const char *> vecToRaw(const std::vector<std::string_view> &in) {
     std::vector<const char *> outRaw;
     outRaw.resize(in.size() + 1);
     for (size_t i = 0; i < in.size(); i++) {
-        outRaw[i] = in[i].c_str();
+        outRaw[i] = in[i].data();
     }
     outRaw[in.size()] = nullptr;
     return outRaw;
 }
 
+/// @brief the usage of the child from its wait status and its rusage.
+inline ChildUsage toChildUsage(int status, const rusage &usage, uint64_t wallNs) {
+    ChildUsage out;
+    out.status = status;
+    if (WIFEXITED(status)) {
+        out.exitCode = WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        out.termSignal = WTERMSIG(status);
+    }
+    out.wallSeconds = static_cast<double>(wallNs) / 1e9;
+    out.userSeconds = static_cast<double>(usage.ru_utime.tv_sec) + static_cast<double>(usage.ru_utime.tv_usec) / 1e6;
+    out.systemSeconds = static_cast<double>(usage.ru_stime.tv_sec) + static_cast<double>(usage.ru_stime.tv_usec) / 1e6;
+    out.maxRssKB = usage.ru_maxrss;
+    out.majorFaults = usage.ru_majflt;
+    out.minorFaults = usage.ru_minflt;
+    out.voluntarySwitches = usage.ru_nvcsw;
+    out.involuntarySwitches = usage.ru_nivcsw;
+    out.blockInputs = usage.ru_inblock;
+    out.blockOutputs = usage.ru_oublock;
+    return out;
+}
+
 /// @brief get a vector of the config files found in the order of search priority
 std::vector<std::string> getConfigFilePaths(const ExecutionPlan &executionPlan) {
     std::vector<std::string> configFilePaths;
@@ -57,6 +96,36 @@ std::vector<std::string> getConfigFilePaths(const ExecutionPlan &executionPlan)
     return configFilePaths;
 }
 
+/// @brief check the bytes of a configuration for the name of the command, without parsing them.
+/// The keys of cmdReplacement are matched like findCmdReplacement does: the command, its file name or any path
+/// ending with its file name.
+/// The escaped keys are not matched, the configurations containing a backslash must be parsed.
+/// @return false if the configuration cannot have a cmdReplacement for the command.
+inline bool mayReplaceCommand(const std::string &configBytes, const std::string &command) {
+    const std::string filename = ga::getFilename(command);
+    for (const std::string &pattern : {"\"" + command + "\"", "\"" + filename + "\"", "/" + filename + "\""}) {
+        if (configBytes.find(pattern) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// @brief find the replacement of the command: the key is the command, its file name or a path to the same file name.
+inline const std::vector<std::string> *findCmdReplacement(const JProject &project, const std::string &command) {
+    const std::map<std::string, std::vector<std::string>> &replacements = project.cmdReplacement;
+    auto it = replacements.find(command);
+    if (it == replacements.end()) {
+        it = replacements.find(ga::getFilename(command));
+    }
+    if (it == replacements.end()) {
+        const std::string filename = ga::getFilename(command);
+        it = std::find_if(replacements.begin(), replacements.end(),
+                          [&filename](const auto &kv) { return ga::getFilename(kv.first) == filename; });
+    }
+    return (it != replacements.end()) ? &it->second : nullptr;
+}
+
 /// @brief gather the parameters for patching the .cbp files to use a SDK.
 /// @return true if the CBPs should be patched and the parameters have been gathered.
 inline bool canPatchCBP(const CmdLineArgs &cmdLineArgs, std::string &outProjectDir, std::string &outBuildDir) {
@@ -66,12 +135,13 @@ inline bool canPatchCBP(const CmdLineArgs &cmdLineArgs, std::string &outProjectD
     bool patchCbp = false;
 
     if (cmdLineArgs.args.size() >= 2) {
-        patchCbp = (ga::getFilename(cmdLineArgs.args[0]).find("make") != std::string::npos) &&
-                   ga::pathExists(cmdLineArgs.args[1]) &&
+        std::string projectDir(cmdLineArgs.args[1]);
+        patchCbp = (ga::getFilename(std::string(cmdLineArgs.args[0])).find("make") != std::string::npos) &&
+                   ga::pathExists(projectDir) &&
                    (ga::pathExists(ga::combine(cmdLineArgs.pwd, "CMakeCache.txt")) ||
                     cmdLineArgs.pwd.find("build") != std::string::npos);
         if (patchCbp) {
-            outProjectDir = cmdLineArgs.args[1];
+            outProjectDir = projectDir;
             outBuildDir = cmdLineArgs.pwd;
             ga::getSimplePath(outProjectDir, outProjectDir);
             ga::getSimplePath(outBuildDir, outBuildDir);
@@ -81,13 +151,15 @@ inline bool canPatchCBP(const CmdLineArgs &cmdLineArgs, std::string &outProjectD
     return patchCbp;
 }
 
-#define LOG_F(x)                                                                                                       \
+#define LOG_TO_F(logLines, x)                                                                                          \
     do {                                                                                                               \
         std::stringstream ss;                                                                                          \
         ss << x;                                                                                                       \
-        executionPlan.log.push_back(ss.str());                                                                         \
+        (logLines).push_back(ss.str());                                                                                \
     } while (false)
 
+#define LOG_F(x) LOG_TO_F(executionPlan.log, x)
+
 #define OUT_F(x)                                                                                                       \
     do {                                                                                                               \
         std::stringstream ss;                                                                                          \
@@ -97,15 +169,33 @@ inline bool canPatchCBP(const CmdLineArgs &cmdLineArgs, std::string &outProjectD
     } while (false)
 
 const std::string CMaker::CONFIG_FILENAME = "xcmake.json";
+const std::string CMaker::REPATCH_PROJECT_ARG = "--repatch-project";
 
 struct CMaker::Impl {
     CmdLineArgs cmdLineArgs;
     ExecutionPlan executionPlan;
     JConfig defaultJConfiguration;
+    /// @brief compiled once from executionPlan.patchRules and shared by all the .cbp files.
+    std::shared_ptr<const CbpPatchRules> patchRules;
+    /// @brief compiled once from executionPlan.sdkRewriteRoots.
+    std::shared_ptr<const CbpRewriteRoots> rewriteRoots;
+    /// @brief the store of the patched outputs, set by patchCBPs if patchCacheSizeMB is set.
+    std::shared_ptr<const CbpCache> patchCache;
+    /// @brief the memo of the rewritten values, shared by the workers of patchCBPs.
+    std::shared_ptr<CbpRewriteCache> rewriteCache;
+    /// @brief the hash of the settings that change the patched .cbp files (see getPatchProfile).
+    std::string patchProfile;
+    /// @brief the profile of the patch cache keys: the patch profile and the engine, the engines do not format the
+    /// output the same way ("splice" keeps the bytes of the input, "dom" prints the document again).
+    std::string cacheProfile;
+    /// @brief xcmake --repatch-project: nothing is run, the cbpSearchPaths are all the build directories.
+    bool isRepatch = false;
 
     /// @brief gather the parameters for patching the .cbp files to use a SDK.
+    /// @param command if set, a configuration that cannot replace the command is rejected before it is parsed.
     /// @return true if the CBPs should be patched and the parameters have been gathered.
-    bool readConfiguration(const std::string &projectDir, const std::string &buildDir, JProject &outProject) {
+    bool readConfiguration(const std::string &projectDir, const std::string &buildDir, JProject &outProject,
+                           const std::string &command = std::string()) {
         LOG_F("preparePatchCBPs");
         outProject = JProject();
 
@@ -131,6 +221,13 @@ struct CMaker::Impl {
                 LOG_F(configFilePath << " could not be read");
                 continue;
             }
+            // The pre-filter is only a hint: the configuration is parsed if the build directory must be registered
+            // (projectDir is set by canPatchCBP) or if a key may be escaped ("\/usr\/bin\/cmake", "\u0063make").
+            if (!command.empty() && projectDir.empty() && jStr.find('\\') == std::string::npos &&
+                !mayReplaceCommand(jStr, command)) {
+                LOG_F("cmdReplacement for: " << command << " does not exist in " << configFilePath);
+                return false;
+            }
 
             config = deserialize(jStr);
             simplify(config);
@@ -146,7 +243,7 @@ struct CMaker::Impl {
             }
             if (selectProject(config, projectOrBuildDir, outProject)) {
                 LOG_F("Selected project: " << outProject.path << ", sdk: " << outProject.sdkPath);
-                if (updateProject(projectDir, buildDir, config)) {
+                if (!buildDir.empty() && updateProject(projectDir, buildDir, config)) {
                     LOG_F("Update project: " << projectDir << " with buildDir: " << buildDir);
                     doUpdate = true;
                 }
@@ -163,44 +260,442 @@ struct CMaker::Impl {
         return !outProject.sdkPath.empty();
     }
 
+    /// @brief keep the original .cbp generated by cmake.
+    static void backupCBP(const std::string &filePath, std::vector<std::string> &fileLog) {
+        std::string bakFile = filePath + ".bak";
+        if (!ga::pathExists(bakFile)) {
+            int bk = std::rename(filePath.c_str(), bakFile.c_str());
+            LOG_TO_F(fileLog, "backup: " << bakFile << " (rename=" << bk << ")");
+        }
+    }
+
+    /// @brief patch a .cbp without building a DOM. The output is streamed into the temp file of writeFile.
+    static PatchResult patchCBPStreamed(CbpPatchContext &context, std::vector<std::string> &fileLog) {
+        const std::string &filePath = context.cbpFilePath;
+        std::ifstream input(filePath, std::ifstream::in | std::ifstream::binary);
+        if (!input) {
+            LOG_TO_F(fileLog, filePath << " cannot be loaded");
+            return PatchResult::Error;
+        }
+
+        PatchResult patchResult = PatchResult::Error;
+        bool ok = ga::writeFile(filePath, [&context, &input, &fileLog, &filePath, &patchResult](std::ostream &output) {
+            patchResult = patchCBPStream(context, input, output);
+            LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult));
+            if (patchResult != PatchResult::Changed) {
+                return false;
+            }
+            backupCBP(filePath, fileLog);
+            return true;
+        });
+        if (patchResult == PatchResult::Changed) {
+            LOG_TO_F(fileLog, "writeFile: " << filePath << " (ok=" << ok << ")");
+            if (!ok) {
+                patchResult = PatchResult::Error;
+            }
+        }
+        return patchResult;
+    }
+
+    /// @brief find the edits of a .cbp. The Target and Unit subtrees that did not change since the previous input
+    /// reuse their edits from the snapshot stored next to the .bak, the snapshot is then updated to this input.
+    PatchResult findCBPEditsIncremental(CbpPatchContext &context, const char *data, size_t size,
+                                        std::vector<CbpEdit> &edits, std::vector<std::string> &fileLog) const {
+        std::string snapshotFile = context.cbpFilePath + CbpSubtreeSnapshot::EXTENSION;
+        CbpSubtreeSnapshot snapshot;
+        std::string bytes;
+        if (ga::readFile(snapshotFile, bytes) && !snapshot.load(bytes, patchProfile)) {
+            LOG_TO_F(fileLog, snapshotFile << " was saved for other settings");
+        }
+
+        PatchResult patchResult = findCBPEdits(context, data, size, edits, &snapshot);
+        if (patchResult == PatchResult::Changed) {
+            LOG_TO_F(fileLog, context.cbpFilePath << " subtrees reused: " << snapshot.reused
+                                                  << ", transformed: " << snapshot.transformed);
+            if (!ga::writeFile(snapshotFile, snapshot.save(patchProfile))) {
+                LOG_TO_F(fileLog, snapshotFile << " cannot be written");
+            }
+        }
+        return patchResult;
+    }
+
+    /// @brief patch the compile_commands.json of the build directory with the settings of the session.
+    /// The database is streamed into the temp file of writeFile, the original is kept like the .cbp files.
+    static PatchResult patchCompileCommands(CbpPatchSession &session, const std::string &filePath,
+                                            std::vector<std::string> &fileLog) {
+        CbpPatchContext &context = session.begin(filePath);
+        std::ifstream input(filePath, std::ifstream::in | std::ifstream::binary);
+        if (!input) {
+            LOG_TO_F(fileLog, filePath << " cannot be loaded");
+            return PatchResult::Error;
+        }
+
+        PatchResult patchResult = PatchResult::Error;
+        bool ok = ga::writeFile(filePath, [&context, &input, &fileLog, &filePath, &patchResult](std::ostream &output) {
+            patchResult = gatools::patchCompileCommands(context, input, output);
+            LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult));
+            if (patchResult != PatchResult::Changed) {
+                return false;
+            }
+            backupCBP(filePath, fileLog);
+            return true;
+        });
+        if (patchResult == PatchResult::Changed) {
+            LOG_TO_F(fileLog, "writeFile: " << filePath << " (ok=" << ok << ")");
+            if (!ok) {
+                patchResult = PatchResult::Error;
+            }
+        }
+        return patchResult;
+    }
+
+    /// @brief patch a .cbp by copying the unchanged byte ranges of the mapped file and splicing in the edits.
+    PatchResult patchCBPSpliced(CbpPatchContext &context, const ga::MappedFile &input,
+                                std::vector<std::string> &fileLog) const {
+        const std::string &filePath = context.cbpFilePath;
+        std::vector<CbpEdit> edits;
+        PatchResult patchResult = findCBPEditsIncremental(context, input.data(), input.size(), edits, fileLog);
+        LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult));
+        if (patchResult != PatchResult::Changed) {
+            return patchResult;
+        }
+
+        // The mapping stays valid when the file is renamed or replaced
+        backupCBP(filePath, fileLog);
+        bool ok = ga::writeFile(filePath, [&input, &edits](std::ostream &output) {
+            return writeCBPEdits(input.data(), input.size(), edits, output);
+        });
+        LOG_TO_F(fileLog, "writeFile: " << filePath << " (ok=" << ok << ")");
+        return ok ? PatchResult::Changed : PatchResult::Error;
+    }
+
+    /// @brief patch the parsed .cbp and print it straight into the temp file of writeFileHandle.
+    static PatchResult patchCBPPrinted(CbpPatchContext &context, std::vector<std::string> &fileLog) {
+        const std::string &filePath = context.cbpFilePath;
+        PatchResult patchResult = PatchResult::Error;
+        bool ok = ga::writeFileHandle(filePath, [&context, &fileLog, &filePath, &patchResult](FILE *output) {
+            patchResult = gatools::patchCBP(context, output);
+            LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult));
+            if (patchResult != PatchResult::Changed) {
+                return false;
+            }
+            backupCBP(filePath, fileLog);
+            return true;
+        });
+        if (patchResult == PatchResult::Changed) {
+            LOG_TO_F(fileLog, "writeFile: " << filePath << " (ok=" << ok << ")");
+            if (!ok) {
+                patchResult = PatchResult::Error;
+            }
+        }
+        return patchResult;
+    }
+
+    /// @brief backup the original .cbp and replace it with the patched bytes.
+    static PatchResult writePatchedCBP(const std::string &filePath, const std::string &patched,
+                                       std::vector<std::string> &fileLog) {
+        backupCBP(filePath, fileLog);
+        bool ok = ga::writeFile(filePath, patched);
+        LOG_TO_F(fileLog, "writeFile: " << filePath << " (ok=" << ok << ")");
+        return ok ? PatchResult::Changed : PatchResult::Error;
+    }
+
+    /// @brief move a .cbp patched for another SDK (the old prefixes are in the context) to the SDK of the context.
+    /// If the file cannot be retargeted, the original written by cmake (the .bak) is patched again.
+    static PatchResult retargetCBP(CbpPatchContext &context, const char *data, size_t size, std::string &retargeted,
+                                   std::vector<std::string> &fileLog) {
+        const std::string &filePath = context.cbpFilePath;
+        PatchResult patchResult = gatools::retargetCBP(context, data, size, retargeted);
+        LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult) + " (retarget from " +
+                              context.oldSdkPrefix + ")");
+        if (patchResult == PatchResult::Changed) {
+            return writePatchedCBP(filePath, retargeted, fileLog);
+        }
+
+        std::string original;
+        if (!ga::readFile(filePath + ".bak", original)) {
+            return patchResult;
+        }
+        if (context.inOutXml.Parse(original.data(), original.size()) != tinyxml2::XML_SUCCESS) {
+            LOG_TO_F(fileLog, filePath << ".bak cannot be loaded");
+            return PatchResult::Error;
+        }
+        patchResult = gatools::patchCBP(context, &retargeted);
+        LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult) + " (from the backup)");
+        if (patchResult != PatchResult::Changed) {
+            return patchResult;
+        }
+        return writePatchedCBP(filePath, retargeted, fileLog);
+    }
+
+    /// @brief patch a single .cbp file with the session of the worker.
+    /// Only the executionPlan settings are read, so this can run on any thread.
+    PatchResult patchCBP(CbpPatchSession &session, const std::string &filePath,
+                         std::vector<std::string> &fileLog) const {
+        CbpPatchContext &context = session.begin(filePath);
+
+        // The input is mapped, or read in memory with the cache (for the key and, on a miss, for the patch).
+        std::string input;
+        ga::MappedFile mapped;
+        bool loaded = patchCache ? ga::readFile(filePath, input) : mapped.open(filePath);
+        if (!loaded) {
+            LOG_TO_F(fileLog, filePath << " cannot be loaded");
+            return PatchResult::Error;
+        }
+        const char *data = patchCache ? input.data() : mapped.data();
+        size_t size = patchCache ? input.size() : mapped.size();
+
+        // The files patched by a previous run are recognized from their first bytes, without parsing them.
+        PatchResult patchResult = PatchResult::Error;
+        if (prescanCBP(context, data, size, patchResult)) {
+            LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult) + " (prescan)");
+            if (patchResult == PatchResult::DifferentSDK && executionPlan.retargetSdk) {
+                return retargetCBP(context, data, size, session.getOutput(), fileLog);
+            }
+            return patchResult;
+        }
+
+        std::string cacheKey;
+        if (patchCache) {
+            cacheKey = CbpCache::getKey(input, cacheProfile);
+
+            std::string cached;
+            if (patchCache->get(cacheKey, cached)) {
+                LOG_TO_F(fileLog, filePath + " PatchResult: Changed (cached)");
+                return writePatchedCBP(filePath, cached, fileLog);
+            }
+        }
+
+        std::string &modified = session.getOutput();
+        if (executionPlan.patchEngine == "stream") {
+            if (!patchCache) {
+                return patchCBPStreamed(context, fileLog);
+            }
+            std::istringstream in(input);
+            std::ostringstream out;
+            patchResult = patchCBPStream(context, in, out);
+            modified = out.str();
+        } else if (executionPlan.patchEngine == "dom") {
+            tinyxml2::XMLError error = context.inOutXml.Parse(data, size);
+            if (error != tinyxml2::XML_SUCCESS) {
+                LOG_TO_F(fileLog, filePath << " cannot be loaded");
+                return PatchResult::Error;
+            }
+            if (!patchCache) {
+                // The mapping is not needed anymore, the document is printed without a copy in memory.
+                mapped.close();
+                return patchCBPPrinted(context, fileLog);
+            }
+            patchResult = gatools::patchCBP(context, &modified);
+        } else {
+            // "splice" (default): only the patched byte ranges are replaced, unchanged subtrees come from the snapshot
+            if (!patchCache) {
+                return patchCBPSpliced(context, mapped, fileLog);
+            }
+            std::vector<CbpEdit> edits;
+            patchResult = findCBPEditsIncremental(context, input.data(), input.size(), edits, fileLog);
+            std::ostringstream out;
+            if (patchResult == PatchResult::Changed && !writeCBPEdits(input.data(), input.size(), edits, out)) {
+                patchResult = PatchResult::Error;
+            }
+            modified = out.str();
+        }
+
+        LOG_TO_F(fileLog, filePath + " PatchResult: " + asString(patchResult));
+
+        if (patchResult != PatchResult::Changed) {
+            return patchResult;
+        }
+        if (patchCache && !patchCache->put(cacheKey, modified)) {
+            LOG_TO_F(fileLog, filePath << " cannot be stored in the patch cache");
+        }
+        return writePatchedCBP(filePath, modified, fileLog);
+    }
+
+    /// @brief get a hash of the settings that change the patched .cbp files.
+    std::string getPatchProfile() const {
+        std::stringstream ss;
+        ss << executionPlan.projectDir << '\n' << executionPlan.buildDir << '\n' << executionPlan.sdkDir << '\n';
+        for (const std::string &dir : executionPlan.extraAddDirectory) {
+            ss << dir << '\n';
+        }
+        for (const std::string &fix : executionPlan.gccClangFixes) {
+            ss << fix << '\n';
+        }
+        for (const JPatchRule &rule : executionPlan.patchRules) {
+            ss << rule.path << '\n' << rule.attribute << '\n' << rule.action << '\n';
+            ss << rule.from << '\n' << rule.to << '\n';
+        }
+        for (const std::string &root : executionPlan.sdkRewriteRoots) {
+            ss << root << '\n';
+        }
+        std::string profile = ss.str();
+        return ga::toHex(ga::hashBytes(profile.data(), profile.size()));
+    }
+
+    /// @brief get the .cbp files of the search directories (not recursive).
+    static std::vector<std::string> findCBPs(const std::vector<std::string> &cbpSearchPaths) {
+        std::vector<std::string> cbpFilePaths;
+        ga::DirectorySearch ds;
+        ds.includeFiles = true;
+        ds.includeDirectories = false;
+        ds.maxRecursionLevel = 0;
+        for (const std::string &searchDir : cbpSearchPaths) {
+            ga::findInDirectory(
+                searchDir,
+                [&cbpFilePaths](const ga::ChildEntry &entry) {
+                    const char *ext = ga::getFileExtension(entry.path);
+                    if ((ext != nullptr) &&              //
+                        (std::tolower(ext[0]) == 'c') && // extension exists
+                        (std::tolower(ext[1]) == 'b') && // and is "cbp"
+                        (std::tolower(ext[2]) == 'p') && //
+                        (ext[3] == '\0')) {
+                        cbpFilePaths.push_back(entry.path);
+                    }
+                },
+                ds);
+        }
+        return cbpFilePaths;
+    }
+
+    /// @brief the number of threads set by patchWorkers.
+    size_t getWorkerCount() const {
+        size_t workerCount = 1;
+        if (executionPlan.patchWorkers < 0) {
+            workerCount = ga::getDefaultWorkerCount();
+        } else if (executionPlan.patchWorkers > 1) {
+            workerCount = static_cast<size_t>(executionPlan.patchWorkers);
+        }
+        return workerCount;
+    }
+
     /// @brief patch the .cbp files from the build directory.
     void patchCBPs(const std::vector<std::string> &cbpFilePaths) {
-        // Process all CBP files
-        for (const std::string &filePath : cbpFilePaths) {
-            CbpPatchContext context;
-            context.cbpFilePath = filePath;
-            context.projectDir = executionPlan.projectDir;
-            context.buildDir = executionPlan.buildDir;
-            context.sdkDir = executionPlan.sdkDir;
-            context.extraAddDirectory = executionPlan.extraAddDirectory;
-            context.gccClangFixes = executionPlan.gccClangFixes;
-
-            tinyxml2::XMLError error = context.inOutXml.LoadFile(filePath.c_str());
-            if (error != tinyxml2::XML_SUCCESS) {
-                LOG_F(filePath << " cannot be loaded");
-                continue;
+        size_t workerCount = getWorkerCount();
+
+        // Every file logs into its own vector. The logs are merged in the order of the files,
+        // so the log does not depend on the number of workers or on the scheduling.
+        std::vector<std::vector<std::string>> fileLogs(cbpFilePaths.size());
+
+        patchProfile = getPatchProfile();
+        const std::string &engine = executionPlan.patchEngine;
+        cacheProfile = patchProfile + '\n' + ((engine == "stream" || engine == "dom") ? engine : "splice");
+        rewriteCache = std::make_shared<CbpRewriteCache>();
+        patchCache.reset();
+        if (executionPlan.patchCacheSizeMB > 0) {
+            std::string cacheDir = executionPlan.patchCacheDir;
+            if (cacheDir.empty()) {
+                cacheDir = CbpCache::getDefaultDir(executionPlan.cmdLineArgs.env, executionPlan.cmdLineArgs.home);
             }
+            auto cache = std::make_shared<CbpCache>(cacheDir, uint64_t(executionPlan.patchCacheSizeMB) << 20);
+            if (cache->open()) {
+                patchCache = cache;
+            } else {
+                LOG_F("patch cache cannot be created in: " << cacheDir);
+            }
+        }
 
-            std::string modified;
-            PatchResult patchResult = patchCBP(context, &modified);
+        // The compile_commands.json of the build directory is tracked like the .cbp files.
+        std::vector<std::string> trackedPaths = cbpFilePaths;
+        std::string compileCommandsPath;
+        std::vector<std::string> compileCommandsLog;
+        if (executionPlan.patchCompileCommands && !executionPlan.buildDir.empty()) {
+            compileCommandsPath = ga::combine(executionPlan.buildDir, COMPILE_COMMANDS_FILENAME);
+            trackedPaths.push_back(compileCommandsPath);
+        }
 
-            LOG_F(filePath + " PatchResult: " + asString(patchResult));
+        // The files written or checked by a previous run are skipped without opening them.
+        CbpManifest manifest;
+        manifest.load(executionPlan.buildDir, patchProfile);
+        manifest.retain(trackedPaths);
+
+        std::vector<size_t> toPatch;
+        for (size_t i = 0; i < cbpFilePaths.size(); i++) {
+            ga::FileStat stat;
+            if (ga::getFileStat(cbpFilePaths[i], stat) && manifest.isUnchanged(cbpFilePaths[i], stat)) {
+                LOG_TO_F(fileLogs[i], cbpFilePaths[i] << " is unchanged since the last patch");
+            } else {
+                toPatch.push_back(i);
+            }
+        }
 
-            switch (patchResult) {
-            case PatchResult::Changed: {
-                std::string bakFile = filePath + ".bak";
-                if (!ga::pathExists(bakFile)) {
-                    int bk = std::rename(filePath.c_str(), bakFile.c_str());
-                    LOG_F("backup: " << bakFile << " (rename=" << bk << ")");
-                }
-                bool ok = ga::writeFile(filePath, modified);
-                LOG_F("writeFile: " << filePath << " (ok=" << ok << ")");
-            } break;
-            default:
-                break;
+        bool patchCommands = false;
+        if (!compileCommandsPath.empty()) {
+            ga::FileStat stat;
+            if (!ga::getFileStat(compileCommandsPath, stat)) {
+                LOG_TO_F(compileCommandsLog, compileCommandsPath << " does not exist");
+            } else if (manifest.isUnchanged(compileCommandsPath, stat)) {
+                LOG_TO_F(compileCommandsLog, compileCommandsPath << " is unchanged since the last patch");
+            } else {
+                patchCommands = true;
+            }
+        }
+
+        // The profile is shared by the workers, every worker reuses its session for all its files.
+        auto profile = std::make_shared<CbpPatchProfile>();
+        profile->projectDir = executionPlan.projectDir;
+        profile->buildDir = executionPlan.buildDir;
+        profile->sdkDir = executionPlan.sdkDir;
+        profile->extraAddDirectory = executionPlan.extraAddDirectory;
+        profile->gccClangFixes = executionPlan.gccClangFixes;
+        profile->patchRules = patchRules;
+        profile->rewriteRoots = rewriteRoots;
+        profile->rewriteCache = rewriteCache;
+        // The workers left when there are less files than workers rewrite the elements of the big files.
+        profile->elementWorkers = std::max<size_t>(1, workerCount / std::max<size_t>(1, toPatch.size()));
+        std::vector<CbpPatchSession> sessions;
+        for (size_t w = 0; w < workerCount; w++) {
+            sessions.emplace_back(profile);
+        }
+
+        // The compile_commands.json is the first task, so it is patched while the other workers patch the .cbp files.
+        std::vector<CbpManifestEntry> entries(trackedPaths.size());
+        std::vector<char> hasEntry(trackedPaths.size(), 0);
+        const size_t firstCbpTask = patchCommands ? 1 : 0;
+        ga::parallelFor(toPatch.size() + firstCbpTask, workerCount,
+                        [this, &trackedPaths, &fileLogs, &compileCommandsLog, &toPatch, &entries, &hasEntry, &sessions,
+                         firstCbpTask](size_t w, size_t t) {
+                            size_t i = trackedPaths.size() - 1;
+                            PatchResult patchResult = PatchResult::Error;
+                            if (t < firstCbpTask) {
+                                patchResult = patchCompileCommands(sessions[w], trackedPaths[i], compileCommandsLog);
+                            } else {
+                                i = toPatch[t - firstCbpTask];
+                                patchResult = patchCBP(sessions[w], trackedPaths[i], fileLogs[i]);
+                            }
+                            if (patchResult != PatchResult::DifferentSDK && patchResult != PatchResult::Error) {
+                                hasEntry[i] = createManifestEntry(trackedPaths[i], entries[i]) ? 1 : 0;
+                            }
+                        });
+
+        for (size_t i = 0; i < trackedPaths.size(); i++) {
+            if (hasEntry[i] != 0) {
+                manifest.set(trackedPaths[i], entries[i]);
+            }
+        }
+        if (!manifest.save()) {
+            LOG_F("manifest could not be written in: " << executionPlan.buildDir);
+        }
+        // The store only grows when an entry is written
+        if (patchCache && patchCache->getPutCount() > 0) {
+            size_t nEvicted = patchCache->evict();
+            if (nEvicted > 0) {
+                LOG_F("evicted " << nEvicted << " entries from the patch cache: " << patchCache->getDir());
             }
         }
 
+        if (workerCount > 1) {
+            LOG_F("patched " << toPatch.size() << " files using " << workerCount << " workers");
+        }
+        CbpRewriteCache::Stats rewriteStats = rewriteCache->getStats();
+        if (rewriteStats.hits + rewriteStats.misses > 0) {
+            LOG_F("rewrite cache: " << rewriteStats.hits << " hits, " << rewriteStats.misses << " misses");
+        }
+        for (const std::vector<std::string> &fileLog : fileLogs) {
+            executionPlan.log.insert(executionPlan.log.end(), fileLog.begin(), fileLog.end());
+        }
+        executionPlan.log.insert(executionPlan.log.end(), compileCommandsLog.begin(), compileCommandsLog.end());
+
         if (!cbpFilePaths.empty()) {
             OUT_F("SDK:    " << executionPlan.sdkDir);
             OUT_F("Config: " << executionPlan.configFilePath);
@@ -208,8 +703,138 @@ struct CMaker::Impl {
         }
     }
 
+    /// @brief generate the .cbp of the build directory from the codemodel written by cmake for the File API query.
+    /// The generated .cbp is kept as the .bak, the .cbp is not written again while the codemodel generates the same.
+    void generateFileApiCBP() {
+        FileApiCodemodel codemodel;
+        std::string error;
+        if (!readFileApiReply(executionPlan.buildDir, getWorkerCount(), codemodel, error)) {
+            LOG_F("file api: " << error);
+            return;
+        }
+
+        std::string cbp = generateCBP(codemodel);
+        std::string cbpFilePath = ga::combine(executionPlan.buildDir, getGeneratedCBPFilename(codemodel));
+        std::string bakFilePath = cbpFilePath + ".bak";
+        std::string previousCbp;
+        if (ga::pathExists(cbpFilePath) && ga::readFile(bakFilePath, previousCbp) && previousCbp == cbp) {
+            LOG_F("file api: " << cbpFilePath << " is up to date");
+            return;
+        }
+        // The .bak of the previous codemodel is replaced by the backup of the new .cbp
+        std::remove(bakFilePath.c_str());
+        bool written = ga::writeFile(cbpFilePath, cbp);
+        LOG_F("file api: generated " << cbpFilePath << " with " << codemodel.targets.size()
+                                     << " targets (write=" << written << ")");
+    }
+
+    /// @brief copy the patch settings of the project into the execution plan and compile them.
+    void applyPatchSettings(const JProject &project) {
+        executionPlan.sdkDir = project.sdkPath;
+        executionPlan.gccClangFixes = project.gccClangFixes;
+        executionPlan.extraAddDirectory = project.extraAddDirectory;
+        executionPlan.patchWorkers = project.patchWorkers;
+        executionPlan.patchEngine = project.patchEngine;
+        executionPlan.patchRules = project.patchRules;
+        executionPlan.sdkRewriteRoots = project.sdkRewriteRoots;
+        executionPlan.retargetSdk = project.retargetSdk;
+        executionPlan.patchCompileCommands = project.patchCompileCommands;
+        executionPlan.fileApi = project.fileApi;
+        executionPlan.captureLogDir = project.captureLogDir;
+        executionPlan.patchCacheSizeMB = project.patchCacheSizeMB;
+        executionPlan.patchCacheDir = project.patchCacheDir;
+
+        std::vector<std::string> ruleErrors;
+        patchRules = CbpPatchRules::compile(executionPlan.patchRules, &ruleErrors);
+        for (const std::string &ruleError : ruleErrors) {
+            LOG_F("patchRules: " << ruleError);
+        }
+        std::vector<std::string> rootErrors;
+        rewriteRoots = CbpRewriteRoots::compile(executionPlan.sdkRewriteRoots, &rootErrors);
+        for (const std::string &rootError : rootErrors) {
+            LOG_F("sdkRewriteRoots: " << rootError);
+        }
+    }
+
+    /// @brief prepare the patch of all the build directories of the project (xcmake --repatch-project <path>).
+    int initRepatch(const std::string &projectPath) {
+        std::string &projectDir = executionPlan.projectDir;
+        projectDir = ga::isAbsolutePath(projectPath) ? projectPath : ga::combine(cmdLineArgs.pwd, projectPath);
+        ga::getSimplePath(projectDir, projectDir);
+
+        JProject project;
+        bool hasConfig = readConfiguration(projectDir, "", project);
+        LOG_F("init repatch: " << projectDir << " hasConfig: " << hasConfig);
+        if (!hasConfig) {
+            OUT_F("No SDK is configured for " << projectDir);
+            return -1;
+        }
+
+        applyPatchSettings(project);
+        // The files patched for the previous SDK are moved to the current one
+        executionPlan.retargetSdk = true;
+        for (const std::string &buildPath : project.buildPaths) {
+            if (ga::pathExists(buildPath)) {
+                executionPlan.cbpSearchPaths.push_back(buildPath);
+            } else {
+                LOG_F("build directory does not exist: " << buildPath);
+            }
+        }
+        isRepatch = true;
+
+        OUT_F("All *.cbp in " << executionPlan.cbpSearchPaths.size() << " build directories of " << projectDir
+                              << " will use " << executionPlan.sdkDir);
+        LOG_F("executionPlan: " << executionPlan);
+        return 0;
+    }
+
+    /// @brief patch the build directories concurrently, every directory is patched with its own copy of the plan.
+    int repatchBuildDirs() {
+        const std::vector<std::string> buildDirs = executionPlan.cbpSearchPaths;
+        const size_t workerCount = getWorkerCount();
+        const size_t dirWorkers = std::max<size_t>(1, std::min(workerCount, buildDirs.size()));
+
+        std::vector<Impl> dirPlans(buildDirs.size(), *this);
+        std::vector<size_t> cbpCounts(buildDirs.size(), 0);
+        std::vector<double> durationsMs(buildDirs.size(), 0.0);
+        auto start = std::chrono::steady_clock::now();
+        ga::parallelFor(buildDirs.size(), dirWorkers,
+                        [&buildDirs, &dirPlans, &cbpCounts, &durationsMs, workerCount, dirWorkers](size_t, size_t i) {
+                            auto dirStart = std::chrono::steady_clock::now();
+                            ExecutionPlan &plan = dirPlans[i].executionPlan;
+                            plan.buildDir = buildDirs[i];
+                            plan.cbpSearchPaths = {buildDirs[i]};
+                            // The workers left by the directories patch the files of each directory
+                            plan.patchWorkers = static_cast<int>(std::max<size_t>(1, workerCount / dirWorkers));
+                            plan.log.clear();
+
+                            std::vector<std::string> cbpFilePaths = findCBPs(plan.cbpSearchPaths);
+                            dirPlans[i].patchCBPs(cbpFilePaths);
+                            cbpCounts[i] = cbpFilePaths.size();
+                            std::chrono::duration<double, std::milli> duration =
+                                std::chrono::steady_clock::now() - dirStart;
+                            durationsMs[i] = duration.count();
+                        });
+        std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+
+        for (size_t i = 0; i < buildDirs.size(); i++) {
+            const std::vector<std::string> &dirLog = dirPlans[i].executionPlan.log;
+            executionPlan.log.insert(executionPlan.log.end(), dirLog.begin(), dirLog.end());
+            OUT_F(buildDirs[i] << ": " << cbpCounts[i] << " .cbp files in " << std::fixed << std::setprecision(1)
+                               << durationsMs[i] << " ms");
+        }
+        OUT_F("Repatched " << buildDirs.size() << " build directories in " << std::fixed << std::setprecision(1)
+                           << duration.count() << " ms");
+        return 0;
+    }
+
     bool hasExecutionPlan() const { return !executionPlan.exePath.empty() && !executionPlan.cmdLineArgs.args.empty(); }
 
+    bool canExecInPlace() const {
+        return !isRepatch && hasExecutionPlan() && executionPlan.cbpSearchPaths.empty() &&
+               executionPlan.captureLogDir.empty();
+    }
+
     int step1init(const CmdLineArgs &cmdLineArgs) {
         // Log the input parameters
         LOG_F("step1 init: " << cmdLineArgs);
@@ -217,10 +842,18 @@ struct CMaker::Impl {
         this->cmdLineArgs = cmdLineArgs;
         executionPlan = ExecutionPlan();
         executionPlan.cmdLineArgs = cmdLineArgs;
+        patchRules.reset();
+        rewriteRoots.reset();
+        isRepatch = false;
+
+        if (cmdLineArgs.args.size() >= 3 && cmdLineArgs.args[1] == CMaker::REPATCH_PROJECT_ARG) {
+            return initRepatch(std::string(cmdLineArgs.args[2]));
+        }
 
         bool patchCbp = canPatchCBP(cmdLineArgs, executionPlan.projectDir, executionPlan.buildDir);
         JProject project;
-        bool hasConfig = readConfiguration(executionPlan.projectDir, executionPlan.buildDir, project);
+        std::string command = cmdLineArgs.args.empty() ? std::string() : std::string(cmdLineArgs.args[0]);
+        bool hasConfig = readConfiguration(executionPlan.projectDir, executionPlan.buildDir, project, command);
         LOG_F("init patchCbp: " << patchCbp << " hasConfig: " << hasConfig);
 
         int retCode = -1;
@@ -233,40 +866,36 @@ struct CMaker::Impl {
                 break;
             }
 
-            auto replIt = project.cmdReplacement.find(cmdLineArgs.args[0]);
-            if (replIt == project.cmdReplacement.end()) {
-                replIt = project.cmdReplacement.find(ga::getFilename(cmdLineArgs.args[0]));
-            }
-            if (replIt == project.cmdReplacement.end()) {
-                LOG_F("cmdReplacement for: " << cmdLineArgs.args[0] << " does not exist");
+            const std::vector<std::string> *replacement = findCmdReplacement(project, command);
+            if (replacement == nullptr) {
+                LOG_F("cmdReplacement for: " << command << " does not exist");
                 break;
             }
 
-            const std::vector<std::string> &replCmd = replIt->second;
+            const std::vector<std::string> &replCmd = *replacement;
 
+            // The arguments and the variables that are not replaced still view argv and environ
             executionPlan.exePath = replCmd[0];
-            std::vector<std::string> &args = executionPlan.cmdLineArgs.args;
-            args = cmdLineArgs.args;
-            for (size_t i = 0; (i + 1) < replCmd.size() && i < args.size(); i++) {
-                args[i] = replCmd[i + 1];
+            CmdLineArgs &planArgs = executionPlan.cmdLineArgs;
+            for (size_t i = 0; (i + 1) < replCmd.size() && i < planArgs.args.size(); i++) {
+                planArgs.setArg(i, replCmd[i + 1]);
             }
-
-            std::vector<std::string> &env = executionPlan.cmdLineArgs.env;
-            env = cmdLineArgs.env;
             for (const std::string &v : project.cmdEnvironment) {
-                env.push_back(v);
+                planArgs.setEnv(v);
             }
 
-            executionPlan.sdkDir = project.sdkPath;
-            executionPlan.gccClangFixes = project.gccClangFixes;
-            executionPlan.extraAddDirectory = project.extraAddDirectory;
+            applyPatchSettings(project);
 
             // Gather all the CBP search paths and
             // output a message when running cmake to prevent qtcreator from stating the cmake server.
             if (patchCbp) {
                 executionPlan.cbpSearchPaths.push_back(executionPlan.buildDir);
+                // cmake answers the query when it configures, the .cbp is generated from the reply by step3patch
+                if (executionPlan.fileApi && !writeFileApiQuery(executionPlan.buildDir)) {
+                    LOG_F("file api: the query cannot be written in " << executionPlan.buildDir);
+                }
                 OUT_F("All *.cbp in " << executionPlan.buildDir << " will use " << executionPlan.sdkDir);
-            } else if (ga::getFilename(executionPlan.cmdLineArgs.args[0]).find("cmake") != std::string::npos) {
+            } else if (ga::getFilename(std::string(planArgs.args[0])).find("cmake") != std::string::npos) {
                 OUT_F("Running xcmake...");
             }
 
@@ -280,6 +909,10 @@ struct CMaker::Impl {
 
     int step2run() {
         executionPlan.output.clear();
+        executionPlan.childUsage = ChildUsage();
+        if (isRepatch) {
+            return 0;
+        }
         int retCode = -1;
         if (!hasExecutionPlan()) {
             LOG_F("no execution plan");
@@ -288,37 +921,69 @@ struct CMaker::Impl {
 
         LOG_F("execute: " << executionPlan.exePath);
 
+        // Everything the child needs is prepared before the spawn
+        std::vector<const char *> cmdRaw = vecToRaw(executionPlan.cmdLineArgs.args);
+        std::vector<const char *> envRaw = vecToRaw(executionPlan.cmdLineArgs.env);
+
         fflush(stdout);
         fflush(stderr);
 
-        pid_t pid = fork();
-        switch (pid) {
-        case -1:
-            LOG_F("cannot fork");
-            break;
-        case 0:
-            // Child process
-            {
-                std::vector<const char *> cmdRaw = vecToRaw(executionPlan.cmdLineArgs.args);
-                std::vector<const char *> envRaw = vecToRaw(executionPlan.cmdLineArgs.env);
+        // The output of the child goes through the pipes of the capture
+        ga::OutputCapture capture;
+        CaptureLog captureLog;
+        bool isCaptured = false;
+        if (!executionPlan.captureLogDir.empty()) {
+            std::stringstream header;
+            for (std::string_view arg : executionPlan.cmdLineArgs.args) {
+                header << arg << ' ';
+            }
+            header << "(" << executionPlan.cmdLineArgs.pwd << ")";
+            isCaptured = captureLog.open(executionPlan.captureLogDir, header.str()) && capture.open();
+            if (isCaptured) {
+                executionPlan.captureLogPath = captureLog.getFilePath();
+            } else {
+                LOG_F("the output cannot be captured in " << executionPlan.captureLogDir);
+            }
+        }
 
-                retCode = execvpe(executionPlan.exePath.c_str(), const_cast<char *const *>(cmdRaw.data()),
-                                  const_cast<char *const *>(envRaw.data()));
-                exit(retCode);
+        pid_t pid = -1;
+        uint64_t spawnNs = ga::getMonotonicNs();
+        int spawnError = ga::spawnProcess(executionPlan.exePath.c_str(), cmdRaw.data(), envRaw.data(), pid,
+                                          isCaptured ? capture.getChildOut() : -1,
+                                          isCaptured ? capture.getChildErr() : -1);
+        if (spawnError != 0) {
+            LOG_F("cannot spawn " << executionPlan.exePath << ": " << std::strerror(spawnError));
+        } else {
+            if (isCaptured &&
+                !capture.forward(STDOUT_FILENO, STDERR_FILENO,
+                                 [&captureLog](const ga::CapturedLine &line) { captureLog.write(line); })) {
+                LOG_F("the output of " << pid << " could not be forwarded");
             }
-            break;
-        default:
-            // Parent process
-            {
-                int status;
-                int r = waitpid(pid, &status, 0);
-                if (r == pid) {
-                    retCode = 0;
+            int status = -1;
+            rusage usage;
+            if (ga::waitProcess(pid, status, usage)) {
+                executionPlan.childUsage = toChildUsage(status, usage, ga::getMonotonicNs() - spawnNs);
+                retCode = 0;
+            }
+            LOG_F("wait(" << pid << ") retCode: " << retCode);
+            if (retCode == 0) {
+                LOG_F("usage of " << pid << ": " << executionPlan.childUsage);
+            }
+            if (isCaptured) {
+                const ChildUsage &childUsage = executionPlan.childUsage;
+                std::stringstream footer;
+                if (childUsage.termSignal != 0) {
+                    footer << "signal " << childUsage.termSignal;
+                } else {
+                    footer << "exit " << childUsage.exitCode;
                 }
-
-                LOG_F("waitpid(" << pid << ") returned " << r << ". retCode: " << retCode);
+                footer << " after " << std::fixed << std::setprecision(3) << childUsage.wallSeconds << " s";
+                if (!captureLog.close(footer.str())) {
+                    LOG_F("capture log: " << executionPlan.captureLogPath << " could not be written");
+                }
+                LOG_F("capture log: " << executionPlan.captureLogPath << " spliced: " << capture.splicedBytes
+                                      << " copied: " << capture.copiedBytes);
             }
-            break;
         }
 
         fflush(stdout);
@@ -327,34 +992,41 @@ struct CMaker::Impl {
         return retCode;
     }
 
+    /// @brief replace xcmake with the command, nothing is left to do after it.
+    int step2exec() {
+        executionPlan.output.clear();
+        if (!canExecInPlace()) {
+            LOG_F("cannot exec in place");
+            return -1;
+        }
+
+        LOG_F("exec: " << executionPlan.exePath);
+
+        std::vector<const char *> cmdRaw = vecToRaw(executionPlan.cmdLineArgs.args);
+        std::vector<const char *> envRaw = vecToRaw(executionPlan.cmdLineArgs.env);
+
+        fflush(stdout);
+        fflush(stderr);
+
+        execvpe(executionPlan.exePath.c_str(), const_cast<char *const *>(cmdRaw.data()),
+                const_cast<char *const *>(envRaw.data()));
+        LOG_F("cannot exec " << executionPlan.exePath << ": " << std::strerror(errno));
+        return -1;
+    }
+
     int step3patch() {
         executionPlan.output.clear();
+        if (isRepatch) {
+            return repatchBuildDirs();
+        }
         if (!hasExecutionPlan()) {
             return -1;
         }
 
-        std::vector<std::string> cbpFilePaths;
-        ga::DirectorySearch ds;
-        ds.includeFiles = true;
-        ds.includeDirectories = false;
-        ds.maxRecursionLevel = 0;
-        for (const std::string &searchDir : executionPlan.cbpSearchPaths) {
-            ga::findInDirectory(
-                searchDir,
-                [&cbpFilePaths](const ga::ChildEntry &entry) {
-                    const char *ext = ga::getFileExtension(entry.path);
-                    if ((ext != nullptr) &&              //
-                        (std::tolower(ext[0]) == 'c') && // extension exists
-                        (std::tolower(ext[1]) == 'b') && // and is "cbp"
-                        (std::tolower(ext[2]) == 'p') && //
-                        (ext[3] == '\0')) {
-                        cbpFilePaths.push_back(entry.path);
-                    }
-                },
-                ds);
+        if (executionPlan.fileApi && !executionPlan.cbpSearchPaths.empty()) {
+            generateFileApiCBP();
         }
-
-        patchCBPs(cbpFilePaths);
+        patchCBPs(findCBPs(executionPlan.cbpSearchPaths));
         return 0;
     }
 };
@@ -394,6 +1066,16 @@ int CMaker::run() {
     return r;
 }
 
+bool CMaker::canExecInPlace() const { return _impl && _impl->canExecInPlace(); }
+
+int CMaker::exec() {
+    int r = -1;
+    if (_impl) {
+        r = _impl->step2exec();
+    }
+    return r;
+}
+
 int CMaker::patch() {
     int r = -1;
     if (_impl) {
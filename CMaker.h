@@ -25,11 +25,21 @@ class CMaker {
     /// @brief execute the command in the specified working directory.
     int run();
 
+    /// @brief true if nothing has to be done after the command (no .cbp to patch), so exec can be used.
+    bool canExecInPlace() const;
+
+    /// @brief replace the current process with the command: no child is created and patch is not needed.
+    /// @return only if the command cannot be executed.
+    int exec();
+
     /// @brief post run
     int patch();
 
   public:
     static const std::string CONFIG_FILENAME;
+    /// @brief xcmake --repatch-project <path>: patch the .cbp files of all the build directories of the project
+    /// for its current SDK, without running a command.
+    static const std::string REPATCH_PROJECT_ARG;
 
   private:
     struct Impl;
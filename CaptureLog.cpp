@@ -0,0 +1,93 @@
+#include "CaptureLog.h"
+
+#include "file_system.h"
+
+#include <unistd.h>
+
+#include <ctime>
+
+namespace gatools {
+
+/// @brief the lines are written to the file when the buffer has this size.
+const size_t CAPTURE_LOG_BUFFER_SIZE = 64 * 1024;
+
+/// @brief append "ssssss.uuuuuu": the seconds right aligned on 6 characters and the microseconds.
+inline void appendElapsed(uint64_t us, std::string &out) {
+    char text[32];
+    char *end = text + sizeof(text);
+    char *p = end;
+    uint64_t micros = us % 1000000;
+    for (int i = 0; i < 6; i++) {
+        *--p = static_cast<char>('0' + micros % 10);
+        micros /= 10;
+    }
+    *--p = '.';
+    char *secondsEnd = p;
+    uint64_t seconds = us / 1000000;
+    do {
+        *--p = static_cast<char>('0' + seconds % 10);
+        seconds /= 10;
+    } while (seconds > 0);
+    while (secondsEnd - p < 6) {
+        *--p = ' ';
+    }
+    out.append(p, static_cast<size_t>(end - p));
+}
+
+CaptureLog::~CaptureLog() { close(std::string()); }
+
+bool CaptureLog::open(const std::string &dir, const std::string &header) {
+    time_t now = time(nullptr);
+    tm local;
+    localtime_r(&now, &local);
+    char name[64];
+    strftime(name, sizeof(name), "xcmake-%Y%m%d-%H%M%S", &local);
+    _filePath = ga::combine(dir, std::string(name) + "-" + std::to_string(getpid()) + ".log");
+
+    ga::createDirectories(dir);
+    _file = fopen(_filePath.c_str(), "w");
+    if (_file == nullptr) {
+        return false;
+    }
+    _startNs = ga::getMonotonicNs();
+    _failed = false;
+    _buffer.reserve(CAPTURE_LOG_BUFFER_SIZE + 4096);
+    _buffer += "# ";
+    _buffer += header;
+    _buffer += '\n';
+    return true;
+}
+
+void CaptureLog::write(const ga::CapturedLine &line) {
+    appendElapsed((line.timeNs > _startNs) ? (line.timeNs - _startNs) / 1000 : 0, _buffer);
+    _buffer += (line.stream == 2) ? " e " : " o ";
+    _buffer.append(line.text.data(), line.text.size());
+    _buffer += '\n';
+    if (_buffer.size() >= CAPTURE_LOG_BUFFER_SIZE) {
+        flush();
+    }
+}
+
+bool CaptureLog::close(const std::string &footer) {
+    if (_file == nullptr) {
+        return false;
+    }
+    if (!footer.empty()) {
+        _buffer += "# ";
+        _buffer += footer;
+        _buffer += '\n';
+    }
+    flush();
+    bool ok = (fclose(_file) == 0) && !_failed;
+    _file = nullptr;
+    return ok;
+}
+
+void CaptureLog::flush() {
+    if (!_buffer.empty() && fwrite(_buffer.data(), 1, _buffer.size(), _file) != _buffer.size()) {
+        _failed = true;
+    }
+    _buffer.clear();
+}
+
+} // namespace gatools
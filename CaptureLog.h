@@ -0,0 +1,45 @@
+#pragma once
+
+#include "process.h"
+
+#include <cstdio>
+#include <string>
+
+namespace gatools {
+
+/// @brief the log of a captured command: every line of the output with the seconds since the start
+/// and the stream ('o': stdout, 'e': stderr), e.g. "     1.250000 o [ 50%] Building CXX object ...".
+class CaptureLog {
+  public:
+    CaptureLog() = default;
+    CaptureLog(const CaptureLog &) = delete;
+    CaptureLog &operator=(const CaptureLog &) = delete;
+    ~CaptureLog();
+
+    /// @brief create the log of this invocation in the directory ("xcmake-<date>-<time>-<pid>.log").
+    /// The header is the first line of the log.
+    bool open(const std::string &dir, const std::string &header);
+
+    /// @brief add a line, the lines are written to the file in blocks.
+    void write(const ga::CapturedLine &line);
+
+    /// @brief write the footer (the last line of the log) and close the log.
+    /// @return false if the log could not be written.
+    bool close(const std::string &footer);
+
+    const std::string &getFilePath() const { return _filePath; }
+
+    /// @brief the monotonic time of the open, the times of the lines are relative to it.
+    uint64_t getStartNs() const { return _startNs; }
+
+  private:
+    void flush();
+
+    std::string _filePath;
+    FILE *_file = nullptr;
+    uint64_t _startNs = 0;
+    std::string _buffer;
+    bool _failed = false;
+};
+
+} // namespace gatools
@@ -0,0 +1,152 @@
+#include "CbpCache.h"
+
+#include "file_system.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gatools {
+
+namespace {
+
+const char LOCK_FILENAME[] = ".lock";
+const char ENTRY_EXTENSION[] = ".cbp";
+
+/// @brief the second hash of the key uses another seed, a collision would need both hashes to collide.
+const uint64_t SECOND_SEED = 0x9e3779b97f4a7c15ULL;
+
+bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+std::string CbpCache::getDefaultDir(const std::vector<std::string_view> &env, const std::string &home) {
+    static const std::string XDG_CACHE_HOME = "XDG_CACHE_HOME=";
+    for (std::string_view var : env) {
+        if (var.size() > XDG_CACHE_HOME.size() && var.compare(0, XDG_CACHE_HOME.size(), XDG_CACHE_HOME) == 0) {
+            return ga::combine(std::string(var.substr(XDG_CACHE_HOME.size())), "xcmake");
+        }
+    }
+    return ga::combine(ga::combine(home, ".cache"), "xcmake");
+}
+
+std::string CbpCache::getKey(const std::string &input, const std::string &profile) {
+    uint64_t seed = ga::hashBytes(profile.data(), profile.size());
+    std::string key = ga::toHex(ga::hashBytes(input.data(), input.size(), seed));
+    key += ga::toHex(ga::hashBytes(input.data(), input.size(), seed ^ SECOND_SEED));
+    key += ga::toHex(input.size());
+    return key;
+}
+
+CbpCache::CbpCache(const std::string &dir, uint64_t maxBytes)
+    : _dir(dir)
+    , _maxBytes(maxBytes) {}
+
+bool CbpCache::open() { return ga::createDirectories(_dir); }
+
+std::string CbpCache::getEntryPath(const std::string &key) const { return ga::combine(_dir, key + ENTRY_EXTENSION); }
+
+bool CbpCache::get(const std::string &key, std::string &outBytes) const {
+    std::string entryPath = getEntryPath(key);
+    if (!ga::pathExists(entryPath) || !ga::readFile(entryPath, outBytes)) {
+        return false;
+    }
+    // The modification time is the last use of the entry.
+    utimensat(AT_FDCWD, entryPath.c_str(), nullptr, 0);
+    return true;
+}
+
+bool CbpCache::put(const std::string &key, const std::string &bytes) const {
+    static std::atomic<unsigned> counter(0);
+    std::string entryPath = getEntryPath(key);
+    std::string tmpPath = entryPath + "." + std::to_string(getpid()) + "." + std::to_string(counter++) + ".tmp";
+
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = writeAll(fd, bytes.data(), bytes.size());
+    ok = (close(fd) == 0) && ok;
+
+    // rename replaces an entry written by another process for the same key, which has the same content.
+    if (!ok || std::rename(tmpPath.c_str(), entryPath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    _putCount++;
+    return true;
+}
+
+size_t CbpCache::evict() const {
+    std::string lockPath = ga::combine(_dir, LOCK_FILENAME);
+    int lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (lockFd < 0) {
+        return 0;
+    }
+    if (flock(lockFd, LOCK_EX | LOCK_NB) != 0) {
+        close(lockFd);
+        return 0;
+    }
+
+    struct Entry {
+        std::string path;
+        ga::FileStat stat;
+    };
+    std::vector<Entry> entries;
+    uint64_t totalBytes = 0;
+
+    ga::DirectorySearch ds;
+    ds.includeFiles = true;
+    ds.includeDirectories = false;
+    ds.maxRecursionLevel = 0;
+    ga::findInDirectory(
+        _dir,
+        [&entries, &totalBytes](const ga::ChildEntry &child) {
+            Entry entry;
+            entry.path = child.path;
+            // The temp files of a crashed process are evicted like the entries.
+            if (ga::getFilename(entry.path) == LOCK_FILENAME || !ga::getFileStat(entry.path, entry.stat)) {
+                return;
+            }
+            totalBytes += entry.stat.size;
+            entries.push_back(entry);
+        },
+        ds);
+
+    size_t nRemoved = 0;
+    if (totalBytes > _maxBytes) {
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry &lhs, const Entry &rhs) { return lhs.stat.mtimeNs < rhs.stat.mtimeNs; });
+        for (const Entry &entry : entries) {
+            if (totalBytes <= _maxBytes) {
+                break;
+            }
+            // A process that is reading the entry keeps its data until it closes the file.
+            if (std::remove(entry.path.c_str()) == 0) {
+                totalBytes -= entry.stat.size;
+                nRemoved++;
+            }
+        }
+    }
+
+    flock(lockFd, LOCK_UN);
+    close(lockFd);
+    return nRemoved;
+}
+
+} // namespace gatools
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gatools {
+
+/// @brief a content-addressed store of the patched .cbp files, shared by all the xcmake processes of the user.
+/// The key is computed from the bytes of the input and the patch profile, the value is the patched output.
+/// An entry is written to a temp file and renamed, so a reader finds a complete entry or none.
+/// The least recently used entries are evicted when the store is bigger than its size limit.
+class CbpCache {
+  public:
+    /// @brief $XDG_CACHE_HOME/xcmake or <home>/.cache/xcmake.
+    /// @param env the environment of the process ("NAME=value").
+    static std::string getDefaultDir(const std::vector<std::string_view> &env, const std::string &home);
+
+    /// @brief get the key of the input for the profile (hex, 128 bits of hash and the size of the input).
+    static std::string getKey(const std::string &input, const std::string &profile);
+
+    CbpCache(const std::string &dir, uint64_t maxBytes);
+
+    /// @brief create the cache directory.
+    /// @return false if the cache cannot be used.
+    bool open();
+
+    /// @brief get the output stored for the key and mark the entry as recently used.
+    bool get(const std::string &key, std::string &outBytes) const;
+
+    /// @brief store the output of the key. Safe to call from multiple threads and processes.
+    bool put(const std::string &key, const std::string &bytes) const;
+
+    /// @brief remove the least recently used entries until the store fits in its size limit.
+    /// Nothing is done if another process is already evicting.
+    /// @return the number of removed entries.
+    size_t evict() const;
+
+    /// @brief the number of entries stored by put.
+    size_t getPutCount() const { return _putCount; }
+
+    const std::string &getDir() const { return _dir; }
+
+  private:
+    std::string getEntryPath(const std::string &key) const;
+
+    std::string _dir;
+    uint64_t _maxBytes;
+    mutable std::atomic<size_t> _putCount{0};
+};
+
+} // namespace gatools
@@ -0,0 +1,416 @@
+#include "CbpFileApi.h"
+
+#include "file_system.h"
+#include "json.hpp"
+#include "parallel.h"
+
+#include <map>
+#include <set>
+
+namespace gatools {
+
+inline const nlohmann::json *getMember(const nlohmann::json &jObj, const char *key) {
+    if (!jObj.is_object()) {
+        return nullptr;
+    }
+    auto it = jObj.find(key);
+    return (it != jObj.end()) ? &(*it) : nullptr;
+}
+
+inline std::string getString(const nlohmann::json &jObj, const char *key) {
+    const nlohmann::json *jValue = getMember(jObj, key);
+    return (jValue != nullptr && jValue->is_string()) ? jValue->get<std::string>() : std::string();
+}
+
+inline const nlohmann::json &getArray(const nlohmann::json &jObj, const char *key) {
+    static const nlohmann::json emptyArray = nlohmann::json::array();
+    const nlohmann::json *jValue = getMember(jObj, key);
+    return (jValue != nullptr && jValue->is_array()) ? *jValue : emptyArray;
+}
+
+inline const nlohmann::json &getObject(const nlohmann::json &jObj, const char *key) {
+    static const nlohmann::json emptyObject = nlohmann::json::object();
+    const nlohmann::json *jValue = getMember(jObj, key);
+    return (jValue != nullptr && jValue->is_object()) ? *jValue : emptyObject;
+}
+
+/// @brief the path relative to the base directory made absolute and simple.
+inline std::string getAbsolutePath(const std::string &baseDir, const std::string &path) {
+    std::string absolutePath;
+    ga::getSimplePath(ga::isAbsolutePath(path) ? path : ga::combine(baseDir, path), absolutePath);
+    return absolutePath;
+}
+
+inline bool readJsonFile(const std::string &filePath, nlohmann::json &outJson, std::string &outError) {
+    std::string bytes;
+    if (!ga::readFile(filePath, bytes)) {
+        outError = filePath + " could not be read";
+        return false;
+    }
+    outJson = nlohmann::json::parse(bytes, nullptr, false);
+    if (outJson.is_discarded() || !outJson.is_object()) {
+        outError = filePath + " is not a json object";
+        return false;
+    }
+    return true;
+}
+
+inline void addUnique(const std::string &value, std::set<std::string> &seen, std::vector<std::string> &out) {
+    if (seen.insert(value).second) {
+        out.push_back(value);
+    }
+}
+
+/// @brief read the settings of a target from its reply file.
+inline bool readTarget(const std::string &replyDir, const std::string &jsonFile, const FileApiCodemodel &codemodel,
+                       FileApiTarget &outTarget, std::string &outError) {
+    nlohmann::json jTarget;
+    if (!readJsonFile(ga::combine(replyDir, jsonFile), jTarget, outError)) {
+        return false;
+    }
+
+    outTarget.name = getString(jTarget, "name");
+    outTarget.type = getString(jTarget, "type");
+    outTarget.buildDir = getAbsolutePath(codemodel.buildDir, getString(getObject(jTarget, "paths"), "build"));
+    for (const nlohmann::json &jArtifact : getArray(jTarget, "artifacts")) {
+        std::string path = getString(jArtifact, "path");
+        if (!path.empty()) {
+            outTarget.output = getAbsolutePath(codemodel.buildDir, path);
+            break;
+        }
+    }
+
+    std::set<std::string> seenDefines;
+    std::set<std::string> seenIncludes;
+    for (const nlohmann::json &jGroup : getArray(jTarget, "compileGroups")) {
+        for (const nlohmann::json &jDefine : getArray(jGroup, "defines")) {
+            addUnique(getString(jDefine, "define"), seenDefines, outTarget.defines);
+        }
+        for (const nlohmann::json &jInclude : getArray(jGroup, "includes")) {
+            addUnique(getAbsolutePath(codemodel.sourceDir, getString(jInclude, "path")), seenIncludes,
+                      outTarget.includes);
+        }
+    }
+    for (const nlohmann::json &jSource : getArray(jTarget, "sources")) {
+        outTarget.sources.push_back(getAbsolutePath(codemodel.sourceDir, getString(jSource, "path")));
+    }
+
+    if (outTarget.name.empty()) {
+        outError = jsonFile + " has no target name";
+        return false;
+    }
+    return true;
+}
+
+bool writeFileApiQuery(const std::string &buildDir) {
+    std::string queryFilePath = ga::combine(buildDir, FILE_API_QUERY);
+    if (ga::pathExists(queryFilePath)) {
+        return true;
+    }
+    return ga::createDirectories(ga::getParent(queryFilePath)) && ga::writeFile(queryFilePath, std::string());
+}
+
+bool readFileApiReply(const std::string &buildDir, size_t workerCount, FileApiCodemodel &outCodemodel,
+                      std::string &outError) {
+    outCodemodel = FileApiCodemodel();
+    outError.clear();
+
+    // cmake keeps only the index of the last configure, the newest one has the largest name.
+    std::string replyDir = ga::combine(buildDir, FILE_API_REPLY_DIR);
+    std::string indexName;
+    ga::DirectorySearch ds;
+    ds.includeFiles = true;
+    ds.includeDirectories = false;
+    ds.maxRecursionLevel = 0;
+    ga::findInDirectory(
+        replyDir,
+        [&indexName](const ga::ChildEntry &entry) {
+            std::string name = entry.name;
+            if (name.compare(0, 6, "index-") == 0 && ga::getFileExtension(name) == "json" && name > indexName) {
+                indexName = name;
+            }
+        },
+        ds);
+    if (indexName.empty()) {
+        outError = "no reply index in " + replyDir;
+        return false;
+    }
+
+    nlohmann::json jIndex;
+    if (!readJsonFile(ga::combine(replyDir, indexName), jIndex, outError)) {
+        return false;
+    }
+    outCodemodel.cmakePath = getString(getObject(getObject(jIndex, "cmake"), "paths"), "cmake");
+    std::string codemodelFile;
+    for (const nlohmann::json &jObject : getArray(jIndex, "objects")) {
+        const nlohmann::json *jMajor = getMember(getObject(jObject, "version"), "major");
+        if (getString(jObject, "kind") == "codemodel" && jMajor != nullptr && *jMajor == 2) {
+            codemodelFile = getString(jObject, "jsonFile");
+            break;
+        }
+    }
+    if (codemodelFile.empty()) {
+        outError = indexName + " has no codemodel-v2 object";
+        return false;
+    }
+
+    nlohmann::json jCodemodel;
+    if (!readJsonFile(ga::combine(replyDir, codemodelFile), jCodemodel, outError)) {
+        return false;
+    }
+    const nlohmann::json &jPaths = getObject(jCodemodel, "paths");
+    outCodemodel.sourceDir = getString(jPaths, "source");
+    outCodemodel.buildDir = getString(jPaths, "build");
+    const nlohmann::json &jConfigurations = getArray(jCodemodel, "configurations");
+    if (jConfigurations.empty()) {
+        outError = codemodelFile + " has no configuration";
+        return false;
+    }
+    // A multi-config generator has one configuration per build type, the sources and targets are the same.
+    const nlohmann::json &jConfiguration = jConfigurations[0];
+    for (const nlohmann::json &jProject : getArray(jConfiguration, "projects")) {
+        if (getMember(jProject, "parentIndex") == nullptr) {
+            outCodemodel.projectName = getString(jProject, "name");
+            break;
+        }
+    }
+    for (const nlohmann::json &jDirectory : getArray(jConfiguration, "directories")) {
+        outCodemodel.directories.push_back(getString(jDirectory, "source"));
+    }
+    std::vector<std::string> targetFiles;
+    for (const nlohmann::json &jTarget : getArray(jConfiguration, "targets")) {
+        targetFiles.push_back(getString(jTarget, "jsonFile"));
+    }
+
+    // The target files are the bulk of a large codemodel, every task parses one of them.
+    outCodemodel.targets.resize(targetFiles.size());
+    std::vector<std::string> targetErrors(targetFiles.size());
+    ga::parallelFor(targetFiles.size(), workerCount,
+                    [&replyDir, &targetFiles, &outCodemodel, &targetErrors](size_t, size_t t) {
+                        readTarget(replyDir, targetFiles[t], outCodemodel, outCodemodel.targets[t], targetErrors[t]);
+                    });
+    for (const std::string &targetError : targetErrors) {
+        if (!targetError.empty()) {
+            outError = targetError;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief append the value escaped for a xml attribute.
+inline void appendXmlEscaped(const std::string &value, std::string &out) {
+    for (char c : value) {
+        switch (c) {
+        case '&':
+            out += "&amp;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        default:
+            out += c;
+            break;
+        }
+    }
+}
+
+/// @brief the type of the Code::Blocks target (1: console application, 2: static library, 3: dynamic library,
+/// 4: commands only).
+inline int getCBPTargetType(const std::string &type) {
+    if (type == "EXECUTABLE") {
+        return 1;
+    }
+    if (type == "STATIC_LIBRARY" || type == "OBJECT_LIBRARY") {
+        return 2;
+    }
+    if (type == "SHARED_LIBRARY" || type == "MODULE_LIBRARY") {
+        return 3;
+    }
+    return 4;
+}
+
+/// @brief the "CMake Files" virtual folder of a source directory ("sub/dir" -> "CMake Files\sub\dir\").
+inline std::string getCMakeFilesFolder(const std::string &directory) {
+    std::string folder = "CMake Files\\";
+    if (directory != ".") {
+        for (char c : directory) {
+            folder += (c == '/') ? '\\' : c;
+        }
+        folder += '\\';
+    }
+    return folder;
+}
+
+class CbpWriter {
+  public:
+    explicit CbpWriter(std::string &out)
+        : _out(out) {}
+
+    void open(int level, const char *name) {
+        indent(level);
+        _out += '<';
+        _out += name;
+        _out += ">\n";
+    }
+
+    /// @brief open an element with a single attribute.
+    void open(int level, const char *name, const char *attrName, const std::string &value) {
+        start(level, name);
+        attribute(attrName, value);
+        _out += ">\n";
+    }
+
+    void close(int level, const char *name) {
+        indent(level);
+        _out += "</";
+        _out += name;
+        _out += ">\n";
+    }
+
+    /// @brief start an element, the attributes are added with attribute() and the element is ended with end().
+    void start(int level, const char *name) {
+        indent(level);
+        _out += '<';
+        _out += name;
+    }
+
+    void attribute(const char *name, const std::string &value) {
+        _out += ' ';
+        _out += name;
+        _out += "=\"";
+        appendXmlEscaped(value, _out);
+        _out += '"';
+    }
+
+    void end() { _out += "/>\n"; }
+
+    void end(int level, const char *name, const char *attrName, const std::string &value) {
+        start(level, name);
+        attribute(attrName, value);
+        end();
+    }
+
+  private:
+    void indent(int level) { _out.append(static_cast<size_t>(level), '\t'); }
+
+    std::string &_out;
+};
+
+inline void writeMakeCommands(const FileApiCodemodel &codemodel, const std::string &target, CbpWriter &writer) {
+    std::string build = "\"" + codemodel.cmakePath + "\" --build \"" + codemodel.buildDir + "\" --target ";
+    writer.open(4, "MakeCommands");
+    writer.end(5, "Build", "command", build + target);
+    writer.end(5, "Clean", "command", build + "clean");
+    writer.end(5, "DistClean", "command", build + "clean");
+    writer.close(4, "MakeCommands");
+}
+
+std::string generateCBP(const FileApiCodemodel &codemodel) {
+    std::string out;
+    CbpWriter writer(out);
+
+    // The CMakeLists.txt files are grouped by directory, every level of a directory is a folder.
+    std::vector<std::string> folders;
+    std::set<std::string> seenFolders;
+    for (const std::string &directory : codemodel.directories) {
+        for (size_t pos = directory.find('/'); pos != std::string::npos; pos = directory.find('/', pos + 1)) {
+            addUnique(getCMakeFilesFolder(directory.substr(0, pos)), seenFolders, folders);
+        }
+        addUnique(getCMakeFilesFolder(directory), seenFolders, folders);
+    }
+    std::string virtualFolders;
+    for (const std::string &folder : folders) {
+        virtualFolders += folder;
+        virtualFolders += ';';
+    }
+
+    out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    writer.open(0, "CodeBlocks_project_file");
+    writer.start(1, "FileVersion");
+    writer.attribute("major", "1");
+    writer.attribute("minor", "6");
+    writer.end();
+    writer.open(1, "Project");
+    writer.end(2, "Option", "title", codemodel.projectName);
+    writer.end(2, "Option", "makefile_is_custom", "1");
+    writer.end(2, "Option", "compiler", "gcc");
+    writer.end(2, "Option", "virtualFolders", virtualFolders);
+    writer.open(2, "Build");
+
+    writer.open(3, "Target", "title", "all");
+    writer.end(4, "Option", "working_dir", codemodel.buildDir);
+    writer.end(4, "Option", "type", "4");
+    writeMakeCommands(codemodel, "all", writer);
+    writer.close(3, "Target");
+
+    // The units are sorted by path, like the extra generator of cmake does.
+    std::map<std::string, std::vector<const std::string *>> unitTargets;
+    for (const FileApiTarget &target : codemodel.targets) {
+        int type = getCBPTargetType(target.type);
+        writer.open(3, "Target", "title", target.name);
+        if (!target.output.empty()) {
+            writer.start(4, "Option");
+            writer.attribute("output", target.output);
+            writer.attribute("prefix_auto", "0");
+            writer.attribute("extension_auto", "0");
+            writer.end();
+        }
+        writer.end(4, "Option", "working_dir", target.buildDir);
+        if (type != 4) {
+            writer.end(4, "Option", "object_output", "./");
+        }
+        writer.end(4, "Option", "type", std::to_string(type));
+        if (type != 4) {
+            writer.end(4, "Option", "compiler", "gcc");
+            writer.open(4, "Compiler");
+            for (const std::string &define : target.defines) {
+                writer.end(5, "Add", "option", "-D" + define);
+            }
+            for (const std::string &include : target.includes) {
+                writer.end(5, "Add", "directory", include);
+            }
+            writer.close(4, "Compiler");
+        }
+        writeMakeCommands(codemodel, target.name, writer);
+        writer.close(3, "Target");
+
+        for (const std::string &source : target.sources) {
+            std::vector<const std::string *> &targets = unitTargets[source];
+            if (targets.empty() || targets.back() != &target.name) {
+                targets.push_back(&target.name);
+            }
+        }
+    }
+    writer.close(2, "Build");
+
+    for (const std::string &directory : codemodel.directories) {
+        std::string cmakeLists = ga::combine(getAbsolutePath(codemodel.sourceDir, directory), "CMakeLists.txt");
+        writer.open(2, "Unit", "filename", cmakeLists);
+        writer.end(3, "Option", "virtualFolder", getCMakeFilesFolder(directory));
+        writer.close(2, "Unit");
+    }
+    for (const auto &kv : unitTargets) {
+        writer.open(2, "Unit", "filename", kv.first);
+        for (const std::string *targetName : kv.second) {
+            writer.end(3, "Option", "target", *targetName);
+        }
+        writer.close(2, "Unit");
+    }
+
+    writer.close(1, "Project");
+    writer.close(0, "CodeBlocks_project_file");
+    return out;
+}
+
+std::string getGeneratedCBPFilename(const FileApiCodemodel &codemodel) {
+    return (codemodel.projectName.empty() ? std::string("Project") : codemodel.projectName) + ".cbp";
+}
+
+} // namespace gatools
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace gatools {
+
+/// @brief the stateless query of the codemodel, relative to the build directory.
+const char *const FILE_API_QUERY = ".cmake/api/v1/query/codemodel-v2";
+
+/// @brief the directory of the replies written by cmake, relative to the build directory.
+const char *const FILE_API_REPLY_DIR = ".cmake/api/v1/reply";
+
+/// @brief a target of the codemodel-v2 reply, with the settings the .cbp needs.
+struct FileApiTarget {
+    std::string name;
+    /// @brief "EXECUTABLE", "STATIC_LIBRARY", "SHARED_LIBRARY", "MODULE_LIBRARY", "OBJECT_LIBRARY" or "UTILITY".
+    std::string type;
+    /// @brief the absolute build directory of the target.
+    std::string buildDir;
+    /// @brief the absolute path of the first artifact, empty if the target has none.
+    std::string output;
+    /// @brief the defines and the include directories of all the compile groups, in order and without duplicates.
+    std::vector<std::string> defines;
+    std::vector<std::string> includes;
+    /// @brief the absolute paths of the sources.
+    std::vector<std::string> sources;
+};
+
+/// @brief the first configuration of the codemodel-v2 reply.
+struct FileApiCodemodel {
+    /// @brief the cmake that wrote the reply, used for the build commands.
+    std::string cmakePath;
+    std::string sourceDir;
+    std::string buildDir;
+    /// @brief the name of the top level project.
+    std::string projectName;
+    /// @brief the source directories containing a CMakeLists.txt, relative to sourceDir ("." for the top level).
+    std::vector<std::string> directories;
+    std::vector<FileApiTarget> targets;
+};
+
+/// @brief ask cmake for the codemodel: the query is an empty file, cmake answers it on every configure.
+bool writeFileApiQuery(const std::string &buildDir);
+
+/// @brief read the newest reply of the build directory.
+/// The index and the codemodel are read first, the target files are then parsed on workerCount threads.
+/// @return false and the reason in outError if there is no reply or if a file cannot be read or parsed.
+bool readFileApiReply(const std::string &buildDir, size_t workerCount, FileApiCodemodel &outCodemodel,
+                      std::string &outError);
+
+/// @brief generate the .cbp that the "CodeBlocks" extra generator of cmake writes for the codemodel.
+/// The "all" target and one target per codemodel target are written, the build commands run "cmake --build",
+/// so the .cbp works with any generator. The sources and the CMakeLists.txt files are the units.
+/// The result is not patched yet: it is patched like the .cbp files written by cmake.
+std::string generateCBP(const FileApiCodemodel &codemodel);
+
+/// @brief the file name of the generated .cbp in the build directory.
+std::string getGeneratedCBPFilename(const FileApiCodemodel &codemodel);
+
+} // namespace gatools
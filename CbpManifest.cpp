@@ -0,0 +1,98 @@
+#include "CbpManifest.h"
+
+#include "json.hpp"
+#include <set>
+
+namespace gatools {
+
+const std::string CbpManifest::FILENAME = ".xcmake_manifest.json";
+
+void CbpManifest::load(const std::string &buildDir, const std::string &profile) {
+    _filePath = ga::combine(buildDir, FILENAME);
+    _profile = profile;
+    _entries.clear();
+    _modified = false;
+
+    std::string jStr;
+    if (!ga::readFile(_filePath, jStr)) {
+        return;
+    }
+
+    nlohmann::json jObj = nlohmann::json::parse(jStr, nullptr, false);
+    if (!jObj.is_object() || !jObj.contains("profile") || jObj["profile"] != _profile || !jObj.contains("files") ||
+        !jObj["files"].is_object()) {
+        // Written by another version or for other settings: everything will be checked again.
+        _modified = true;
+        return;
+    }
+
+    for (const auto &kv : jObj["files"].items()) {
+        const nlohmann::json &jEntry = kv.value();
+        if (!jEntry.is_object()) {
+            continue;
+        }
+
+        CbpManifestEntry entry;
+        entry.stat.size = jEntry.value("size", uint64_t(0));
+        entry.stat.mtimeNs = jEntry.value("mtimeNs", int64_t(0));
+        entry.stat.inode = jEntry.value("inode", uint64_t(0));
+        _entries[kv.key()] = entry;
+    }
+}
+
+bool CbpManifest::save() {
+    if (!_modified || _filePath.empty()) {
+        return true;
+    }
+
+    nlohmann::json jFiles = nlohmann::json::object();
+    for (const auto &kv : _entries) {
+        nlohmann::json jEntry;
+        jEntry["size"] = kv.second.stat.size;
+        jEntry["mtimeNs"] = kv.second.stat.mtimeNs;
+        jEntry["inode"] = kv.second.stat.inode;
+        jFiles[kv.first] = jEntry;
+    }
+
+    nlohmann::json jObj;
+    jObj["profile"] = _profile;
+    jObj["files"] = jFiles;
+
+    bool ok = ga::writeFile(_filePath, jObj.dump(2));
+    if (ok) {
+        _modified = false;
+    }
+    return ok;
+}
+
+bool CbpManifest::isUnchanged(const std::string &filePath, const ga::FileStat &stat) const {
+    auto it = _entries.find(filePath);
+    return (it != _entries.end()) && (it->second.stat == stat);
+}
+
+void CbpManifest::set(const std::string &filePath, const CbpManifestEntry &entry) {
+    auto it = _entries.find(filePath);
+    if (it != _entries.end() && it->second.stat == entry.stat) {
+        return;
+    }
+    _entries[filePath] = entry;
+    _modified = true;
+}
+
+void CbpManifest::retain(const std::vector<std::string> &filePaths) {
+    std::set<std::string> keep(filePaths.begin(), filePaths.end());
+    for (auto it = _entries.begin(); it != _entries.end();) {
+        if (keep.find(it->first) == keep.end()) {
+            it = _entries.erase(it);
+            _modified = true;
+        } else {
+            it++;
+        }
+    }
+}
+
+bool createManifestEntry(const std::string &filePath, CbpManifestEntry &outEntry) {
+    return ga::getFileStat(filePath, outEntry.stat);
+}
+
+} // namespace gatools
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "file_system.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gatools {
+
+/// @brief a file is unchanged while its size, modification time and inode match the entry.
+struct CbpManifestEntry {
+    ga::FileStat stat;
+};
+
+/// @brief remembers the .cbp files of a build directory that were written or checked by xcmake.
+/// A file whose size, modification time and inode still match its entry does not need to be opened again.
+class CbpManifest {
+  public:
+    static const std::string FILENAME;
+
+    /// @brief load the manifest of the build directory.
+    /// The entries are dropped if they were recorded with another patch profile (SDK, rules...).
+    void load(const std::string &buildDir, const std::string &profile);
+
+    /// @brief write the manifest if it was modified.
+    bool save();
+
+    bool isUnchanged(const std::string &filePath, const ga::FileStat &stat) const;
+
+    void set(const std::string &filePath, const CbpManifestEntry &entry);
+
+    /// @brief drop the entries of the files that are not in filePaths.
+    void retain(const std::vector<std::string> &filePaths);
+
+    size_t size() const { return _entries.size(); }
+
+  private:
+    std::string _filePath;
+    std::string _profile;
+    std::map<std::string, CbpManifestEntry> _entries;
+    bool _modified = false;
+};
+
+/// @brief create a manifest entry for the current state of the file, the file is not read.
+bool createManifestEntry(const std::string &filePath, CbpManifestEntry &outEntry);
+
+} // namespace gatools
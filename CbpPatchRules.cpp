@@ -0,0 +1,198 @@
+#include "CbpPatchRules.h"
+
+#include "CbpPatcher.h"
+#include "CbpRewriteCache.h"
+
+#include <algorithm>
+
+namespace gatools {
+
+namespace {
+
+struct ActionName {
+    const char *name;
+    PatchAction action;
+    bool builtInOnly;
+};
+
+const ActionName ACTION_NAMES[] = {
+    {"sdkPrefix", PatchAction::SdkPrefix, false},
+    {"virtualFolder", PatchAction::VirtualFolder, false},
+    {"replace", PatchAction::Replace, false},
+    {"projectOption", PatchAction::ProjectOption, true},
+    {"injectCompiler", PatchAction::InjectCompiler, true},
+};
+
+bool findAction(const std::string &name, bool builtIn, PatchAction &outAction) {
+    for (const ActionName &actionName : ACTION_NAMES) {
+        if (name == actionName.name && (builtIn || !actionName.builtInOnly)) {
+            outAction = actionName.action;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool replaceAll(const std::string &from, const std::string &to, std::string &inOutStr) {
+    if (from.empty()) {
+        return false;
+    }
+    bool changed = false;
+    size_t start_pos = 0;
+    while ((start_pos = inOutStr.find(from, start_pos)) != std::string::npos) {
+        inOutStr.replace(start_pos, from.length(), to);
+        start_pos += to.length();
+        changed = true;
+    }
+    return changed && (from != to);
+}
+
+} // namespace
+
+bool getPatchAction(const std::string &name, PatchAction &outAction) { return findAction(name, false, outAction); }
+
+const std::vector<CbpPatchRule> &CbpPatchRules::NameEntry::getRules(int parentId) const {
+    for (const auto &kv : byParent) {
+        if (kv.first == parentId) {
+            return kv.second;
+        }
+    }
+    return anyParent;
+}
+
+const std::vector<JPatchRule> &CbpPatchRules::getBuiltInRules() {
+    static const std::vector<JPatchRule> builtInRules = {
+        {"Compiler/Add", "directory", "sdkPrefix", "", ""},
+        {"Unit", "filename", "sdkPrefix", "", ""},
+        {"Unit/Option", "virtualFolder", "virtualFolder", "", ""},
+        // In the Project section there will be multiple Option children.
+        {"Project/Option", "virtualFolders", "projectOption", "", ""},
+        {"Compiler", "", "injectCompiler", "", ""},
+    };
+    return builtInRules;
+}
+
+std::shared_ptr<const CbpPatchRules> CbpPatchRules::getDefault() {
+    static const std::shared_ptr<const CbpPatchRules> defaultRules = compile({});
+    return defaultRules;
+}
+
+std::shared_ptr<const CbpPatchRules> CbpPatchRules::compile(const std::vector<JPatchRule> &userRules,
+                                                            std::vector<std::string> *outErrors) {
+    std::shared_ptr<CbpPatchRules> rules(new CbpPatchRules());
+    std::string error;
+    for (const JPatchRule &rule : getBuiltInRules()) {
+        rules->add(rule, true, error);
+    }
+    for (const JPatchRule &rule : userRules) {
+        if (!rules->add(rule, false, error) && outErrors != nullptr) {
+            outErrors->push_back(error);
+        }
+    }
+    return rules;
+}
+
+const CbpPatchRules::NameEntry *CbpPatchRules::find(const char *name) const {
+    if (name == nullptr) {
+        return nullptr;
+    }
+    auto it = _entries.find(std::string_view(name));
+    return (it != _entries.end()) ? &it->second : nullptr;
+}
+
+int CbpPatchRules::intern(const std::string &name) {
+    auto it = _entries.find(std::string_view(name));
+    if (it != _entries.end()) {
+        return it->second.id;
+    }
+
+    _names.push_back(name);
+    NameEntry &entry = _entries[std::string_view(_names.back())];
+    entry.id = static_cast<int>(_names.size());
+    return entry.id;
+}
+
+bool CbpPatchRules::add(const JPatchRule &rule, bool builtIn, std::string &outError) {
+    CbpPatchRule compiled;
+    if (!findAction(rule.action, builtIn, compiled.action)) {
+        outError = "unknown action: " + rule.action + " for path: " + rule.path;
+        return false;
+    }
+    if (rule.attribute.empty() && compiled.action != PatchAction::InjectCompiler) {
+        outError = "missing attribute for path: " + rule.path;
+        return false;
+    }
+    compiled.attribute = rule.attribute;
+    compiled.from = rule.from;
+    compiled.to = rule.to;
+
+    // "Parent/Element", "*/Element" or "Element"
+    std::string parentName;
+    std::string name = rule.path;
+    size_t separator = rule.path.find('/');
+    if (separator != std::string::npos) {
+        parentName = rule.path.substr(0, separator);
+        name = rule.path.substr(separator + 1);
+        if (parentName == "*") {
+            parentName.clear();
+        }
+    }
+    if (name.empty() || name.find('/') != std::string::npos) {
+        outError = "invalid path: " + rule.path;
+        return false;
+    }
+
+    int parentId = parentName.empty() ? UNKNOWN_NAME : intern(parentName);
+    intern(name);
+    NameEntry &entry = _entries[std::string_view(name)];
+
+    if (parentName.empty()) {
+        // The lists for specific parents also contain the rules for any parent, in the order of the rules.
+        entry.anyParent.push_back(compiled);
+        for (auto &kv : entry.byParent) {
+            kv.second.push_back(compiled);
+        }
+    } else {
+        auto it = std::find_if(entry.byParent.begin(), entry.byParent.end(),
+                               [parentId](const std::pair<int, std::vector<CbpPatchRule>> &kv) {
+                                   return kv.first == parentId;
+                               });
+        if (it == entry.byParent.end()) {
+            entry.byParent.emplace_back(parentId, entry.anyParent);
+            it = entry.byParent.end() - 1;
+        }
+        it->second.push_back(compiled);
+    }
+    return true;
+}
+
+bool applyPatchRule(const CbpPatchRule &rule, const CbpPatchContext &context, std::string &value) {
+    switch (rule.action) {
+    case PatchAction::SdkPrefix:
+        return rewriteValue(RewriteKind::SdkPrefix, context, value);
+    case PatchAction::VirtualFolder:
+    case PatchAction::ProjectOption:
+        return rewriteValue(RewriteKind::VirtualFolder, context, value);
+    case PatchAction::Replace:
+        return replaceAll(rule.from, rule.to, value);
+    case PatchAction::InjectCompiler:
+        break;
+    }
+    return false;
+}
+
+bool applyPatchRule(const CbpPatchRule &rule, const CbpPatchContext &context, tinyxml2::XMLElement *elem) {
+    std::string value;
+    if (!getAttribute(elem, rule.attribute.c_str(), value)) {
+        return false;
+    }
+
+    if (!applyPatchRule(rule, context, value)) {
+        return false;
+    }
+
+    elem->SetAttribute(rule.attribute.c_str(), value.c_str());
+    return true;
+}
+
+} // namespace gatools
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Config.h"
+#include "tinyxml2.h"
+#include <deque>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
+namespace gatools {
+
+struct CbpPatchContext;
+
+enum class PatchAction {
+    /// @brief relocate the /usr paths of the attribute inside the SDK (addPrefix).
+    SdkPrefix,
+    /// @brief relocate the "CMake Files\..." virtual folders of the attribute (addPrefixToVirtualFolder).
+    VirtualFolder,
+    /// @brief replace every occurrence of "from" with "to" in the attribute.
+    Replace,
+    /// @brief the Options of the Project: create or read the note and patch the virtual folders of the attribute.
+    ProjectOption,
+    /// @brief add the extraAddDirectory and the gccClangFixes to the Compiler when the note was created.
+    InjectCompiler,
+};
+
+struct CbpPatchRule {
+    PatchAction action;
+    std::string attribute;
+    std::string from;
+    std::string to;
+};
+
+/// @brief get the action of a JPatchRule ("sdkPrefix", "virtualFolder", "replace").
+/// @return false if the action is unknown or cannot be used in the config.
+bool getPatchAction(const std::string &name, PatchAction &outAction);
+
+/// @brief the patch rules compiled into a dispatch table.
+/// Every element name used by a rule is interned, the rules of an element are found with one hash lookup
+/// of its name and the id of its parent (which is known from the parent's lookup).
+class CbpPatchRules {
+  public:
+    /// @brief the id of the names not used by any rule.
+    static const int UNKNOWN_NAME = 0;
+
+    struct NameEntry {
+        int id = UNKNOWN_NAME;
+        /// @brief the rules for a specific parent id (including the rules for any parent).
+        std::vector<std::pair<int, std::vector<CbpPatchRule>>> byParent;
+        /// @brief the rules for any parent.
+        std::vector<CbpPatchRule> anyParent;
+
+        const std::vector<CbpPatchRule> &getRules(int parentId) const;
+    };
+
+    /// @brief the built-in rules (the ones patchCBP always used).
+    static const std::vector<JPatchRule> &getBuiltInRules();
+
+    /// @brief get the compiled built-in rules.
+    static std::shared_ptr<const CbpPatchRules> getDefault();
+
+    /// @brief compile the built-in rules followed by the user rules.
+    /// The user rules that cannot be compiled are skipped and described in outErrors.
+    static std::shared_ptr<const CbpPatchRules> compile(const std::vector<JPatchRule> &userRules,
+                                                        std::vector<std::string> *outErrors = nullptr);
+
+    /// @return nullptr if no rule uses the name.
+    const NameEntry *find(const char *name) const;
+
+  private:
+    CbpPatchRules() = default;
+
+    int intern(const std::string &name);
+
+    bool add(const JPatchRule &rule, bool builtIn, std::string &outError);
+
+    std::deque<std::string> _names;
+    std::unordered_map<std::string_view, NameEntry> _entries;
+};
+
+/// @brief apply a value rule (SdkPrefix, VirtualFolder, Replace, ProjectOption) to the value.
+/// @return true if the value was changed.
+bool applyPatchRule(const CbpPatchRule &rule, const CbpPatchContext &context, std::string &value);
+
+/// @brief apply a value rule to the attribute of the element.
+/// @return true if the attribute was changed.
+bool applyPatchRule(const CbpPatchRule &rule, const CbpPatchContext &context, tinyxml2::XMLElement *elem);
+
+} // namespace gatools
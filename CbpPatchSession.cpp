@@ -0,0 +1,31 @@
+#include "CbpPatchSession.h"
+
+namespace gatools {
+
+CbpPatchSession::CbpPatchSession(std::shared_ptr<const CbpPatchProfile> profile)
+    : _profile(std::move(profile))
+    , _context(new CbpPatchContext()) {
+    _context->projectDir = _profile->projectDir;
+    _context->buildDir = _profile->buildDir;
+    _context->sdkDir = _profile->sdkDir;
+    _context->extraAddDirectory = _profile->extraAddDirectory;
+    _context->gccClangFixes = _profile->gccClangFixes;
+    _context->patchRules = _profile->patchRules;
+    _context->rewriteRoots = _profile->rewriteRoots;
+    _context->rewriteCache = _profile->rewriteCache;
+    _context->elementWorkers = _profile->elementWorkers;
+}
+
+CbpPatchContext &CbpPatchSession::begin(const std::string &cbpFilePath) {
+    CbpPatchContext &context = *_context;
+    context.inOutXml.Clear();
+    context.cbpFilePath = cbpFilePath;
+    context.virtualFolderPrefix.clear();
+    context.oldSdkPrefix.clear();
+    context.oldVirtualFolderPrefix.clear();
+    _output.clear();
+    _fileCount++;
+    return context;
+}
+
+} // namespace gatools
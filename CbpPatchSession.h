@@ -0,0 +1,46 @@
+#pragma once
+
+#include "CbpPatcher.h"
+#include <memory>
+
+namespace gatools {
+
+/// @brief the settings of a patch run, shared by the sessions of all the workers.
+struct CbpPatchProfile {
+    std::string projectDir;
+    std::string buildDir;
+    std::string sdkDir;
+    std::vector<std::string> extraAddDirectory;
+    std::set<std::string> gccClangFixes;
+    std::shared_ptr<const CbpPatchRules> patchRules;
+    std::shared_ptr<const CbpRewriteRoots> rewriteRoots;
+    std::shared_ptr<CbpRewriteCache> rewriteCache;
+    size_t elementWorkers = 1;
+};
+
+/// @brief the state reused by one worker for all the .cbp files it patches.
+/// The profile is copied into the context only once, the document is cleared between the files
+/// (XMLDocument::Clear keeps the blocks of its memory pools) and the output buffer keeps its capacity.
+class CbpPatchSession {
+  public:
+    explicit CbpPatchSession(std::shared_ptr<const CbpPatchProfile> profile);
+
+    /// @brief get the context for the next file, the state of the previous file is reset.
+    CbpPatchContext &begin(const std::string &cbpFilePath);
+
+    /// @brief the buffer for the patched document.
+    std::string &getOutput() { return _output; }
+
+    const CbpPatchProfile &getProfile() const { return *_profile; }
+
+    /// @brief the number of files patched with the session.
+    size_t getFileCount() const { return _fileCount; }
+
+  private:
+    std::shared_ptr<const CbpPatchProfile> _profile;
+    std::unique_ptr<CbpPatchContext> _context;
+    std::string _output;
+    size_t _fileCount = 0;
+};
+
+} // namespace gatools
@@ -1,7 +1,13 @@
 #include "CbpPatcher.h"
+#include "CbpPatchRules.h"
+#include "CbpRewriteRoots.h"
 #include "file_system.h"
+#include "parallel.h"
 
-#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string_view>
 
 namespace gatools {
 
@@ -26,10 +32,12 @@ std::ostream &operator<<(std::ostream &os, PatchResult in) {
     return os;
 }
 
-inline void split(const std::string &input, const std::string &separator, std::vector<std::string> &parts) {
+/// @brief split into views of the input. A last part shorter than 2 characters is dropped.
+inline void split(std::string_view input, std::string_view separator, std::vector<std::string_view> &parts) {
+    parts.clear();
     size_t start = 0;
     size_t end = input.find(separator);
-    while (end != std::string::npos) {
+    while (end != std::string_view::npos) {
         parts.push_back(input.substr(start, end - start));
         start = end + separator.length();
         end = input.find(separator, start);
@@ -39,17 +47,27 @@ inline void split(const std::string &input, const std::string &separator, std::v
     }
 }
 
-inline std::string join(const std::vector<std::string> &content, const std::string &separator) {
-    std::stringstream ss;
+inline std::string join(const std::vector<std::string_view> &content, std::string_view separator) {
+    std::string result;
     size_t n = content.size();
     if (n > 0) {
-        ss << content[0];
+        size_t size = separator.size() * (n - 1);
+        for (std::string_view part : content) {
+            size += part.size();
+        }
+        result.reserve(size);
+
+        result.append(content[0].data(), content[0].size());
         for (size_t i = 1; i < n; i++) {
-            ss << separator;
-            ss << content[i];
+            result.append(separator.data(), separator.size());
+            result.append(content[i].data(), content[i].size());
         }
     }
-    return ss.str();
+    return result;
+}
+
+inline bool startsWith(std::string_view value, std::string_view prefix) {
+    return value.size() >= prefix.size() && value.compare(0, prefix.size(), prefix) == 0;
 }
 
 inline void cleanPathSeparators(std::string &path, char separator) {
@@ -72,80 +90,154 @@ bool getAttribute(XmlElemPtr elem, const char *attrName, std::string &outValue)
     return ok;
 }
 
-void addPrefix(XmlElemPtr elem, const char *attrName, const std::string &prefix) {
+const CbpRewriteRoots &getRewriteRoots(const CbpPatchContext &context) {
+    if (context.rewriteRoots) {
+        return *context.rewriteRoots;
+    }
+    static const std::shared_ptr<const CbpRewriteRoots> defaultRoots = CbpRewriteRoots::getDefault();
+    return *defaultRoots;
+}
+
+bool addPrefix(std::string &value, const std::string &prefix) {
+    return addPrefix(value, prefix, *CbpRewriteRoots::getDefault());
+}
+
+bool addPrefix(std::string &value, const std::string &prefix, const CbpRewriteRoots &roots) {
+    size_t idx = roots.find(value);
+    if (idx == CbpRewriteRoots::NOT_FOUND) {
+        return false;
+    }
+
+    std::string result;
+    result.reserve(prefix.size() + value.size() - idx);
+    result.append(prefix);
+    result.append(value, idx, std::string::npos);
+    ga::getSimplePath(result, result);
+    if (result == value) {
+        return false;
+    }
+
+    value = std::move(result);
+    return true;
+}
+
+bool addPrefix(XmlElemPtr elem, const char *attrName, const std::string &prefix) {
+    return addPrefix(elem, attrName, prefix, *CbpRewriteRoots::getDefault());
+}
+
+bool addPrefix(XmlElemPtr elem, const char *attrName, const std::string &prefix, const CbpRewriteRoots &roots) {
     std::string value;
     if (!getAttribute(elem, attrName, value)) {
-        return;
+        return false;
     }
 
-    size_t idx = value.find("/usr/");
-    if (idx == std::string::npos && value != "/usr") {
-        return;
+    if (!addPrefix(value, prefix, roots)) {
+        return false;
     }
 
-    value = prefix + value.substr(idx);
-    ga::getSimplePath(value, value);
     elem->SetAttribute(attrName, value.c_str());
+    return true;
 }
 
-void addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, std::string &value) {
-    const std::string DELIMIT = ";";
-    std::vector<std::string> parts;
-    split(value, DELIMIT, parts);
+bool addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, std::string &value) {
+    static const std::string_view CMakeFiles_BS = "CMake Files\\";
+
+    // The parts are views of the value and the buffers of the thread are reused,
+    // only the result is allocated.
+    thread_local std::vector<std::string_view> parts;
+    thread_local std::string virtualPath;
+    thread_local std::string simpleVirtualPath;
+    thread_local std::string prefixedPath;
+    const CbpRewriteRoots &roots = getRewriteRoots(executionPlan);
 
-    const std::string CMakeFiles_BS = "CMake Files\\";
+    split(value, ";", parts);
     size_t n = parts.size();
-    for (size_t i = 0; i < n; i++) {
-        std::string part = parts[i];
+    if (n == 0) {
+        return false;
+    }
 
-        // part must begin with "CMake Files\" otherwise continue (maybe error?)
-        if (part.find(CMakeFiles_BS) != 0) {
-            continue;
+    std::string result;
+    result.reserve(value.size() + n * (executionPlan.virtualFolderPrefix.size() + 1));
+    for (size_t i = 0; i < n; i++) {
+        std::string_view part = parts[i];
+        if (i > 0) {
+            result += ';';
         }
 
-        std::string virtualPath(part.substr(CMakeFiles_BS.size()));
-        if (virtualPath.empty()) {
+        // part must begin with "CMake Files\" and have a path, otherwise it is kept (maybe error?)
+        if (!startsWith(part, CMakeFiles_BS) || part.size() == CMakeFiles_BS.size()) {
+            result.append(part.data(), part.size());
             continue;
         }
+        std::string_view partPath = part.substr(CMakeFiles_BS.size());
+        virtualPath.assign(partPath.data(), partPath.size());
 
         // check if the path is inside the source dir
-        std::string simpleVirtualPath = ga::combine(executionPlan.buildDir, virtualPath);
+        ga::combine(executionPlan.buildDir, virtualPath, simpleVirtualPath);
         cleanPathSeparators(simpleVirtualPath, '/');
         ga::getSimplePath(simpleVirtualPath, simpleVirtualPath);
-        if (simpleVirtualPath.empty() || (simpleVirtualPath.find("/usr/") == 0) || (simpleVirtualPath == "/usr")) {
+        if (simpleVirtualPath.empty() || roots.contains(simpleVirtualPath)) {
             // virtual must be put in the SDK
-            simpleVirtualPath = ga::combine(executionPlan.virtualFolderPrefix, simpleVirtualPath);
-            cleanPathSeparators(simpleVirtualPath, '\\');
-            virtualPath = simpleVirtualPath;
+            ga::combine(executionPlan.virtualFolderPrefix, simpleVirtualPath, prefixedPath);
+            cleanPathSeparators(prefixedPath, '\\');
+            virtualPath.swap(prefixedPath);
         } else {
             ga::getSimplePath(virtualPath, virtualPath);
         }
 
         if (virtualPath.size() > 0 && !ga::isPathSeparator(virtualPath.back())) {
-            virtualPath += "\\";
+            virtualPath += '\\';
         }
 
-        parts[i] = CMakeFiles_BS + virtualPath;
+        result.append(CMakeFiles_BS.data(), CMakeFiles_BS.size());
+        result.append(virtualPath);
     }
 
-    if (n > 0) {
-        value = parts[0];
-        for (size_t i = 1; i < n; i++) {
-            value += ";";
-            value += parts[i];
-        }
+    if (result == value) {
+        return false;
     }
+
+    value = std::move(result);
+    return true;
 }
 
-void addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, XmlElemPtr elem, const char *attrName) {
+bool addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, XmlElemPtr elem, const char *attrName) {
     std::string value;
     if (!getAttribute(elem, attrName, value)) {
-        return;
+        return false;
     }
 
-    addPrefixToVirtualFolder(executionPlan, value);
+    if (!addPrefixToVirtualFolder(executionPlan, value)) {
+        return false;
+    }
 
     elem->SetAttribute(attrName, value.c_str());
+    return true;
+}
+
+bool initVirtualFolderPrefix(CbpPatchContext &context) {
+    // will contain the relative path from the directory of the filePath to the sdk folder
+    std::string virtualFolderPrefix;
+    if (!ga::getRelativePath(context.projectDir, context.sdkDir, virtualFolderPrefix)) {
+        return false;
+    }
+
+    cleanPathSeparators(virtualFolderPrefix, '\\');
+    context.virtualFolderPrefix = virtualFolderPrefix;
+    return true;
+}
+
+std::string getNoteContent(const CbpPatchContext &executionPlan) {
+    return join({executionPlan.sdkDir, executionPlan.virtualFolderPrefix}, "\n");
+}
+
+void readNoteContent(const std::string &data, CbpPatchContext &executionPlan) {
+    std::vector<std::string_view> content;
+    split(data, "\n", content);
+    if (content.size() >= 2) {
+        executionPlan.oldSdkPrefix.assign(content[0].data(), content[0].size());
+        executionPlan.oldVirtualFolderPrefix.assign(content[1].data(), content[1].size());
+    }
 }
 
 bool readNote(XmlElemPtr elem, CbpPatchContext &executionPlan) {
@@ -168,18 +260,7 @@ bool readNote(XmlElemPtr elem, CbpPatchContext &executionPlan) {
             data = data.substr(9, data.size() - 12);
         }
 
-        std::vector<std::string> content;
-        split(data, "\n", content);
-        if (content.size() >= 2) {
-            executionPlan.oldSdkPrefix = content[0];
-            executionPlan.oldVirtualFolderPrefix = content[1];
-        }
-
-        std::vector<std::string> newContent;
-        newContent.push_back(executionPlan.sdkDir);
-        newContent.push_back(executionPlan.virtualFolderPrefix);
-        std::string sNewContent = join(newContent, "\n");
-        child->SetText(sNewContent.c_str());
+        readNoteContent(data, executionPlan);
 
         ok = true;
         break;
@@ -195,140 +276,436 @@ XmlElemPtr createNote(const CbpPatchContext &executionPlan, XmlElemPtr elem) {
     tinyxml2::XMLText *text = notes->InsertNewText("");
     text->SetCData(true);
 
-    std::vector<std::string> newContent;
-    newContent.push_back(executionPlan.sdkDir);
-    newContent.push_back(executionPlan.virtualFolderPrefix);
-    std::string sContent = join(newContent, "\n");
+    std::string sContent = getNoteContent(executionPlan);
     text->SetValue(sContent.c_str());
 
     elem->InsertFirstChild(option);
     return option;
 }
 
-inline void enqueueWithSiblings(XmlElemPtr elem, XmlElemPtr parent, std::deque<XmlElemParentPair> &q) {
+namespace {
+
+inline bool isXmlSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+inline const char *findBytes(const char *begin, const char *end, const char *sequence) {
+    // memmem is vectorized by the C library
+    return static_cast<const char *>(memmem(begin, static_cast<size_t>(end - begin), sequence, strlen(sequence)));
+}
+
+inline const char *skipSpace(const char *p, const char *end) {
+    while (p < end && isXmlSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+inline bool startsWith(const char *p, const char *end, const char *sequence) {
+    size_t n = strlen(sequence);
+    return static_cast<size_t>(end - p) >= n && memcmp(p, sequence, n) == 0;
+}
+
+/// @brief find the '>' of the tag that starts before p (the attribute values can contain '>').
+inline const char *findTagEnd(const char *p, const char *end) {
+    char quote = '\0';
+    for (; p < end; p++) {
+        if (quote != '\0') {
+            quote = (*p == quote) ? '\0' : quote;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (*p == '>') {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+bool prescanCBP(CbpPatchContext &context, const char *data, size_t size, PatchResult &outResult) {
+    const char *end = data + std::min(size, PRESCAN_SIZE);
+    for (;;) {
+        // The first Project element, a comment before it could hide the real one
+        const char *project = findBytes(data, end, "<Project");
+        if (project == nullptr || project + 8 >= end || (!isXmlSpace(project[8]) && project[8] != '>') ||
+            findBytes(data, project, "<!--") != nullptr) {
+            break;
+        }
+        const char *p = findTagEnd(project + 8, end);
+        if (p == nullptr || p[-1] == '/') {
+            break;
+        }
+
+        // The note is the first child of the Project: <Option show_notes="0"><notes><![CDATA[...]]></notes>
+        p = skipSpace(p + 1, end);
+        if (!startsWith(p, end, "<Option") || p + 7 >= end || !isXmlSpace(p[7])) {
+            break;
+        }
+        const char *optionEnd = findTagEnd(p + 7, end);
+        if (optionEnd == nullptr || optionEnd[-1] == '/') {
+            break;
+        }
+        const char *showNotes = findBytes(p + 7, optionEnd, "show_notes=");
+        if (showNotes == nullptr || !isXmlSpace(showNotes[-1]) || showNotes + 12 >= optionEnd ||
+            (showNotes[11] != '"' && showNotes[11] != '\'') || showNotes[12] == showNotes[11]) {
+            // getAttribute ignores an empty value
+            break;
+        }
+
+        p = skipSpace(optionEnd + 1, end);
+        if (!startsWith(p, end, "<notes>")) {
+            break;
+        }
+        p += 7;
+        if (!startsWith(p, end, "<![CDATA[")) {
+            break;
+        }
+        p += 9;
+        const char *cdataEnd = findBytes(p, end, "]]>");
+        if (cdataEnd == nullptr) {
+            break;
+        }
+
+        if (!initVirtualFolderPrefix(context)) {
+            break;
+        }
+        readNoteContent(std::string(p, cdataEnd), context);
+        outResult = (context.oldVirtualFolderPrefix == context.virtualFolderPrefix) ? PatchResult::AlreadyPatched
+                                                                                   : PatchResult::DifferentSDK;
+        return true;
+    }
+    return false;
+}
+
+namespace {
+
+inline bool isPathNameChar(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-' || c == '.' || c == '+' || c == '~';
+}
+
+inline bool hasXmlSpecialChar(const std::string &value) {
+    return value.find_first_of("&<>\"'") != std::string::npos;
+}
+
+/// @brief the prefix as it is in the patched values: simplified like addPrefix does, without a trailing separator.
+inline std::string getRetargetPrefix(const std::string &prefix) {
+    std::string simple;
+    if (!ga::getSimplePath(prefix, simple)) {
+        simple = prefix;
+    }
+    while (!simple.empty() && ga::isPathSeparator(simple.back())) {
+        simple.pop_back();
+    }
+    return simple;
+}
+
+/// @brief a prefix to replace, the match must not be followed by a character of a path name ("v42" is not "v421").
+struct RetargetPattern {
+    std::string from;
+    std::string to;
+    const char *next = nullptr;
+    /// @brief the number of replaced matches.
+    size_t count = 0;
+
+    void find(const char *p, const char *end) {
+        if (p >= end) {
+            next = nullptr;
+            return;
+        }
+        for (next = findBytes(p, end, from.c_str()); next != nullptr; next = findBytes(next + 1, end, from.c_str())) {
+            const char *after = next + from.size();
+            if (after == end || !isPathNameChar(*after)) {
+                break;
+            }
+        }
+    }
+};
+
+/// @brief copy the bytes with the patterns replaced.
+template <size_t N>
+void appendRetargeted(const char *p, const char *end, RetargetPattern (&patterns)[N], std::string &out) {
+    for (RetargetPattern &pattern : patterns) {
+        pattern.find(p, end);
+    }
+    for (;;) {
+        RetargetPattern *first = nullptr;
+        for (RetargetPattern &pattern : patterns) {
+            if (pattern.next != nullptr && (first == nullptr || pattern.next < first->next)) {
+                first = &pattern;
+            }
+        }
+        if (first == nullptr) {
+            break;
+        }
+        out.append(p, first->next);
+        out.append(first->to);
+        first->count++;
+        p = first->next + first->from.size();
+        for (RetargetPattern &pattern : patterns) {
+            if (pattern.next != nullptr && pattern.next < p) {
+                pattern.find(p, end);
+            }
+        }
+    }
+    out.append(p, end);
+}
+
+} // namespace
+
+PatchResult retargetCBP(const CbpPatchContext &context, const char *data, size_t size, std::string &outRetargeted) {
+    outRetargeted.clear();
+    const std::string oldSdkPrefix = getRetargetPrefix(context.oldSdkPrefix);
+    const std::string sdkPrefix = getRetargetPrefix(context.sdkDir);
+    const std::string oldVirtualFolderPrefix = getRetargetPrefix(context.oldVirtualFolderPrefix);
+    const std::string virtualFolderPrefix = getRetargetPrefix(context.virtualFolderPrefix);
+    if (oldSdkPrefix.empty() || oldVirtualFolderPrefix.empty() || sdkPrefix.empty() || virtualFolderPrefix.empty() ||
+        hasXmlSpecialChar(oldSdkPrefix) || hasXmlSpecialChar(sdkPrefix)) {
+        return PatchResult::Error;
+    }
+
+    CbpPatchContext oldContext;
+    oldContext.sdkDir = context.oldSdkPrefix;
+    oldContext.virtualFolderPrefix = context.oldVirtualFolderPrefix;
+    const std::string oldNote = "<![CDATA[" + getNoteContent(oldContext) + "]]>";
+    const std::string newNote = "<![CDATA[" + getNoteContent(context) + "]]>";
+
+    const char *end = data + size;
+    const char *note = findBytes(data, end, oldNote.c_str());
+    if (note == nullptr) {
+        return PatchResult::Error;
+    }
+
+    // The virtual folders are "CMake Files\<prefix>\...", the paths start with the SDK directory
+    static const std::string CMakeFiles_BS = "CMake Files\\";
+    RetargetPattern patterns[] = {
+        {oldSdkPrefix, sdkPrefix},
+        {CMakeFiles_BS + oldVirtualFolderPrefix, CMakeFiles_BS + virtualFolderPrefix},
+    };
+
+    outRetargeted.reserve(size + size / 16);
+    appendRetargeted(data, note, patterns, outRetargeted);
+    outRetargeted.append(newNote);
+    appendRetargeted(note + oldNote.size(), end, patterns, outRetargeted);
+    if (patterns[0].count == 0) {
+        // The paths are not written with the prefix of the note, only the note would be moved
+        outRetargeted.clear();
+        return PatchResult::DifferentSDK;
+    }
+    return PatchResult::Changed;
+}
+
+/// @brief an element in the BFS queue with the interned name id of its parent.
+struct XmlQueueEntry {
+    XmlElemPtr elem;
+    XmlElemPtr parent;
+    int parentId;
+};
+
+inline void enqueueWithSiblings(XmlElemPtr elem, XmlElemPtr parent, int parentId, std::deque<XmlQueueEntry> &q) {
     if (elem == nullptr) {
         return;
     }
 
-    q.push_back(std::make_pair(elem, parent));
+    q.push_back(XmlQueueEntry{elem, parent, parentId});
     while ((elem = elem->NextSiblingElement()) != nullptr) {
-        q.push_back(std::make_pair(elem, parent));
+        q.push_back(XmlQueueEntry{elem, parent, parentId});
     }
 }
 
-/// @brief patch the .cbp at the filePath.
-PatchResult patchCBP(CbpPatchContext &context, std::string *outModifiedXml) {
-    PatchResult patchResult = PatchResult::Error;
+/// @brief add the extraAddDirectory and the gccClangFixes to the Compiler.
+/// @return the number of inserted elements.
+inline size_t injectCompiler(const CbpPatchContext &context, XmlElemPtr compiler) {
+    size_t changes = 0;
+    for (const std::string &addDir : context.extraAddDirectory) {
+        XmlElemPtr elem = compiler->InsertNewChildElement("Add");
+        elem->SetAttribute("directory", addDir.c_str());
+        addPrefix(elem, "directory", context.sdkDir, getRewriteRoots(context));
+        changes++;
+    }
 
-    if (outModifiedXml != nullptr) {
-        (*outModifiedXml).clear();
+    // Add the options at the beginning of the Compiler section
+    for (const std::string &addOption : context.gccClangFixes) {
+        XmlElemPtr elem = compiler->InsertNewChildElement("Add");
+        elem->SetAttribute("option", addOption.c_str());
+        compiler->InsertFirstChild(elem);
+        changes++;
     }
+    return changes;
+}
 
-    // will contain the relative path from the directory of the filePath to the sdk folder
-    std::string virtualFolderPrefix;
-    if (!ga::getRelativePath(context.projectDir, context.sdkDir, virtualFolderPrefix)) {
-        return patchResult;
+/// @brief the value rules of an element, applied after the traversal when they are computed in parallel.
+struct PendingRewrite {
+    XmlElemPtr elem;
+    const std::vector<CbpPatchRule> *rules;
+    /// @brief the new values of the changed attributes.
+    std::vector<std::pair<const std::string *, std::string>> values;
+    size_t changes;
+};
+
+/// @brief apply the value rules of the element to copies of its attributes.
+/// The document is only read, so the elements can be computed concurrently.
+inline void computeRewrite(const CbpPatchContext &context, PendingRewrite &pending) {
+    for (const CbpPatchRule &rule : *pending.rules) {
+        if (rule.action == PatchAction::ProjectOption || rule.action == PatchAction::InjectCompiler) {
+            continue;
+        }
+
+        // A previous rule of the element may have changed the attribute already
+        std::string *value = nullptr;
+        for (auto &kv : pending.values) {
+            if (*kv.first == rule.attribute) {
+                value = &kv.second;
+                break;
+            }
+        }
+
+        if (value != nullptr) {
+            pending.changes += applyPatchRule(rule, context, *value) ? 1 : 0;
+            continue;
+        }
+
+        std::string original;
+        if (getAttribute(pending.elem, rule.attribute.c_str(), original) && applyPatchRule(rule, context, original)) {
+            pending.values.emplace_back(&rule.attribute, std::move(original));
+            pending.changes++;
+        }
     }
+}
 
-    cleanPathSeparators(virtualFolderPrefix, '\\');
-    context.virtualFolderPrefix = virtualFolderPrefix;
+/// @brief compute the pending rewrites, in parallel if there are enough of them, and apply them in order.
+/// @return the number of changes.
+inline size_t applyPendingRewrites(const CbpPatchContext &context, std::vector<PendingRewrite> &pending) {
+    size_t workerCount = (pending.size() >= PARALLEL_REWRITE_MIN) ? context.elementWorkers : 1;
+    size_t chunkCount = (workerCount > 1) ? (workerCount * 4) : 1;
+    ga::parallelFor(chunkCount, workerCount, [&context, &pending, chunkCount](size_t, size_t chunk) {
+        size_t begin = pending.size() * chunk / chunkCount;
+        size_t end = pending.size() * (chunk + 1) / chunkCount;
+        for (size_t i = begin; i < end; i++) {
+            computeRewrite(context, pending[i]);
+        }
+    });
+
+    // tinyxml2 does not support concurrent mutations
+    size_t changes = 0;
+    for (const PendingRewrite &rewrite : pending) {
+        for (const auto &kv : rewrite.values) {
+            rewrite.elem->SetAttribute(kv.first->c_str(), kv.second.c_str());
+        }
+        changes += rewrite.changes;
+    }
+    return changes;
+}
+
+/// @brief patch the document loaded in context.inOutXml without printing it.
+inline PatchResult patchDocument(CbpPatchContext &context) {
+    if (!initVirtualFolderPrefix(context)) {
+        return PatchResult::Error;
+    }
+
+    std::shared_ptr<const CbpPatchRules> patchRules = context.patchRules;
+    if (!patchRules) {
+        patchRules = CbpPatchRules::getDefault();
+    }
 
     bool hasNotes = false;
     bool hasNewNote = false;
+    // Every mutation of the document is counted, so the document is only printed if something changed.
+    size_t changes = 0;
 
-    tinyxml2::XMLPrinter printerIn;
     tinyxml2::XMLDocument &inOutXml = context.inOutXml;
-    inOutXml.Print(&printerIn);
-    std::string original(printerIn.CStr());
 
-    std::deque<XmlElemParentPair> q;
-    enqueueWithSiblings(inOutXml.FirstChildElement(), nullptr, q);
+    // With multiple element workers the value rules are applied after the traversal.
+    // They only change attribute values, which are not used by the traversal.
+    const bool deferRewrites = (context.elementWorkers > 1);
+    std::vector<PendingRewrite> pending;
+
+    std::deque<XmlQueueEntry> q;
+    enqueueWithSiblings(inOutXml.FirstChildElement(), nullptr, CbpPatchRules::UNKNOWN_NAME, q);
 
     while (!q.empty()) {
-        XmlElemParentPair currPair = q.front();
-        XmlElemPtr curr = currPair.first;
-        XmlElemPtr parentElem = currPair.second;
+        XmlQueueEntry currEntry = q.front();
+        XmlElemPtr curr = currEntry.elem;
         q.pop_front();
 
-        std::string parent;
-        if (parentElem != nullptr && parentElem->Name() != nullptr) {
-            parent = parentElem->Name();
-        }
-
-        const char *name_cstr = curr->Name();
-        if (name_cstr == nullptr) {
+        // One lookup gives the rules of the element and the parent id of its children.
+        const CbpPatchRules::NameEntry *nameEntry = patchRules->find(curr->Name());
+        if (nameEntry == nullptr) {
+            enqueueWithSiblings(curr->FirstChildElement(), curr, CbpPatchRules::UNKNOWN_NAME, q);
             continue;
         }
 
-        std::string name(name_cstr);
-
-        if (parent == "Compiler" && name == "Add") {
-            addPrefix(curr, "directory", context.sdkDir);
-        } else if (name == "Unit") {
-            addPrefix(curr, "filename", context.sdkDir);
-        } else if (parent == "MakeCommands") {
-            static std::set<std::string> makeCommandChildren = {"Build", "CompileFile", "Clean", "DistClean"};
-            if (makeCommandChildren.find(name) != makeCommandChildren.end()) {
-                /// @todo maybe replace the commands with our own set?
-                // addPrefix(curr, "command", in.sdkDir);
-            }
-        } else if (parent == "Unit" && name == "Option") {
-            addPrefixToVirtualFolder(context, curr, "virtualFolder");
-        } else if (parent == "Project" && name == "Option") {
-            // In the Project section there will be multiple Option children.
-            if (readNote(curr, context)) {
-                hasNotes = true;
-                // If the file was already patched, we will exit early
-                if (hasNotes) {
+        bool inject = false;
+        bool hasValueRules = false;
+        const std::vector<CbpPatchRule> &rules = nameEntry->getRules(currEntry.parentId);
+        for (const CbpPatchRule &rule : rules) {
+            switch (rule.action) {
+            case PatchAction::ProjectOption:
+                if (readNote(curr, context)) {
+                    // If the file was already patched, we will exit early without printing the document
                     if (context.oldVirtualFolderPrefix == context.virtualFolderPrefix) {
-                        patchResult = PatchResult::AlreadyPatched;
-                    } else {
-                        patchResult = PatchResult::DifferentSDK;
+                        return PatchResult::AlreadyPatched;
                     }
-                    break;
+                    return PatchResult::DifferentSDK;
                 }
-            } else {
                 if (!hasNotes) {
-                    createNote(context, parentElem);
+                    createNote(context, currEntry.parent);
                     hasNotes = true;
                     hasNewNote = true;
+                    changes++;
+                }
+                changes += applyPatchRule(rule, context, curr) ? 1 : 0;
+                break;
+            case PatchAction::InjectCompiler:
+                /// @todo store the old values in the note instead of just checking if the note exists.
+                inject = hasNewNote;
+                break;
+            default:
+                if (deferRewrites) {
+                    hasValueRules = true;
+                } else {
+                    changes += applyPatchRule(rule, context, curr) ? 1 : 0;
                 }
-                addPrefixToVirtualFolder(context, curr, "virtualFolders");
+                break;
             }
         }
+        if (hasValueRules) {
+            pending.push_back(PendingRewrite{curr, &rules, {}, 0});
+        }
 
-        enqueueWithSiblings(curr->FirstChildElement(), curr, q);
-
-        /// @todo we should actually store the old values in the note instead of just checking if the note exists.
-        if (hasNewNote && name == "Compiler") {
-            for (const std::string &addDir : context.extraAddDirectory) {
-                XmlElemPtr elem = curr->InsertNewChildElement("Add");
-                elem->SetAttribute("directory", addDir.c_str());
-                addPrefix(elem, "directory", context.sdkDir);
-            }
+        enqueueWithSiblings(curr->FirstChildElement(), curr, nameEntry->id, q);
 
-            // Add the options at the beginning of the Compiler section
-            for (const std::string &addOption : context.gccClangFixes) {
-                XmlElemPtr elem = curr->InsertNewChildElement("Add");
-                elem->SetAttribute("option", addOption.c_str());
-                curr->InsertFirstChild(elem);
-            }
+        // The injected elements are added after the children were queued, so they are not patched again.
+        if (inject) {
+            changes += injectCompiler(context, curr);
         }
     }
 
-    tinyxml2::XMLPrinter printerOut;
-    inOutXml.Print(&printerOut);
-    std::string modified(printerOut.CStr());
+    if (!pending.empty()) {
+        changes += applyPendingRewrites(context, pending);
+    }
 
-    if (original != modified) {
-        if (outModifiedXml != nullptr) {
-            *outModifiedXml = std::move(modified);
-        }
-        patchResult = PatchResult::Changed;
-    } else {
-        patchResult = PatchResult::Unchanged;
+    return (changes == 0) ? PatchResult::Unchanged : PatchResult::Changed;
+}
+
+PatchResult patchCBP(CbpPatchContext &context, std::string *outModifiedXml) {
+    if (outModifiedXml != nullptr) {
+        (*outModifiedXml).clear();
     }
 
+    PatchResult patchResult = patchDocument(context);
+    if (patchResult == PatchResult::Changed && outModifiedXml != nullptr) {
+        tinyxml2::XMLPrinter printerOut;
+        context.inOutXml.Print(&printerOut);
+        outModifiedXml->assign(printerOut.CStr(), static_cast<size_t>(printerOut.CStrSize() - 1));
+    }
+    return patchResult;
+}
+
+PatchResult patchCBP(CbpPatchContext &context, FILE *outFile) {
+    PatchResult patchResult = patchDocument(context);
+    if (patchResult == PatchResult::Changed) {
+        tinyxml2::XMLPrinter printerOut(outFile);
+        context.inOutXml.Print(&printerOut);
+    }
     return patchResult;
 }
 
@@ -2,10 +2,16 @@
 
 #include "Config.h"
 #include "tinyxml2.h"
+#include <cstdio>
 #include <deque>
+#include <memory>
 
 namespace gatools {
 
+class CbpPatchRules;
+class CbpRewriteCache;
+class CbpRewriteRoots;
+
 using XmlElemPtr = tinyxml2::XMLElement *;
 using XmlElemParentPair = std::pair<XmlElemPtr, XmlElemPtr>;
 
@@ -18,6 +24,14 @@ struct CbpPatchContext {
     std::string sdkDir;
     std::vector<std::string> extraAddDirectory;
     std::set<std::string> gccClangFixes;
+    /// @brief the compiled rules, if not set the built-in rules are used.
+    std::shared_ptr<const CbpPatchRules> patchRules;
+    /// @brief the roots relocated inside the SDK, if not set "/usr" is used.
+    std::shared_ptr<const CbpRewriteRoots> rewriteRoots;
+    /// @brief memo of the rewritten values, can be shared by the contexts of multiple threads.
+    std::shared_ptr<CbpRewriteCache> rewriteCache;
+    /// @brief the number of threads computing the attribute values of a single document (1: serial).
+    size_t elementWorkers = 1;
 
     std::string virtualFolderPrefix;
     std::string oldSdkPrefix;
@@ -32,16 +46,72 @@ std::ostream &operator<<(std::ostream &os, PatchResult in);
 
 bool getAttribute(XmlElemPtr elem, const char *attrName, std::string &outValue);
 
-void addPrefix(XmlElemPtr elem, const char *attrName, const std::string &prefix);
+/// @brief get the rewrite roots of the context (the default roots if not set).
+const CbpRewriteRoots &getRewriteRoots(const CbpPatchContext &context);
+
+/// @brief relocate a path that points into /usr inside the prefix.
+/// @return true if the value was changed.
+bool addPrefix(std::string &value, const std::string &prefix);
+
+/// @brief relocate a path that points into one of the roots inside the prefix.
+/// @return true if the value was changed.
+bool addPrefix(std::string &value, const std::string &prefix, const CbpRewriteRoots &roots);
+
+/// @return true if the attribute was changed.
+bool addPrefix(XmlElemPtr elem, const char *attrName, const std::string &prefix);
+
+/// @return true if the attribute was changed.
+bool addPrefix(XmlElemPtr elem, const char *attrName, const std::string &prefix, const CbpRewriteRoots &roots);
 
-void addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, std::string &value);
+/// @return true if the value was changed.
+bool addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, std::string &value);
 
-void addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, XmlElemPtr elem, const char *attrName);
+/// @return true if the attribute was changed.
+bool addPrefixToVirtualFolder(const CbpPatchContext &executionPlan, XmlElemPtr elem, const char *attrName);
 
+/// @brief compute the virtualFolderPrefix of the context (sdkDir relative to projectDir).
+bool initVirtualFolderPrefix(CbpPatchContext &context);
+
+/// @brief get the text stored in the note of a patched .cbp.
+std::string getNoteContent(const CbpPatchContext &executionPlan);
+
+/// @brief read the old prefixes from the text of a note.
+void readNoteContent(const std::string &data, CbpPatchContext &executionPlan);
+
+/// @brief read the note of a patched .cbp (the old prefixes are stored in the context).
+/// @return false if the element is not a note.
 bool readNote(XmlElemPtr elem, CbpPatchContext &executionPlan);
 
 XmlElemPtr createNote(const CbpPatchContext &executionPlan, XmlElemPtr elem);
 
+/// @brief the minimum number of elements with value rules for computing them with the elementWorkers.
+const size_t PARALLEL_REWRITE_MIN = 1024;
+
+/// @brief the number of bytes at the start of a .cbp that prescanCBP searches.
+const size_t PRESCAN_SIZE = 16 * 1024;
+
+/// @brief decide from the first bytes of a .cbp if it was already patched, without parsing it.
+/// Only the note created by patchCBP as the first child of the Project is recognized.
+/// @return true if the file was classified, outResult is then PatchResult::AlreadyPatched or
+/// PatchResult::DifferentSDK and the old prefixes are stored in the context. false if the file has to be parsed.
+bool prescanCBP(CbpPatchContext &context, const char *data, size_t size, PatchResult &outResult);
+
+/// @brief rewrite a .cbp patched for another SDK to the SDK of the context, without parsing it.
+/// The old prefixes must be in the context (read from the note by prescanCBP or readNote): every path starting
+/// with the old SDK prefix and every virtual folder starting with the old virtual folder prefix is moved to the
+/// new prefixes, and the note records the new ones. The rest of the bytes is copied unchanged.
+/// The prefixes are compared simplified and without a trailing separator, like addPrefix writes them.
+/// @return PatchResult::Changed and the retargeted .cbp in outRetargeted, PatchResult::Error if the note is not found
+/// or if a prefix would be escaped in the xml, PatchResult::DifferentSDK if no path starts with the old SDK prefix.
+PatchResult retargetCBP(const CbpPatchContext &context, const char *data, size_t size, std::string &outRetargeted);
+
+/// @brief patch the document loaded in context.inOutXml.
+/// The changes are tracked while patching: the document is printed into outModifiedXml
+/// only if PatchResult::Changed is returned, the other results do not print it at all.
 PatchResult patchCBP(CbpPatchContext &context, std::string *outModifiedXml = nullptr);
 
+/// @brief patch the document loaded in context.inOutXml and print it directly into the file
+/// if PatchResult::Changed is returned (nothing is written otherwise).
+PatchResult patchCBP(CbpPatchContext &context, FILE *outFile);
+
 } // namespace gatools
@@ -0,0 +1,80 @@
+#include "CbpRewriteCache.h"
+
+#include "CbpPatcher.h"
+#include "CbpRewriteRoots.h"
+
+#include <mutex>
+
+namespace gatools {
+
+namespace {
+
+bool rewriteUncached(RewriteKind kind, const CbpPatchContext &context, std::string &value) {
+    switch (kind) {
+    case RewriteKind::SdkPrefix:
+        return addPrefix(value, context.sdkDir, getRewriteRoots(context));
+    case RewriteKind::VirtualFolder:
+        return addPrefixToVirtualFolder(context, value);
+    }
+    return false;
+}
+
+} // namespace
+
+bool CbpRewriteCache::rewrite(RewriteKind kind, const CbpPatchContext &context, std::string &value) {
+    // The buffer of the key is reused by the calls of the thread.
+    thread_local std::string key;
+    key.clear();
+    key += static_cast<char>(kind);
+    key += context.buildDir;
+    key += '\0';
+    key += context.sdkDir;
+    key += '\0';
+    key += context.virtualFolderPrefix;
+    key += '\0';
+    key += getRewriteRoots(context).getProfile();
+    key += '\0';
+    key += value;
+
+    Shard &shard = _shards[std::hash<std::string>()(key) % SHARD_COUNT];
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.results.find(key);
+        if (it != shard.results.end()) {
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            if (it->second.changed) {
+                value = it->second.value;
+            }
+            return it->second.changed;
+        }
+    }
+
+    // Computed without the lock: another thread may compute the same value, both results are equal.
+    _misses.fetch_add(1, std::memory_order_relaxed);
+    Result result;
+    result.changed = rewriteUncached(kind, context, value);
+    if (result.changed) {
+        result.value = value;
+    }
+
+    bool changed = result.changed;
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    shard.results.emplace(key, std::move(result));
+    return changed;
+}
+
+CbpRewriteCache::Stats CbpRewriteCache::getStats() const {
+    Stats stats;
+    stats.hits = _hits.load(std::memory_order_relaxed);
+    stats.misses = _misses.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool rewriteValue(RewriteKind kind, const CbpPatchContext &context, std::string &value) {
+    if (context.rewriteCache) {
+        return context.rewriteCache->rewrite(kind, context, value);
+    }
+    return rewriteUncached(kind, context, value);
+}
+
+} // namespace gatools
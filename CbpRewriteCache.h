@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace gatools {
+
+struct CbpPatchContext;
+
+enum class RewriteKind : char {
+    /// @brief addPrefix with the sdkDir.
+    SdkPrefix = 's',
+    /// @brief addPrefixToVirtualFolder.
+    VirtualFolder = 'v',
+};
+
+/// @brief memo of the rewritten attribute values, shared by the threads patching the .cbp files of a build tree.
+/// The key is the kind of rewrite, the context used by the rewrite (buildDir, sdkDir, virtualFolderPrefix and the
+/// profile of the rewrite roots) and the value. The entries are spread over shards, the lookups of a shard only take a shared lock.
+class CbpRewriteCache {
+  public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+    };
+
+    /// @brief rewrite the value in place, using the memo if the same value was already rewritten.
+    /// @return true if the value was changed.
+    bool rewrite(RewriteKind kind, const CbpPatchContext &context, std::string &value);
+
+    Stats getStats() const;
+
+  private:
+    struct Result {
+        bool changed = false;
+        std::string value;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Result> results;
+    };
+
+    static const size_t SHARD_COUNT = 16;
+
+    std::array<Shard, SHARD_COUNT> _shards;
+    std::atomic<uint64_t> _hits{0};
+    std::atomic<uint64_t> _misses{0};
+};
+
+/// @brief rewrite the value with the cache of the context, or directly if the context has no cache.
+/// @return true if the value was changed.
+bool rewriteValue(RewriteKind kind, const CbpPatchContext &context, std::string &value);
+
+} // namespace gatools
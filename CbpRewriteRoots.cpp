@@ -0,0 +1,122 @@
+#include "CbpRewriteRoots.h"
+
+#include "file_system.h"
+
+#include <cstring>
+
+namespace gatools {
+
+const std::vector<std::string> &CbpRewriteRoots::getDefaultRoots() {
+    static const std::vector<std::string> roots = {"/usr"};
+    return roots;
+}
+
+std::shared_ptr<const CbpRewriteRoots> CbpRewriteRoots::getDefault() {
+    static const std::shared_ptr<const CbpRewriteRoots> roots = compile(getDefaultRoots());
+    return roots;
+}
+
+std::shared_ptr<const CbpRewriteRoots> CbpRewriteRoots::compile(const std::vector<std::string> &roots,
+                                                                std::vector<std::string> *outErrors) {
+    std::vector<std::string> valid;
+    for (const std::string &root : roots) {
+        std::string simpleRoot;
+        if (!ga::isAbsolutePath(root) || !ga::getSimplePath(root, simpleRoot)) {
+            if (outErrors) {
+                outErrors->push_back("the root must be an absolute path: " + root);
+            }
+            continue;
+        }
+        while (simpleRoot.size() > 1 && simpleRoot.back() == '/') {
+            simpleRoot.pop_back();
+        }
+        if (simpleRoot.size() < 2) {
+            if (outErrors) {
+                outErrors->push_back("the root cannot be the file system root: " + root);
+            }
+            continue;
+        }
+        bool duplicate = false;
+        for (const std::string &other : valid) {
+            duplicate = duplicate || (other == simpleRoot);
+        }
+        if (!duplicate) {
+            valid.push_back(simpleRoot);
+        }
+    }
+    if (valid.empty()) {
+        valid = getDefaultRoots();
+    }
+
+    std::shared_ptr<CbpRewriteRoots> compiled(new CbpRewriteRoots());
+    for (const std::string &root : valid) {
+        for (char c : root) {
+            uint8_t &cls = compiled->_classes[static_cast<uint8_t>(c)];
+            if (cls == 0) {
+                cls = static_cast<uint8_t>(compiled->_nClasses++);
+            }
+        }
+    }
+    compiled->_next.assign(compiled->_nClasses, -1);
+    compiled->_isRoot.assign(1, 0);
+    for (const std::string &root : valid) {
+        compiled->add(root);
+    }
+    return compiled;
+}
+
+void CbpRewriteRoots::add(const std::string &root) {
+    _roots.push_back(root);
+    _profile += root;
+    _profile += '\n';
+    size_t node = 0;
+    for (char c : root) {
+        size_t idx = node * _nClasses + _classes[static_cast<uint8_t>(c)];
+        if (_next[idx] < 0) {
+            _next[idx] = static_cast<int32_t>(_isRoot.size());
+            _isRoot.push_back(0);
+            _next.resize(_next.size() + _nClasses, -1);
+        }
+        node = static_cast<size_t>(_next[idx]);
+    }
+    _isRoot[node] = 1;
+}
+
+bool CbpRewriteRoots::matchAt(const char *p, const char *end, bool allowEnd) const {
+    size_t node = 0;
+    for (; p < end; p++) {
+        uint8_t cls = _classes[static_cast<uint8_t>(*p)];
+        if (cls == 0) {
+            return false;
+        }
+        int32_t next = _next[node * _nClasses + cls];
+        if (next < 0) {
+            return false;
+        }
+        node = static_cast<size_t>(next);
+        // A shorter root that is not followed by '/' can be the start of a longer one ("/lib" and "/lib64")
+        if (_isRoot[node] && ((p + 1 == end) ? allowEnd : (p[1] == '/'))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t CbpRewriteRoots::find(std::string_view value) const {
+    const char *begin = value.data();
+    const char *end = begin + value.size();
+    const char *p = begin;
+    while (p < end && (p = static_cast<const char *>(memchr(p, '/', end - p))) != nullptr) {
+        if (matchAt(p, end, p == begin)) {
+            return static_cast<size_t>(p - begin);
+        }
+        p++;
+    }
+    return NOT_FOUND;
+}
+
+bool CbpRewriteRoots::contains(std::string_view path) const {
+    return !path.empty() && path[0] == '/' && matchAt(path.data(), path.data() + path.size(), true);
+}
+
+} // namespace gatools
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gatools {
+
+/// @brief the roots of the system paths that are relocated inside the SDK ("/usr", "/opt", ...).
+/// The roots are compiled into a trie over the byte classes of their characters: a value is searched with memchr
+/// for the '/' that starts every root, then the trie is walked from each of them. The cost of a value depends
+/// on its length and on the length of the longest root, not on the number of roots.
+class CbpRewriteRoots {
+  public:
+    static constexpr size_t NOT_FOUND = std::string_view::npos;
+
+    /// @brief the roots used when none is configured: "/usr".
+    static const std::vector<std::string> &getDefaultRoots();
+
+    /// @brief get the compiled default roots.
+    static std::shared_ptr<const CbpRewriteRoots> getDefault();
+
+    /// @brief compile the roots (absolute paths, simplified and without the trailing '/').
+    /// The roots that cannot be used are skipped and described in outErrors,
+    /// the default roots are compiled if no root is given.
+    static std::shared_ptr<const CbpRewriteRoots> compile(const std::vector<std::string> &roots,
+                                                          std::vector<std::string> *outErrors = nullptr);
+
+    /// @brief find the first root of the value followed by a '/'. A value that is a root is found at 0.
+    /// @return the position of the root or NOT_FOUND.
+    size_t find(std::string_view value) const;
+
+    /// @brief check if the path is a root or is inside a root.
+    bool contains(std::string_view path) const;
+
+    const std::vector<std::string> &getRoots() const { return _roots; }
+
+    /// @brief the compiled roots in one string ("/usr\n/opt\n"), equal for the same roots in the same order.
+    const std::string &getProfile() const { return _profile; }
+
+  private:
+    CbpRewriteRoots() = default;
+
+    void add(const std::string &root);
+
+    /// @brief check if a root starts at p and is followed by '/' (or by the end of the value if allowEnd).
+    bool matchAt(const char *p, const char *end, bool allowEnd) const;
+
+    std::vector<std::string> _roots;
+    std::string _profile;
+    /// @brief the class of every byte, 0 for the bytes that are not used by any root.
+    uint8_t _classes[256] = {};
+    size_t _nClasses = 1;
+    /// @brief the next node of every node and byte class (-1: no root continues with the class).
+    std::vector<int32_t> _next;
+    std::vector<char> _isRoot;
+};
+
+} // namespace gatools
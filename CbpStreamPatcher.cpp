@@ -0,0 +1,997 @@
+#include "CbpStreamPatcher.h"
+
+#include "CbpPatchRules.h"
+#include "file_system.h"
+#include "json.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+
+namespace gatools {
+
+namespace {
+
+const size_t NPOS = std::string::npos;
+
+const int SNAPSHOT_VERSION = 1;
+
+/// @brief sliding window over the input. The bytes are addressed by their offset in the input.
+/// The whole input is in the window when it is created over bytes in memory.
+class InputWindow {
+  public:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    explicit InputWindow(std::istream &input)
+        : _input(&input)
+        , _bytes(nullptr)
+        , _size(0)
+        , _base(0)
+        , _released(0)
+        , _eof(false) {}
+
+    InputWindow(const char *data, size_t size)
+        : _input(nullptr)
+        , _bytes(data)
+        , _size(size)
+        , _base(0)
+        , _released(0)
+        , _eof(true) {}
+
+    /// @brief make sure that the byte at absPos is loaded.
+    /// @return false if the input ends before absPos.
+    bool load(size_t absPos) {
+        while (absPos >= end()) {
+            if (!refill()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t end() const { return _base + _size; }
+
+    const char *data(size_t absPos) const { return _bytes + (absPos - _base); }
+
+    char at(size_t absPos) const { return _bytes[absPos - _base]; }
+
+    /// @brief the bytes before absPos are not needed anymore and can be dropped on the next refill.
+    void release(size_t absPos) { _released = std::max(_released, absPos); }
+
+    size_t find(size_t absPos, char c) {
+        while (load(absPos)) {
+            const char *p = data(absPos);
+            const void *found = memchr(p, c, end() - absPos);
+            if (found != nullptr) {
+                return absPos + static_cast<size_t>(static_cast<const char *>(found) - p);
+            }
+            absPos = end();
+        }
+        return NPOS;
+    }
+
+    size_t find(size_t absPos, const char *sequence) {
+        size_t n = strlen(sequence);
+        for (;;) {
+            size_t p = find(absPos, sequence[0]);
+            if (p == NPOS || !load(p + n - 1)) {
+                return NPOS;
+            }
+            if (memcmp(data(p), sequence, n) == 0) {
+                return p;
+            }
+            absPos = p + 1;
+        }
+    }
+
+    bool startsWith(size_t absPos, const char *sequence) {
+        size_t n = strlen(sequence);
+        return load(absPos + n - 1) && (memcmp(data(absPos), sequence, n) == 0);
+    }
+
+  private:
+    bool refill() {
+        if (_eof) {
+            return false;
+        }
+
+        size_t drop = _released - _base;
+        if (drop > 0 && drop >= _buffer.size() / 2) {
+            _buffer.erase(0, drop);
+            _base += drop;
+        }
+
+        size_t oldSize = _buffer.size();
+        _buffer.resize(oldSize + CHUNK_SIZE);
+        _input->read(&_buffer[oldSize], CHUNK_SIZE);
+        size_t n = static_cast<size_t>(_input->gcount());
+        _buffer.resize(oldSize + n);
+        _bytes = _buffer.data();
+        _size = _buffer.size();
+        if (!*_input) {
+            _eof = true;
+        }
+        return n > 0;
+    }
+
+    std::istream *_input;
+    std::string _buffer;
+    const char *_bytes;
+    size_t _size;
+    size_t _base;
+    size_t _released;
+    bool _eof;
+};
+
+struct Attribute {
+    std::string name;
+    size_t valueStart;
+    size_t valueEnd;
+    /// @brief the unescaped value, loaded by the first rule that uses the attribute.
+    std::string value;
+    bool loaded;
+    bool changed;
+};
+
+/// @brief the Add elements injected in a Compiler element.
+struct CompilerInjection {
+    std::string name;
+    size_t afterStartTag;
+    size_t beforeEndTag;
+    size_t selfCloseStart;
+    std::string indent;
+    bool hasIndent;
+    bool childOfProject;
+    bool active;
+};
+
+struct Frame {
+    std::string name;
+    std::string indent;
+    bool hasIndent;
+    bool hasChildElement;
+    bool captureText;
+    bool isNote;
+    int nameId;
+    int injection;
+};
+
+inline bool isWhiteSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+std::string unescapeXml(const char *p, size_t n) {
+    static const struct {
+        const char *pattern;
+        size_t length;
+        char value;
+    } entities[] = {{"&quot;", 6, '"'}, {"&amp;", 5, '&'}, {"&apos;", 6, '\''}, {"&lt;", 4, '<'}, {"&gt;", 4, '>'}};
+
+    std::string out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (p[i] != '&') {
+            out += p[i];
+            continue;
+        }
+
+        bool found = false;
+        for (const auto &entity : entities) {
+            if (i + entity.length <= n && memcmp(p + i, entity.pattern, entity.length) == 0) {
+                out += entity.value;
+                i += entity.length - 1;
+                found = true;
+                break;
+            }
+        }
+        if (!found && i + 2 < n && p[i + 1] == '#') {
+            const char *semicolon = static_cast<const char *>(memchr(p + i, ';', n - i));
+            if (semicolon != nullptr) {
+                std::string number(p + i + 2, semicolon);
+                unsigned long code = 0;
+                if (!number.empty() && (number[0] == 'x' || number[0] == 'X')) {
+                    code = std::strtoul(number.c_str() + 1, nullptr, 16);
+                } else {
+                    code = std::strtoul(number.c_str(), nullptr, 10);
+                }
+                // cbp files only contain ascii, anything else is kept as is
+                if (code > 0 && code < 0x80) {
+                    out += static_cast<char>(code);
+                    i = static_cast<size_t>(semicolon - p);
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            out += p[i];
+        }
+    }
+    return out;
+}
+
+/// @brief escape the value in the same way as tinyxml2::XMLPrinter does for attributes.
+std::string escapeXmlAttribute(const std::string &value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        switch (c) {
+        case '"':
+            out += "&quot;";
+            break;
+        case '&':
+            out += "&amp;";
+            break;
+        case '\'':
+            out += "&apos;";
+            break;
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        default:
+            out += c;
+            break;
+        }
+    }
+    return out;
+}
+
+/// @brief compute the two 64 bit hashes of a subtree key, 8 bytes at a time.
+/// FNV-1a (ga::hashBytes) is limited by one multiplication per byte, it would cost as much as transforming the Units.
+void hashSubtree(const char *data, size_t size, uint64_t seed, CbpSubtreeSnapshot::Key &outKey) {
+    const uint64_t m1 = 0x9e3779b97f4a7c15ULL;
+    const uint64_t m2 = 0xc2b2ae3d27d4eb4fULL;
+    uint64_t h1 = seed ^ (size * m1);
+    uint64_t h2 = ~seed ^ (size * m2);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h1 = (h1 ^ word) * m1;
+        h1 ^= h1 >> 29;
+        h2 = ((h2 ^ word) * m2);
+        h2 ^= h2 >> 32;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        h1 = (h1 ^ word) * m1;
+        h2 = (h2 ^ word) * m2;
+    }
+    outKey.hash1 = (h1 ^ (h1 >> 31)) * m2;
+    outKey.hash2 = (h2 ^ (h2 >> 29)) * m1;
+    outKey.size = size;
+}
+
+class CbpStreamTransformer {
+  public:
+    CbpStreamTransformer(CbpPatchContext &context, std::istream &input, std::ostream &output)
+        : _context(context)
+        , _in(input)
+        , _out(&output)
+        , _outEdits(nullptr)
+        , _rules(context.patchRules ? context.patchRules : CbpPatchRules::getDefault())
+        , _indentUnit("    ") {}
+
+    /// @brief nothing is written, the edits are moved to outEdits when the input is flushed.
+    CbpStreamTransformer(CbpPatchContext &context, const char *data, size_t size, std::vector<CbpEdit> &outEdits,
+                         CbpSubtreeSnapshot *snapshot)
+        : _context(context)
+        , _in(data, size)
+        , _out(nullptr)
+        , _outEdits(&outEdits)
+        , _snapshot(snapshot)
+        , _rules(context.patchRules ? context.patchRules : CbpPatchRules::getDefault())
+        , _indentUnit("    ") {}
+
+    PatchResult run() {
+        if (!initVirtualFolderPrefix(_context)) {
+            return PatchResult::Error;
+        }
+
+        size_t pos = 0;
+        for (;;) {
+            size_t lt = _in.find(pos, '<');
+            if (lt == NPOS) {
+                break;
+            }
+
+            // Everything up to the end of the previous markup can be written,
+            // the text before the current markup is kept to compute indentations and insert elements before it.
+            if (!_notePending) {
+                flush(pos);
+            }
+            _in.release(_flushed);
+
+            _textStart = pos;
+            if (lt > pos && !_stack.empty() && _stack.back().captureText) {
+                _noteText += unescapeXml(_in.data(pos), lt - pos);
+            }
+
+            size_t end = NPOS;
+            if (_in.startsWith(lt, "<!--")) {
+                end = findEnd(lt + 4, "-->");
+            } else if (_in.startsWith(lt, "<![CDATA[")) {
+                end = findEnd(lt + 9, "]]>");
+                if (end != NPOS && !_stack.empty() && _stack.back().captureText) {
+                    _noteText.append(_in.data(lt + 9), end - 3 - (lt + 9));
+                }
+            } else if (_in.startsWith(lt, "<?")) {
+                end = findEnd(lt + 2, "?>");
+            } else if (_in.startsWith(lt, "<!")) {
+                end = findEnd(lt + 2, ">");
+            } else if (_in.startsWith(lt, "</")) {
+                end = findEnd(lt + 2, ">");
+                if (end != NPOS && !onEndTag()) {
+                    return PatchResult::Error;
+                }
+            } else {
+                end = findTagEnd(lt + 1);
+                if (end != NPOS) {
+                    size_t subtreeEnd = (_snapshot != nullptr) ? replaySubtree(lt, end) : NPOS;
+                    if (subtreeEnd != NPOS) {
+                        end = subtreeEnd;
+                    } else {
+                        onStartTag(lt, end);
+                    }
+                }
+            }
+
+            if (end == NPOS) {
+                return PatchResult::Error;
+            }
+            if (_recording && end >= _recordEnd) {
+                _recording = false;
+                _recorded.indentUnit = _indentUnit;
+                _snapshot->add(_recordKey, std::move(_recorded));
+                _snapshot->transformed++;
+            }
+            if (_decided) {
+                return _result;
+            }
+            pos = end;
+        }
+
+        if (!_stack.empty()) {
+            return PatchResult::Error;
+        }
+
+        // Write the rest of the input
+        for (;;) {
+            flush(_in.end());
+            _in.release(_flushed);
+            if (!_in.load(_in.end())) {
+                break;
+            }
+        }
+        if (_out != nullptr) {
+            _out->flush();
+        }
+
+        return _changed ? PatchResult::Changed : PatchResult::Unchanged;
+    }
+
+  private:
+    size_t findEnd(size_t absPos, const char *sequence) {
+        size_t p = _in.find(absPos, sequence);
+        return (p == NPOS) ? NPOS : p + strlen(sequence);
+    }
+
+    /// @brief find the end of a start tag, the '>' can be inside the attribute values.
+    size_t findTagEnd(size_t absPos) {
+        char quote = '\0';
+        for (size_t p = absPos;; p++) {
+            if (!_in.load(p)) {
+                return NPOS;
+            }
+            char c = _in.at(p);
+            if (quote != '\0') {
+                if (c == quote) {
+                    quote = '\0';
+                }
+            } else if (c == '"' || c == '\'') {
+                quote = c;
+            } else if (c == '>') {
+                return p + 1;
+            }
+        }
+    }
+
+    void addEdit(size_t start, size_t end, const std::string &text) {
+        // Edits at the same position are applied in the order they were added
+        auto it = std::upper_bound(_edits.begin(), _edits.end(), start,
+                                   [](size_t value, const CbpEdit &edit) { return value < edit.start; });
+        _edits.insert(it, CbpEdit{start, end, text});
+        _changed = true;
+
+        if (_recording && start >= _recordStart && end <= _recordEnd) {
+            _recorded.edits.push_back(CbpEdit{start - _recordStart, end - _recordStart, text});
+        }
+    }
+
+    /// @brief find the end of the Target or Unit element that starts with the tag.
+    /// @return NPOS if the element is something else or if it contains markup that cannot be replayed
+    /// (comments, CDATA or a nested element with the same name).
+    size_t findSubtreeEnd(size_t tagStart, size_t tagEnd, const char *&outName) const {
+        static const char *names[] = {"Target", "Unit"};
+        outName = nullptr;
+        for (const char *name : names) {
+            size_t n = strlen(name);
+            if (tagStart + 1 + n < tagEnd && memcmp(_in.data(tagStart + 1), name, n) == 0) {
+                char c = _in.at(tagStart + 1 + n);
+                if (isWhiteSpace(c) || c == '/' || c == '>') {
+                    outName = name;
+                    break;
+                }
+            }
+        }
+        if (outName == nullptr) {
+            return NPOS;
+        }
+        if (_in.at(tagEnd - 2) == '/') {
+            return tagEnd;
+        }
+
+        size_t n = strlen(outName);
+        const char *begin = _in.data(0);
+        size_t size = _in.end();
+        for (size_t p = tagEnd;;) {
+            const void *found = memchr(begin + p, '<', size - p);
+            if (found == nullptr) {
+                return NPOS;
+            }
+            p = static_cast<size_t>(static_cast<const char *>(found) - begin) + 1;
+            if (p + n + 1 > size || begin[p] == '!') {
+                return NPOS;
+            }
+            if (begin[p] == '/') {
+                if (memcmp(begin + p + 1, outName, n) == 0 && p + n + 1 < size && begin[p + n + 1] == '>') {
+                    return p + n + 2;
+                }
+            } else if (memcmp(begin + p, outName, n) == 0) {
+                return NPOS;
+            }
+        }
+    }
+
+    /// @brief reuse the edits of an unchanged Target or Unit from the snapshot, or start recording the edits of a
+    /// new one. Only the subtrees after the note was inserted are keyed, their edits depend only on their bytes,
+    /// the parent, the indentations and the patch profile.
+    /// @return the end of the subtree if its edits were reused, NPOS if it has to be transformed.
+    size_t replaySubtree(size_t tagStart, size_t tagEnd) {
+        const char *name = nullptr;
+        if (_recording || !_hasNewNote || _notePending || _stack.empty()) {
+            return NPOS;
+        }
+        size_t subtreeEnd = findSubtreeEnd(tagStart, tagEnd, name);
+        if (subtreeEnd == NPOS) {
+            return NPOS;
+        }
+
+        // The state is hashed into the seed: parent, indentations and indentation unit
+        Frame &parentFrame = _stack.back();
+        size_t indentStart = findIndent(tagStart);
+        bool hasIndent = (indentStart != NPOS);
+        const uint64_t state[] = {static_cast<uint64_t>(parentFrame.nameId), parentFrame.hasIndent ? 1u : 0u,
+                                  parentFrame.indent.size(), hasIndent ? (tagStart - indentStart + 1) : 0,
+                                  _indentUnit.size()};
+        uint64_t seed = ga::hashBytes(reinterpret_cast<const char *>(state), sizeof(state));
+        seed = ga::hashBytes(parentFrame.indent.data(), parentFrame.indent.size(), seed);
+        if (hasIndent) {
+            seed = ga::hashBytes(_in.data(indentStart), tagStart - indentStart, seed);
+        }
+        seed = ga::hashBytes(_indentUnit.data(), _indentUnit.size(), seed);
+
+        CbpSubtreeSnapshot::Key key;
+        hashSubtree(_in.data(tagStart), subtreeEnd - tagStart, seed, key);
+
+        const CbpSubtreeSnapshot::Subtree *subtree = _snapshot->find(key);
+        if (subtree == nullptr) {
+            _recording = true;
+            _recordStart = tagStart;
+            _recordEnd = subtreeEnd;
+            _recordKey = key;
+            _recorded = CbpSubtreeSnapshot::Subtree();
+            return NPOS;
+        }
+
+        for (const CbpEdit &edit : subtree->edits) {
+            if (edit.start > edit.end || edit.end > key.size) {
+                return NPOS;
+            }
+        }
+        for (const CbpEdit &edit : subtree->edits) {
+            addEdit(tagStart + edit.start, tagStart + edit.end, edit.text);
+        }
+        _indentUnit = subtree->indentUnit;
+        parentFrame.hasChildElement = true;
+        _snapshot->reused++;
+        return subtreeEnd;
+    }
+
+    void writeRaw(size_t start, size_t end) {
+        if (end > start && _out != nullptr) {
+            _out->write(_in.data(start), static_cast<std::streamsize>(end - start));
+        }
+    }
+
+    /// @brief write the input up to the absPos and apply the edits in the range.
+    void flush(size_t absPos) {
+        while (!_edits.empty() && _edits.front().start <= absPos) {
+            CbpEdit &edit = _edits.front();
+            writeRaw(_flushed, edit.start);
+            _flushed = edit.end;
+            if (_out != nullptr) {
+                *_out << edit.text;
+            } else {
+                _outEdits->push_back(std::move(edit));
+            }
+            _edits.pop_front();
+        }
+        if (absPos > _flushed) {
+            writeRaw(_flushed, absPos);
+            _flushed = absPos;
+        }
+    }
+
+    /// @brief the indentation of the element is the white space after the last new line in the text before it.
+    /// @return the start of the indentation, NPOS if the element is not indented.
+    size_t findIndent(size_t tagStart) const {
+        for (size_t p = tagStart; p > _textStart; p--) {
+            char c = _in.at(p - 1);
+            if (c == '\n') {
+                return p;
+            }
+            if (c != ' ' && c != '\t') {
+                break;
+            }
+        }
+        return NPOS;
+    }
+
+    bool getIndent(size_t tagStart, std::string &outIndent) const {
+        size_t indentStart = findIndent(tagStart);
+        if (indentStart == NPOS) {
+            return false;
+        }
+        outIndent.assign(_in.data(indentStart), tagStart - indentStart);
+        return true;
+    }
+
+    std::string newLine(const std::string &indent, bool hasIndent) const {
+        return hasIndent ? ("\n" + indent) : std::string();
+    }
+
+    /// @brief apply a value rule to the attribute. The rules of an element can change the same attribute,
+    /// so the edits are added after all of them were applied.
+    void rewrite(std::vector<Attribute> &attributes, const CbpPatchRule &rule) {
+        for (Attribute &attr : attributes) {
+            if (attr.name != rule.attribute) {
+                continue;
+            }
+
+            if (!attr.loaded) {
+                attr.value = unescapeXml(_in.data(attr.valueStart), attr.valueEnd - attr.valueStart);
+                attr.loaded = true;
+            }
+            if (!attr.value.empty() && applyPatchRule(rule, _context, attr.value)) {
+                attr.changed = true;
+            }
+            break;
+        }
+    }
+
+    void insertNote(const std::string &indent, bool hasIndent) {
+        std::string note = newLine(indent, hasIndent) + "<Option show_notes=\"0\">" +
+                           newLine(indent + _indentUnit, hasIndent) + "<notes><![CDATA[" + getNoteContent(_context) +
+                           "]]></notes>" + newLine(indent, hasIndent) + "</Option>";
+        addEdit(_projectContentStart, _projectContentStart, note);
+        _hasNotes = true;
+        _hasNewNote = true;
+        _notePending = false;
+
+        // The notes are created before the children of the Project are visited by patchCBP,
+        // so the Compilers found until now are patched unless they are direct children of the Project.
+        for (CompilerInjection &injection : _injections) {
+            if (!injection.childOfProject) {
+                activate(injection);
+            }
+        }
+    }
+
+    std::string getCompilerOptions(const CompilerInjection &injection) const {
+        std::string childNewLine = newLine(injection.indent + _indentUnit, injection.hasIndent);
+        std::string text;
+        // patchCBP inserts every option as the first child, so they end up in reverse order
+        for (auto it = _context.gccClangFixes.rbegin(); it != _context.gccClangFixes.rend(); it++) {
+            text += childNewLine + "<Add option=\"" + escapeXmlAttribute(*it) + "\"/>";
+        }
+        return text;
+    }
+
+    std::string getCompilerDirectories(const CompilerInjection &injection) const {
+        std::string childNewLine = newLine(injection.indent + _indentUnit, injection.hasIndent);
+        std::string text;
+        for (const std::string &addDir : _context.extraAddDirectory) {
+            std::string value = addDir;
+            addPrefix(value, _context.sdkDir, getRewriteRoots(_context));
+            text += childNewLine + "<Add directory=\"" + escapeXmlAttribute(value) + "\"/>";
+        }
+        return text;
+    }
+
+    void activate(CompilerInjection &injection) {
+        injection.active = true;
+        if (_context.gccClangFixes.empty() && _context.extraAddDirectory.empty()) {
+            return;
+        }
+
+        if (injection.selfCloseStart != NPOS) {
+            // <Compiler/> becomes <Compiler>...</Compiler>
+            addEdit(injection.selfCloseStart, injection.afterStartTag,
+                    ">" + getCompilerOptions(injection) + getCompilerDirectories(injection) +
+                        newLine(injection.indent, injection.hasIndent) + "</" + injection.name + ">");
+            return;
+        }
+
+        std::string options = getCompilerOptions(injection);
+        if (!options.empty()) {
+            addEdit(injection.afterStartTag, injection.afterStartTag, options);
+        }
+        if (injection.beforeEndTag != NPOS) {
+            closeInjection(injection);
+        }
+    }
+
+    void closeInjection(const CompilerInjection &injection) {
+        std::string directories = getCompilerDirectories(injection);
+        if (!directories.empty()) {
+            addEdit(injection.beforeEndTag, injection.beforeEndTag, directories);
+        }
+    }
+
+    void onStartTag(size_t tagStart, size_t tagEnd) {
+        // Parse the name and the attributes
+        size_t p = tagStart + 1;
+        size_t nameEnd = p;
+        while (nameEnd < tagEnd && !isWhiteSpace(_in.at(nameEnd)) && _in.at(nameEnd) != '/' &&
+               _in.at(nameEnd) != '>') {
+            nameEnd++;
+        }
+        std::string name(_in.data(p), nameEnd - p);
+        const bool selfClosing = (_in.at(tagEnd - 2) == '/');
+
+        std::vector<Attribute> attributes;
+        p = nameEnd;
+        for (;;) {
+            while (p < tagEnd && isWhiteSpace(_in.at(p))) {
+                p++;
+            }
+            if (p >= tagEnd || _in.at(p) == '/' || _in.at(p) == '>') {
+                break;
+            }
+            size_t attrNameStart = p;
+            while (p < tagEnd && _in.at(p) != '=' && !isWhiteSpace(_in.at(p))) {
+                p++;
+            }
+            Attribute attr;
+            attr.name.assign(_in.data(attrNameStart), p - attrNameStart);
+            while (p < tagEnd && (isWhiteSpace(_in.at(p)) || _in.at(p) == '=')) {
+                p++;
+            }
+            if (p >= tagEnd || (_in.at(p) != '"' && _in.at(p) != '\'')) {
+                break;
+            }
+            char quote = _in.at(p);
+            attr.valueStart = p + 1;
+            p = _in.find(attr.valueStart, quote);
+            if (p == NPOS || p >= tagEnd) {
+                break;
+            }
+            attr.valueEnd = p;
+            attr.loaded = false;
+            attr.changed = false;
+            attributes.push_back(attr);
+            p++;
+        }
+
+        Frame frame;
+        frame.name = name;
+        frame.hasIndent = getIndent(tagStart, frame.indent);
+        frame.hasChildElement = false;
+        frame.captureText = false;
+        frame.isNote = false;
+        frame.nameId = CbpPatchRules::UNKNOWN_NAME;
+        frame.injection = -1;
+
+        Frame *parentFrame = _stack.empty() ? nullptr : &_stack.back();
+        if (parentFrame != nullptr) {
+            if (parentFrame->isNote && !parentFrame->hasChildElement) {
+                frame.captureText = true;
+            }
+            parentFrame->hasChildElement = true;
+
+            if (frame.hasIndent && parentFrame->hasIndent && frame.indent.size() > parentFrame->indent.size() &&
+                frame.indent.compare(0, parentFrame->indent.size(), parentFrame->indent) == 0) {
+                _indentUnit = frame.indent.substr(parentFrame->indent.size());
+            }
+        }
+
+        // Same rules as patchCBP
+        bool inject = false;
+        const CbpPatchRules::NameEntry *nameEntry = _rules->find(name.c_str());
+        if (nameEntry != nullptr) {
+            frame.nameId = nameEntry->id;
+            int parentId = (parentFrame != nullptr) ? parentFrame->nameId : CbpPatchRules::UNKNOWN_NAME;
+            for (const CbpPatchRule &rule : nameEntry->getRules(parentId)) {
+                if (rule.action == PatchAction::ProjectOption) {
+                    for (const Attribute &attr : attributes) {
+                        if (attr.name == "show_notes" && attr.valueEnd > attr.valueStart) {
+                            frame.isNote = !selfClosing;
+                            break;
+                        }
+                    }
+                    if (frame.isNote) {
+                        _noteText.clear();
+                        break;
+                    }
+                    if (!_hasNotes) {
+                        insertNote(frame.indent, frame.hasIndent);
+                    }
+                    rewrite(attributes, rule);
+                } else if (rule.action == PatchAction::InjectCompiler) {
+                    inject = true;
+                } else {
+                    rewrite(attributes, rule);
+                }
+            }
+        }
+        for (const Attribute &attr : attributes) {
+            if (attr.changed) {
+                addEdit(attr.valueStart, attr.valueEnd, escapeXmlAttribute(attr.value));
+            }
+        }
+
+        if (name == "Project" && !_hasNotes && !_notePending) {
+            // Hold back the output until the first Option of the Project decides if the note is inserted.
+            _notePending = true;
+            _projectDepth = _stack.size();
+            _projectContentStart = tagEnd;
+        }
+
+        if (inject && (_hasNewNote || _notePending)) {
+            CompilerInjection injection;
+            injection.name = name;
+            injection.afterStartTag = tagEnd;
+            injection.beforeEndTag = NPOS;
+            injection.selfCloseStart = selfClosing ? (tagEnd - 2) : NPOS;
+            injection.indent = frame.indent;
+            injection.hasIndent = frame.hasIndent;
+            injection.childOfProject = _notePending && (_stack.size() == _projectDepth + 1);
+            injection.active = false;
+            _injections.push_back(injection);
+            frame.injection = static_cast<int>(_injections.size() - 1);
+            if (_hasNewNote) {
+                activate(_injections.back());
+            }
+        }
+
+        if (selfClosing) {
+            // A self closing note does not have a text, readNote would fail on it
+            return;
+        }
+        _stack.push_back(frame);
+    }
+
+    bool onEndTag() {
+        if (_stack.empty()) {
+            return false;
+        }
+
+        Frame frame = _stack.back();
+        _stack.pop_back();
+
+        if (frame.isNote) {
+            readNoteContent(_noteText, _context);
+            _result = (_context.oldVirtualFolderPrefix == _context.virtualFolderPrefix) ? PatchResult::AlreadyPatched
+                                                                                       : PatchResult::DifferentSDK;
+            _decided = true;
+            return true;
+        }
+
+        if (frame.injection >= 0) {
+            CompilerInjection &injection = _injections[static_cast<size_t>(frame.injection)];
+            injection.beforeEndTag = _textStart;
+            if (injection.active) {
+                closeInjection(injection);
+            }
+        }
+
+        if (frame.name == "Project" && _notePending && _stack.size() == _projectDepth) {
+            // No Option in the Project: no note is created.
+            _notePending = false;
+            _injections.clear();
+        }
+        return true;
+    }
+
+    CbpPatchContext &_context;
+    InputWindow _in;
+    std::ostream *_out;
+    std::vector<CbpEdit> *_outEdits;
+    CbpSubtreeSnapshot *_snapshot = nullptr;
+    std::shared_ptr<const CbpPatchRules> _rules;
+
+    std::vector<Frame> _stack;
+    std::deque<CbpEdit> _edits;
+    std::vector<CompilerInjection> _injections;
+    std::string _indentUnit;
+    std::string _noteText;
+
+    size_t _flushed = 0;
+    size_t _textStart = 0;
+    size_t _projectDepth = 0;
+    size_t _projectContentStart = 0;
+
+    bool _hasNotes = false;
+    bool _hasNewNote = false;
+    bool _notePending = false;
+    bool _changed = false;
+    bool _decided = false;
+    PatchResult _result = PatchResult::Error;
+
+    /// @brief the subtree whose edits are recorded for the snapshot.
+    bool _recording = false;
+    size_t _recordStart = 0;
+    size_t _recordEnd = 0;
+    CbpSubtreeSnapshot::Key _recordKey;
+    CbpSubtreeSnapshot::Subtree _recorded;
+};
+
+} // namespace
+
+PatchResult patchCBPStream(CbpPatchContext &context, std::istream &input, std::ostream &output) {
+    CbpStreamTransformer transformer(context, input, output);
+    return transformer.run();
+}
+
+namespace {
+
+std::string keyToString(const CbpSubtreeSnapshot::Key &key) {
+    return ga::toHex(key.hash1) + ga::toHex(key.hash2) + ga::toHex(key.size);
+}
+
+bool stringToKey(const std::string &value, CbpSubtreeSnapshot::Key &outKey) {
+    if (value.size() != 48 || value.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        return false;
+    }
+    outKey.hash1 = std::strtoull(value.substr(0, 16).c_str(), nullptr, 16);
+    outKey.hash2 = std::strtoull(value.substr(16, 16).c_str(), nullptr, 16);
+    outKey.size = std::strtoull(value.substr(32, 16).c_str(), nullptr, 16);
+    return true;
+}
+
+} // namespace
+
+const std::string CbpSubtreeSnapshot::EXTENSION = ".xcmake_snapshot";
+
+bool CbpSubtreeSnapshot::load(const std::string &bytes, const std::string &profile) {
+    _subtrees.clear();
+
+    nlohmann::json jObj = nlohmann::json::parse(bytes, nullptr, false);
+    if (!jObj.is_object() || jObj.value("version", 0) != SNAPSHOT_VERSION || !jObj.contains("profile") ||
+        jObj["profile"] != profile || !jObj.contains("subtrees") || !jObj["subtrees"].is_object()) {
+        return false;
+    }
+
+    for (const auto &kv : jObj["subtrees"].items()) {
+        const nlohmann::json &jSubtree = kv.value();
+        Key key;
+        if (!stringToKey(kv.key(), key) || !jSubtree.is_object() || !jSubtree.contains("edits") ||
+            !jSubtree["edits"].is_array()) {
+            continue;
+        }
+
+        Subtree subtree;
+        subtree.indentUnit = jSubtree.value("indentUnit", std::string());
+        bool valid = true;
+        for (const nlohmann::json &jEdit : jSubtree["edits"]) {
+            if (!jEdit.is_array() || jEdit.size() != 3 || !jEdit[0].is_number_unsigned() ||
+                !jEdit[1].is_number_unsigned() || !jEdit[2].is_string()) {
+                valid = false;
+                break;
+            }
+            subtree.edits.push_back(
+                CbpEdit{jEdit[0].get<size_t>(), jEdit[1].get<size_t>(), jEdit[2].get<std::string>()});
+        }
+        if (valid) {
+            _subtrees[key] = Entry{std::move(subtree), _generation};
+        }
+    }
+    // The loaded subtrees are dropped on the next commit unless they are found in the input
+    _generation++;
+    return true;
+}
+
+std::string CbpSubtreeSnapshot::save(const std::string &profile) const {
+    nlohmann::json jSubtrees = nlohmann::json::object();
+    for (const auto &kv : _subtrees) {
+        nlohmann::json jEdits = nlohmann::json::array();
+        for (const CbpEdit &edit : kv.second.subtree.edits) {
+            jEdits.push_back(nlohmann::json::array({edit.start, edit.end, edit.text}));
+        }
+        nlohmann::json jSubtree;
+        jSubtree["edits"] = jEdits;
+        jSubtree["indentUnit"] = kv.second.subtree.indentUnit;
+        jSubtrees[keyToString(kv.first)] = jSubtree;
+    }
+
+    nlohmann::json jObj;
+    jObj["version"] = SNAPSHOT_VERSION;
+    jObj["profile"] = profile;
+    jObj["subtrees"] = jSubtrees;
+    return jObj.dump();
+}
+
+const CbpSubtreeSnapshot::Subtree *CbpSubtreeSnapshot::find(const Key &key) {
+    auto it = _subtrees.find(key);
+    if (it == _subtrees.end()) {
+        return nullptr;
+    }
+    it->second.generation = _generation;
+    return &it->second.subtree;
+}
+
+void CbpSubtreeSnapshot::add(const Key &key, Subtree subtree) {
+    _subtrees[key] = Entry{std::move(subtree), _generation};
+}
+
+void CbpSubtreeSnapshot::commit() {
+    for (auto it = _subtrees.begin(); it != _subtrees.end();) {
+        if (it->second.generation != _generation) {
+            it = _subtrees.erase(it);
+        } else {
+            it++;
+        }
+    }
+    _generation++;
+}
+
+void CbpSubtreeSnapshot::discard() { _generation++; }
+
+PatchResult findCBPEdits(CbpPatchContext &context, const char *data, size_t size, std::vector<CbpEdit> &outEdits,
+                         CbpSubtreeSnapshot *snapshot) {
+    outEdits.clear();
+    if (snapshot != nullptr) {
+        snapshot->reused = 0;
+        snapshot->transformed = 0;
+    }
+
+    CbpStreamTransformer transformer(context, data, size, outEdits, snapshot);
+    PatchResult result = transformer.run();
+    if (snapshot != nullptr) {
+        if (result == PatchResult::Changed || result == PatchResult::Unchanged) {
+            snapshot->commit();
+        } else {
+            snapshot->discard();
+        }
+    }
+    return result;
+}
+
+bool writeCBPEdits(const char *data, size_t size, const std::vector<CbpEdit> &edits, std::ostream &output) {
+    size_t copied = 0;
+    for (const CbpEdit &edit : edits) {
+        if (edit.start < copied || edit.end < edit.start || edit.end > size) {
+            return false;
+        }
+        output.write(data + copied, static_cast<std::streamsize>(edit.start - copied));
+        output.write(edit.text.data(), static_cast<std::streamsize>(edit.text.size()));
+        copied = edit.end;
+    }
+    output.write(data + copied, static_cast<std::streamsize>(size - copied));
+    return static_cast<bool>(output);
+}
+
+} // namespace gatools
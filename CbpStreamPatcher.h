@@ -0,0 +1,104 @@
+#pragma once
+
+#include "CbpPatcher.h"
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace gatools {
+
+/// @brief patch the .cbp read from the input without building a DOM.
+/// The same rules as patchCBP are applied in a single forward pass and the result is written to the output.
+/// Only the current tag, the text before it and the element stack are kept in memory
+/// (and the start of the Project element until its first Option decides if a note has to be inserted).
+/// The formatting of the input is preserved, only the patched values and the inserted elements differ.
+/// The output is complete only if PatchResult::Changed or PatchResult::Unchanged is returned.
+/// context.inOutXml is not used.
+PatchResult patchCBPStream(CbpPatchContext &context, std::istream &input, std::ostream &output);
+
+/// @brief replace the input bytes [start, end) with the text.
+struct CbpEdit {
+    size_t start;
+    size_t end;
+    std::string text;
+};
+
+/// @brief the edits of the Target and Unit subtrees of a previous input, stored next to the .bak of the .cbp.
+/// A subtree is keyed by the hash of its bytes and of the state it was patched in (parent, indentation),
+/// so when cmake regenerates the .cbp only the new or changed subtrees have to be transformed again.
+class CbpSubtreeSnapshot {
+  public:
+    static const std::string EXTENSION;
+
+    struct Subtree {
+        /// @brief the edits, relative to the start of the subtree.
+        std::vector<CbpEdit> edits;
+        /// @brief the indentation unit after the subtree.
+        std::string indentUnit;
+    };
+
+    /// @brief 128 bits of hash and the size of the subtree.
+    struct Key {
+        uint64_t hash1;
+        uint64_t hash2;
+        uint64_t size;
+
+        bool operator==(const Key &other) const {
+            return hash1 == other.hash1 && hash2 == other.hash2 && size == other.size;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const { return static_cast<size_t>(key.hash1); }
+    };
+
+    /// @brief load the subtrees saved for the profile.
+    /// @return false if the bytes are not a snapshot or were saved with another patch profile.
+    bool load(const std::string &bytes, const std::string &profile);
+
+    std::string save(const std::string &profile) const;
+
+    /// @brief find a subtree of the current input, it is kept on commit.
+    const Subtree *find(const Key &key);
+
+    /// @brief add a subtree of the current input.
+    void add(const Key &key, Subtree subtree);
+
+    /// @brief drop the subtrees that were not found or added since the last commit.
+    void commit();
+
+    /// @brief the input could not be patched, the subtrees are dropped on the next commit unless they are found again.
+    void discard();
+
+    size_t size() const { return _subtrees.size(); }
+
+    /// @brief the number of subtrees reused and transformed by the last findCBPEdits.
+    size_t reused = 0;
+    size_t transformed = 0;
+
+  private:
+    struct Entry {
+        Subtree subtree;
+        /// @brief the last commit that found or added the subtree.
+        uint32_t generation;
+    };
+
+    std::unordered_map<Key, Entry, KeyHash> _subtrees;
+    uint32_t _generation = 0;
+};
+
+/// @brief find the edits that patchCBPStream applies to the .cbp in memory (e.g. a mapped file).
+/// Nothing is copied: the output is the input with the edits applied (see writeCBPEdits).
+/// The edits are sorted by position and do not overlap.
+/// The edits are complete only if PatchResult::Changed is returned.
+/// @param snapshot if set, the edits of the unchanged subtrees are reused from it and, on PatchResult::Changed or
+/// PatchResult::Unchanged, it is replaced with the subtrees of this input.
+PatchResult findCBPEdits(CbpPatchContext &context, const char *data, size_t size, std::vector<CbpEdit> &outEdits,
+                         CbpSubtreeSnapshot *snapshot = nullptr);
+
+/// @brief write the unchanged byte ranges of the input and the text of the edits between them.
+/// @return false if the edits are not sorted or if the output failed.
+bool writeCBPEdits(const char *data, size_t size, const std::vector<CbpEdit> &edits, std::ostream &output);
+
+} // namespace gatools
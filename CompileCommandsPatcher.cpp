@@ -0,0 +1,505 @@
+#include "CompileCommandsPatcher.h"
+
+#include "CbpRewriteRoots.h"
+#include "json.hpp"
+
+#include <cstring>
+
+namespace gatools {
+
+namespace {
+
+/// @brief a word of a shell command line: the raw bytes [start, end) and the unquoted value.
+struct CommandWord {
+    size_t start;
+    size_t end;
+    std::string value;
+};
+
+inline bool isShellSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+/// @brief split a command line the way the shell does (quotes and backslashes, no expansions).
+/// The words of the previous command line are reused, only the first outCount words are set.
+void splitCommandLine(const std::string &command, std::vector<CommandWord> &words, size_t &outCount) {
+    outCount = 0;
+    const size_t n = command.size();
+    size_t p = 0;
+    for (;;) {
+        while (p < n && isShellSpace(command[p])) {
+            p++;
+        }
+        if (p >= n) {
+            break;
+        }
+
+        if (outCount == words.size()) {
+            words.emplace_back();
+        }
+        CommandWord &word = words[outCount++];
+        word.start = p;
+        word.value.clear();
+        char quote = '\0';
+        while (p < n) {
+            // Copy the run of ordinary characters at once
+            size_t runEnd = command.find_first_of((quote == '\0') ? " \t\n\r'\"\\" : (quote == '"') ? "\"\\" : "'", p);
+            if (runEnd == std::string::npos) {
+                runEnd = n;
+            }
+            word.value.append(command, p, runEnd - p);
+            p = runEnd;
+            if (p >= n) {
+                break;
+            }
+
+            char c = command[p];
+            if (quote == '\'') {
+                quote = '\0';
+            } else if (quote == '"') {
+                if (c == '"') {
+                    quote = '\0';
+                } else if (p + 1 < n && strchr("\"\\$`", command[p + 1]) != nullptr) {
+                    word.value += command[++p];
+                } else {
+                    word.value += c;
+                }
+            } else if (isShellSpace(c)) {
+                break;
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (p + 1 < n) {
+                word.value += command[++p];
+            } else {
+                word.value += c;
+            }
+            p++;
+        }
+        word.end = p;
+    }
+}
+
+/// @brief append the argument, quoted for the shell if it contains anything else than the usual path and option
+/// characters.
+void appendQuoted(std::string &out, const std::string &value) {
+    bool safe = !value.empty();
+    for (char c : value) {
+        if (!isalnum(static_cast<unsigned char>(c)) && strchr("_-+=/.,:@%", c) == nullptr) {
+            safe = false;
+            break;
+        }
+    }
+    if (safe) {
+        out += value;
+        return;
+    }
+
+    out += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\' || c == '$' || c == '`') {
+            out += '\\';
+        }
+        out += c;
+    }
+    out += '"';
+}
+
+/// @brief append the value as a json string.
+void appendJsonString(std::string &out, const std::string &value) {
+    static const char hexDigits[] = "0123456789abcdef";
+    out += '"';
+    size_t copied = 0;
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(value, copied, i - copied);
+        copied = i + 1;
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            out += "\\u00";
+            out += hexDigits[c >> 4];
+            out += hexDigits[c & 0xf];
+            break;
+        }
+    }
+    out.append(value, copied, std::string::npos);
+    out += '"';
+}
+
+/// @brief write the json events back to the output, with the paths of the entries patched.
+/// The array and the entries are written one item per line (like cmake does), deeper containers on a single line.
+class CompileCommandsWriter : public nlohmann::json_sax<nlohmann::json> {
+  public:
+    static const size_t OUTPUT_CHUNK_SIZE = 64 * 1024;
+
+    CompileCommandsWriter(const CbpPatchContext &context, std::ostream &output)
+        : _context(context)
+        , _roots(getRewriteRoots(context))
+        , _out(output) {
+        _buffer.reserve(OUTPUT_CHUNK_SIZE * 2);
+        for (const std::string &fix : context.gccClangFixes) {
+            _inserted.push_back(fix);
+        }
+        for (const std::string &addDir : context.extraAddDirectory) {
+            std::string value = addDir;
+            addPrefix(value, context.sdkDir, _roots);
+            _inserted.push_back("-I" + value);
+        }
+    }
+
+    bool isChanged() const { return _changed; }
+
+    /// @brief write the rest of the output.
+    bool finish() {
+        _out.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _buffer.clear();
+        return static_cast<bool>(_out);
+    }
+
+    bool null() override {
+        writeScalar("null");
+        return true;
+    }
+
+    bool boolean(bool val) override {
+        writeScalar(val ? "true" : "false");
+        return true;
+    }
+
+    bool number_integer(number_integer_t val) override {
+        writeScalar(std::to_string(val));
+        return true;
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        writeScalar(std::to_string(val));
+        return true;
+    }
+
+    bool number_float(number_float_t, const string_t &s) override {
+        writeScalar(s);
+        return true;
+    }
+
+    bool string(string_t &val) override {
+        if (_stack.size() == 2 && _stack.back().isObject) {
+            switch (_field) {
+            case Field::Directory:
+            case Field::File:
+                _changed = rewritePath(val) || _changed;
+                break;
+            case Field::Command:
+                _changed = patchCommandLine(val) || _changed;
+                break;
+            default:
+                break;
+            }
+        } else if (_stack.size() == 3 && _field == Field::Arguments && !_stack.back().isObject) {
+            addArgument(val);
+            return true;
+        }
+        beginValue();
+        appendJsonString(_buffer, val);
+        return true;
+    }
+
+    bool binary(binary_t &) override { return false; }
+
+    bool start_object(std::size_t) override {
+        beginValue();
+        _buffer += '{';
+        _stack.push_back(Container{true, false});
+        return true;
+    }
+
+    bool key(string_t &val) override {
+        Container &container = _stack.back();
+        if (container.hasValue) {
+            _buffer += ',';
+            if (!isMultiLine(_stack.size() - 1)) {
+                _buffer += ' ';
+            }
+        }
+        container.hasValue = true;
+        newLine(_stack.size() - 1);
+        appendJsonString(_buffer, val);
+        _buffer += ": ";
+
+        if (_stack.size() == 2) {
+            _field = Field::Other;
+            if (val == "directory") {
+                _field = Field::Directory;
+            } else if (val == "file") {
+                _field = Field::File;
+            } else if (val == "command") {
+                _field = Field::Command;
+            } else if (val == "arguments") {
+                _field = Field::Arguments;
+            }
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        endContainer('}');
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        beginValue();
+        _buffer += '[';
+        _stack.push_back(Container{false, false});
+        if (_stack.size() == 3 && _field == Field::Arguments) {
+            _argumentCount = 0;
+            _pending.clear();
+            _comparing = false;
+        }
+        return true;
+    }
+
+    bool end_array() override {
+        if (_stack.size() == 3 && _field == Field::Arguments && _comparing) {
+            flushPending();
+        }
+        endContainer(']');
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) override { return false; }
+
+  private:
+    enum class Field { Other, Directory, File, Command, Arguments };
+
+    struct Container {
+        bool isObject;
+        bool hasValue;
+    };
+
+    /// @brief the array and the entries have one item per line.
+    bool isMultiLine(size_t level) const { return level < 2; }
+
+    void newLine(size_t level) {
+        if (isMultiLine(level)) {
+            _buffer += '\n';
+            for (size_t i = 0; i < level; i++) {
+                _buffer += "  ";
+            }
+        }
+    }
+
+    /// @brief write the separator before a value of an array (the key already wrote it in an object).
+    void beginValue() {
+        if (_stack.empty() || _stack.back().isObject) {
+            return;
+        }
+        Container &container = _stack.back();
+        if (container.hasValue) {
+            _buffer += ',';
+            if (!isMultiLine(_stack.size() - 1)) {
+                _buffer += ' ';
+            }
+        }
+        container.hasValue = true;
+        newLine(_stack.size() - 1);
+    }
+
+    void writeScalar(const std::string &text) {
+        beginValue();
+        _buffer += text;
+    }
+
+    void endContainer(char c) {
+        bool hasValue = _stack.back().hasValue;
+        _stack.pop_back();
+        if (hasValue && isMultiLine(_stack.size())) {
+            newLine(_stack.size() == 0 ? 0 : _stack.size() - 1);
+        }
+        _buffer += c;
+        if (_stack.empty()) {
+            _buffer += '\n';
+        }
+        if (_buffer.size() >= OUTPUT_CHUNK_SIZE) {
+            finish();
+        }
+    }
+
+    /// @brief relocate a path inside a rewrite root. The paths already inside the SDK are not changed.
+    bool rewritePath(std::string &value) const {
+        if (!_roots.contains(value)) {
+            return false;
+        }
+        return addPrefix(value, _context.sdkDir, _roots);
+    }
+
+    /// @brief relocate a path argument or the path of an option ("-I/usr/include", "--sysroot=/usr").
+    bool rewriteArgument(std::string &value) const {
+        if (value.empty()) {
+            return false;
+        }
+        if (value[0] == '/') {
+            return rewritePath(value);
+        }
+        if (value[0] != '-') {
+            return false;
+        }
+
+        size_t p = 1;
+        while (p < value.size() &&
+               (isalnum(static_cast<unsigned char>(value[p])) || value[p] == '-' || value[p] == '_')) {
+            p++;
+        }
+        if (p < value.size() && value[p] == '=') {
+            p++;
+        }
+        if (p >= value.size() || value[p] != '/') {
+            return false;
+        }
+        std::string path = value.substr(p);
+        if (!rewritePath(path)) {
+            return false;
+        }
+        value.replace(p, std::string::npos, path);
+        return true;
+    }
+
+    /// @brief patch the arguments of a command line, the words that are not changed keep their quoting.
+    bool patchCommandLine(std::string &command) {
+        size_t wordCount = 0;
+        splitCommandLine(command, _words, wordCount);
+        if (wordCount == 0) {
+            return false;
+        }
+
+        bool changed = false;
+        _rewritten.assign(wordCount, 0);
+        for (size_t i = 1; i < wordCount; i++) {
+            if (rewriteArgument(_words[i].value)) {
+                _rewritten[i] = 1;
+            }
+        }
+        bool insert = !startsWithInserted(wordCount - 1, [this](size_t i) -> const std::string & {
+            return _words[i + 1].value;
+        });
+
+        std::string patched(command, 0, _words[0].end);
+        if (insert) {
+            for (const std::string &arg : _inserted) {
+                patched += ' ';
+                appendQuoted(patched, arg);
+            }
+            changed = true;
+        }
+        size_t copied = _words[0].end;
+        for (size_t i = 1; i < wordCount; i++) {
+            if (_rewritten[i] != 0) {
+                patched.append(command, copied, _words[i].start - copied);
+                appendQuoted(patched, _words[i].value);
+                copied = _words[i].end;
+                changed = true;
+            }
+        }
+        patched.append(command, copied, std::string::npos);
+        if (changed) {
+            command = std::move(patched);
+        }
+        return changed;
+    }
+
+    /// @brief check if the arguments after the compiler are the inserted ones (the command was already patched).
+    template <typename GetArgument>
+    bool startsWithInserted(size_t count, const GetArgument &getArgument) const {
+        if (_inserted.empty()) {
+            return true;
+        }
+        if (count < _inserted.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < _inserted.size(); i++) {
+            if (getArgument(i) != _inserted[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief the arguments after the compiler are held back until they can be compared with the inserted ones.
+    void addArgument(std::string &value) {
+        size_t index = _argumentCount++;
+        if (index > 0) {
+            _changed = rewriteArgument(value) || _changed;
+        }
+        if (_comparing) {
+            _pending.push_back(std::move(value));
+            if (_pending.size() == _inserted.size()) {
+                flushPending();
+            }
+            return;
+        }
+
+        beginValue();
+        appendJsonString(_buffer, value);
+        if (index == 0 && !_inserted.empty()) {
+            _comparing = true;
+        }
+    }
+
+    void flushPending() {
+        _comparing = false;
+        if (!startsWithInserted(_pending.size(), [this](size_t i) -> const std::string & { return _pending[i]; })) {
+            for (const std::string &arg : _inserted) {
+                beginValue();
+                appendJsonString(_buffer, arg);
+            }
+            _changed = true;
+        }
+        for (const std::string &arg : _pending) {
+            beginValue();
+            appendJsonString(_buffer, arg);
+        }
+        _pending.clear();
+    }
+
+    const CbpPatchContext &_context;
+    const CbpRewriteRoots &_roots;
+    std::ostream &_out;
+    /// @brief the output is written by chunks, an entry is written when it ends.
+    std::string _buffer;
+    /// @brief the gccClangFixes and the extraAddDirectory, inserted after the compiler.
+    std::vector<std::string> _inserted;
+
+    std::vector<Container> _stack;
+    Field _field = Field::Other;
+    std::vector<CommandWord> _words;
+    std::vector<char> _rewritten;
+    size_t _argumentCount = 0;
+    std::vector<std::string> _pending;
+    bool _comparing = false;
+    bool _changed = false;
+};
+
+} // namespace
+
+PatchResult patchCompileCommands(const CbpPatchContext &context, std::istream &input, std::ostream &output) {
+    CompileCommandsWriter writer(context, output);
+    if (!nlohmann::json::sax_parse(input, &writer) || !writer.finish()) {
+        return PatchResult::Error;
+    }
+    return writer.isChanged() ? PatchResult::Changed : PatchResult::Unchanged;
+}
+
+} // namespace gatools
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "CbpPatcher.h"
+#include <istream>
+#include <ostream>
+
+namespace gatools {
+
+/// @brief the compilation database written by cmake in the build directory.
+const char *const COMPILE_COMMANDS_FILENAME = "compile_commands.json";
+
+/// @brief patch the compile_commands.json read from the input with the SDK of the context, in a single pass.
+/// The paths under the rewrite roots are relocated like addPrefix does for the .cbp: the "directory" and "file"
+/// values, the arguments that are paths and the paths of the options ("-I/usr/include", "--sysroot=/usr").
+/// The compiler (the first argument) is not changed. The gccClangFixes and the extraAddDirectory ("-I<dir>")
+/// are inserted after the compiler of every command, unless the command already starts with them.
+/// The input is read with a SAX parser and every value is written as soon as it is read, so the memory does not
+/// depend on the size of the database. Only "command" and "arguments" are supported as the command of an entry.
+/// @return PatchResult::Changed or PatchResult::Unchanged, PatchResult::Error if the input is not valid json
+/// (the output is then incomplete).
+PatchResult patchCompileCommands(const CbpPatchContext &context, std::istream &input, std::ostream &output);
+
+} // namespace gatools
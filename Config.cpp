@@ -3,6 +3,7 @@
 #include "file_system.h"
 #include "json.hpp"
 #include <iomanip>
+#include <sstream>
 
 namespace gatools {
 
@@ -18,6 +19,12 @@ inline void readJValue(const nlohmann::json &jObj, const std::string &key, bool
     }
 }
 
+inline void readJValue(const nlohmann::json &jObj, const std::string &key, int &out) {
+    if (jObj.contains(key) && jObj[key].is_number_integer()) {
+        jObj[key].get_to(out);
+    }
+}
+
 inline void readJValue(const nlohmann::json &jObj, const std::string &key, std::set<std::string> &out) {
     if (jObj.contains(key) && jObj[key].is_array()) {
         for (const auto &jElem : jObj[key]) {
@@ -56,11 +63,53 @@ inline void readJValue(const nlohmann::json &jObj, const std::string &key,
     }
 }
 
+inline void readJValue(const nlohmann::json &jObj, const std::string &key, std::vector<JPatchRule> &out) {
+    if (jObj.contains(key) && jObj[key].is_array()) {
+        for (const auto &jElem : jObj[key]) {
+            if (jElem.is_object()) {
+                JPatchRule rule;
+                readJValue(jElem, "path", rule.path);
+                readJValue(jElem, "attribute", rule.attribute);
+                readJValue(jElem, "action", rule.action);
+                readJValue(jElem, "from", rule.from);
+                readJValue(jElem, "to", rule.to);
+                out.push_back(rule);
+            }
+        }
+    }
+}
+
+inline nlohmann::json to_json(const std::vector<JPatchRule> &in) {
+    nlohmann::json jArray = nlohmann::json::array();
+    for (const JPatchRule &rule : in) {
+        nlohmann::json jRule;
+        jRule["path"] = rule.path;
+        jRule["attribute"] = rule.attribute;
+        jRule["action"] = rule.action;
+        if (!rule.from.empty() || !rule.to.empty()) {
+            jRule["from"] = rule.from;
+            jRule["to"] = rule.to;
+        }
+        jArray.push_back(jRule);
+    }
+    return jArray;
+}
+
 inline void readJSharedConfig(const nlohmann::json &jObj, JSharedConfig &out) {
     readJValue(jObj, "cmdEnvironment", out.cmdEnvironment);
     readJValue(jObj, "cmdReplacement", out.cmdReplacement);
     readJValue(jObj, "gccClangFixes", out.gccClangFixes);
     readJValue(jObj, "extraAddDirectory", out.extraAddDirectory);
+    readJValue(jObj, "patchWorkers", out.patchWorkers);
+    readJValue(jObj, "patchEngine", out.patchEngine);
+    readJValue(jObj, "patchRules", out.patchRules);
+    readJValue(jObj, "sdkRewriteRoots", out.sdkRewriteRoots);
+    readJValue(jObj, "retargetSdk", out.retargetSdk);
+    readJValue(jObj, "patchCompileCommands", out.patchCompileCommands);
+    readJValue(jObj, "fileApi", out.fileApi);
+    readJValue(jObj, "captureLogDir", out.captureLogDir);
+    readJValue(jObj, "patchCacheSizeMB", out.patchCacheSizeMB);
+    readJValue(jObj, "patchCacheDir", out.patchCacheDir);
 }
 
 inline void readJProject(const nlohmann::json &jObj, JProject &out) {
@@ -89,6 +138,37 @@ inline void writeJSharedConfig(const JSharedConfig &in, nlohmann::json &jOut) {
     jOut["cmdReplacement"] = in.cmdReplacement;
     jOut["gccClangFixes"] = in.gccClangFixes;
     jOut["extraAddDirectory"] = in.extraAddDirectory;
+    // The optional settings are written only when they are set, the files edited by hand keep their keys
+    if (in.patchWorkers != 0) {
+        jOut["patchWorkers"] = in.patchWorkers;
+    }
+    if (!in.patchEngine.empty()) {
+        jOut["patchEngine"] = in.patchEngine;
+    }
+    if (!in.patchRules.empty()) {
+        jOut["patchRules"] = to_json(in.patchRules);
+    }
+    if (!in.sdkRewriteRoots.empty()) {
+        jOut["sdkRewriteRoots"] = in.sdkRewriteRoots;
+    }
+    if (in.retargetSdk) {
+        jOut["retargetSdk"] = in.retargetSdk;
+    }
+    if (in.patchCompileCommands) {
+        jOut["patchCompileCommands"] = in.patchCompileCommands;
+    }
+    if (in.fileApi) {
+        jOut["fileApi"] = in.fileApi;
+    }
+    if (!in.captureLogDir.empty()) {
+        jOut["captureLogDir"] = in.captureLogDir;
+    }
+    if (in.patchCacheSizeMB != 0) {
+        jOut["patchCacheSizeMB"] = in.patchCacheSizeMB;
+    }
+    if (!in.patchCacheDir.empty()) {
+        jOut["patchCacheDir"] = in.patchCacheDir;
+    }
 }
 
 inline void writeJProject(const JProject &in, nlohmann::json &jOut) {
@@ -241,6 +321,35 @@ bool selectProject(const JConfig &in, const std::string &projectOrBuildDir, JPro
         }
         out.extraAddDirectory = dirs;
 
+        if (out.patchWorkers == 0) {
+            out.patchWorkers = in.patchWorkers;
+        }
+        if (out.patchEngine.empty()) {
+            out.patchEngine = in.patchEngine;
+        }
+        if (out.patchCacheSizeMB == 0) {
+            out.patchCacheSizeMB = in.patchCacheSizeMB;
+        }
+        if (out.patchCacheDir.empty()) {
+            out.patchCacheDir = in.patchCacheDir;
+        }
+        if (out.captureLogDir.empty()) {
+            out.captureLogDir = in.captureLogDir;
+        }
+        if (out.sdkRewriteRoots.empty()) {
+            out.sdkRewriteRoots = in.sdkRewriteRoots;
+        }
+        out.retargetSdk = out.retargetSdk || in.retargetSdk;
+        out.patchCompileCommands = out.patchCompileCommands || in.patchCompileCommands;
+        out.fileApi = out.fileApi || in.fileApi;
+
+        std::vector<JPatchRule> patchRules = in.patchRules;
+        patchRules.insert(patchRules.end(), out.patchRules.begin(), out.patchRules.end());
+        for (JPatchRule &rule : patchRules) {
+            replaceAll("${sdkPath}", sdkDirWithS, rule.to);
+        }
+        out.patchRules = patchRules;
+
         for (const std::string &env : in.cmdEnvironment) {
             auto it = out.cmdEnvironment.find(env);
             if (it == out.cmdEnvironment.end()) {
@@ -321,15 +430,104 @@ bool updateProject(const std::string &projectDir, const std::string &buildDir, J
     return updated;
 }
 
+inline nlohmann::json to_json(const std::vector<std::string_view> &in) {
+    nlohmann::json jArray = nlohmann::json::array();
+    for (std::string_view value : in) {
+        jArray.push_back(std::string(value));
+    }
+    return jArray;
+}
+
+/// @brief the key of a "KEY=value" variable.
+inline std::string_view getEnvKey(std::string_view keyValue) { return keyValue.substr(0, keyValue.find('=')); }
+
+void CmdLineArgs::setArg(size_t index, std::string_view value) {
+    if (index < args.size()) {
+        args[index] = store(value);
+    }
+}
+
+void CmdLineArgs::setEnv(std::string_view keyValue) {
+    indexEnv();
+
+    std::string_view value = store(keyValue);
+    std::string_view key = getEnvKey(value);
+    size_t mask = _envIndex.size() - 1;
+    size_t slot = std::hash<std::string_view>()(key) & mask;
+    while (_envIndex[slot] != 0 && getEnvKey(env[_envIndex[slot] - 1]) != key) {
+        slot = (slot + 1) & mask;
+    }
+    if (_envIndex[slot] != 0) {
+        env[_envIndex[slot] - 1] = value;
+    } else {
+        env.push_back(value);
+        _envIndex[slot] = static_cast<uint32_t>(env.size());
+    }
+    _indexedData = env.data();
+    _indexedSize = env.size();
+}
+
+void CmdLineArgs::indexEnv() {
+    // Half of the slots stay empty, the variable added by setEnv included
+    if (_indexedData == env.data() && _indexedSize == env.size() && (env.size() + 1) * 2 <= _envIndex.size()) {
+        return;
+    }
+    size_t slotCount = 64;
+    while (slotCount < (env.size() + 1) * 2) {
+        slotCount *= 2;
+    }
+    _envIndex.assign(slotCount, 0);
+    size_t mask = slotCount - 1;
+    for (size_t i = 0; i < env.size(); i++) {
+        std::string_view key = getEnvKey(env[i]);
+        size_t slot = std::hash<std::string_view>()(key) & mask;
+        while (_envIndex[slot] != 0 && getEnvKey(env[_envIndex[slot] - 1]) != key) {
+            slot = (slot + 1) & mask;
+        }
+        // The first variable of a key is the one getenv finds
+        if (_envIndex[slot] == 0) {
+            _envIndex[slot] = static_cast<uint32_t>(i + 1);
+        }
+    }
+    _indexedData = env.data();
+    _indexedSize = env.size();
+}
+
+std::string_view CmdLineArgs::store(std::string_view value) {
+    if (!_overlay) {
+        _overlay = std::make_shared<std::deque<std::string>>();
+    }
+    _overlay->emplace_back(value);
+    return _overlay->back();
+}
+
 inline nlohmann::json to_json(const CmdLineArgs &in) {
     nlohmann::json jObj;
-    jObj["args"] = in.args;
-    jObj["env"] = in.env;
+    jObj["args"] = to_json(in.args);
+    jObj["env"] = to_json(in.env);
     jObj["pwd"] = in.pwd;
     jObj["home"] = in.home;
     return jObj;
 }
 
+inline nlohmann::json to_json(const ChildUsage &in) {
+    nlohmann::json jObj;
+    jObj["status"] = in.status;
+    jObj["exitCode"] = in.exitCode;
+    jObj["termSignal"] = in.termSignal;
+    jObj["wallSeconds"] = in.wallSeconds;
+    jObj["userSeconds"] = in.userSeconds;
+    jObj["systemSeconds"] = in.systemSeconds;
+    jObj["maxRssKB"] = in.maxRssKB;
+    jObj["majorFaults"] = in.majorFaults;
+    jObj["minorFaults"] = in.minorFaults;
+    jObj["voluntarySwitches"] = in.voluntarySwitches;
+    jObj["involuntarySwitches"] = in.involuntarySwitches;
+    jObj["blockInputs"] = in.blockInputs;
+    jObj["blockOutputs"] = in.blockOutputs;
+    return jObj;
+}
+
 inline nlohmann::json to_json(const ExecutionPlan &in) {
     nlohmann::json jObj;
     jObj["exePath"] = in.exePath;
@@ -343,13 +541,112 @@ inline nlohmann::json to_json(const ExecutionPlan &in) {
 
     jObj["extraAddDirectory"] = in.extraAddDirectory;
     jObj["gccClangFixes"] = in.gccClangFixes;
+    jObj["patchWorkers"] = in.patchWorkers;
+    jObj["patchEngine"] = in.patchEngine;
+    jObj["patchRules"] = to_json(in.patchRules);
+    jObj["sdkRewriteRoots"] = in.sdkRewriteRoots;
+    jObj["retargetSdk"] = in.retargetSdk;
+    jObj["patchCompileCommands"] = in.patchCompileCommands;
+    jObj["fileApi"] = in.fileApi;
+    jObj["captureLogDir"] = in.captureLogDir;
+    jObj["captureLogPath"] = in.captureLogPath;
+    jObj["patchCacheSizeMB"] = in.patchCacheSizeMB;
+    jObj["patchCacheDir"] = in.patchCacheDir;
+    jObj["childUsage"] = to_json(in.childUsage);
     jObj["output"] = in.output;
     jObj["log"] = in.log;
     return jObj;
 }
 
+/// @brief append the value as a json string, the bytes that are not escaped are copied as they are.
+inline void appendJsonString(std::string &out, std::string_view value) {
+    static const char hexDigits[] = "0123456789abcdef";
+    out += '"';
+    for (char c : value) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (u >= 0x20 && c != '"' && c != '\\') {
+            out += c;
+            continue;
+        }
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\b':
+            out += "\\b";
+            break;
+        case '\f':
+            out += "\\f";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            out += "\\u00";
+            out += hexDigits[u >> 4];
+            out += hexDigits[u & 0xf];
+            break;
+        }
+    }
+    out += '"';
+}
+
+inline void appendJsonArray(std::string &out, const std::vector<std::string_view> &values) {
+    out += '[';
+    for (size_t i = 0; i < values.size(); i++) {
+        if (i > 0) {
+            out += ',';
+        }
+        appendJsonString(out, values[i]);
+    }
+    out += ']';
+}
+
+/// @brief the same text as the json of the CmdLineArgs, written without building the json of the environment.
 std::ostream &operator<<(std::ostream &os, const CmdLineArgs &in) {
-    os << to_json(in);
+    size_t size = 64 + in.home.size() + in.pwd.size();
+    for (const std::vector<std::string_view> *values : {&in.args, &in.env}) {
+        for (std::string_view value : *values) {
+            size += value.size() + 3;
+        }
+    }
+    std::string out;
+    out.reserve(size);
+    out += "{\"args\":";
+    appendJsonArray(out, in.args);
+    out += ",\"env\":";
+    appendJsonArray(out, in.env);
+    out += ",\"home\":";
+    appendJsonString(out, in.home);
+    out += ",\"pwd\":";
+    appendJsonString(out, in.pwd);
+    out += '}';
+    os << out;
+    return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const ChildUsage &in) {
+    // Formatted apart, the flags of the caller's stream are not changed
+    std::ostringstream out;
+    if (in.termSignal != 0) {
+        out << "signal: " << in.termSignal;
+    } else {
+        out << "exit: " << in.exitCode;
+    }
+    out << std::fixed << std::setprecision(3) << " wall: " << in.wallSeconds << " s user: " << in.userSeconds
+        << " s sys: " << in.systemSeconds << " s maxRss: " << in.maxRssKB << " KB faults: " << in.majorFaults << "/"
+        << in.minorFaults << " switches: " << in.voluntarySwitches << "/" << in.involuntarySwitches
+        << " blocks: " << in.blockInputs << "/" << in.blockOutputs;
+    os << out.str();
     return os;
 }
 
@@ -1,17 +1,61 @@
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace gatools {
 
+/// @brief rewrite an attribute of the .cbp elements matching the path.
+struct JPatchRule {
+    /// @brief "Parent/Element", "*/Element" or "Element".
+    std::string path;
+    std::string attribute;
+    /// @brief "sdkPrefix", "virtualFolder" or "replace".
+    std::string action;
+    /// @brief "replace" only: every occurrence of from is replaced with to (${sdkPath} can be used in to).
+    std::string from;
+    std::string to;
+};
+
 struct JSharedConfig {
     std::set<std::string> cmdEnvironment;
     std::map<std::string, std::vector<std::string>> cmdReplacement;
     std::vector<std::string> extraAddDirectory;
     std::set<std::string> gccClangFixes;
+    /// @brief number of threads used for patching the .cbp files.
+    /// 0: not set (the global value is used, serial by default), -1: one per hardware thread.
+    int patchWorkers = 0;
+    /// @brief "splice" (default): map the .cbp and copy it with only the patched byte ranges replaced, the unchanged
+    /// subtrees are reused from the snapshot of the previous run. "dom": load the .cbp with tinyxml2,
+    /// "stream": patch in a single pass without a DOM. The engines write byte-identical .cbp files.
+    std::string patchEngine;
+    /// @brief applied after the built-in rules.
+    std::vector<JPatchRule> patchRules;
+    /// @brief the roots of the paths relocated inside the SDK. Empty: not set ("/usr" by default).
+    std::vector<std::string> sdkRewriteRoots;
+    /// @brief rewrite the .cbp files patched for another SDK to the SDK of the project,
+    /// without running cmake again (they are left unchanged otherwise).
+    bool retargetSdk = false;
+    /// @brief also relocate the paths of the compile_commands.json of the build directory inside the SDK
+    /// and add the extraAddDirectory and the gccClangFixes to every command.
+    bool patchCompileCommands = false;
+    /// @brief generate the .cbp from the codemodel of the cmake File API instead of the "CodeBlocks" extra
+    /// generator, so any generator (e.g. Ninja) can be used. The generated .cbp is then patched like the others.
+    bool fileApi = false;
+    /// @brief if set, the stdout and stderr of the command are captured through pipes: they are forwarded to the
+    /// terminal and written with the time of every line in a log of the invocation in this directory.
+    /// The command does not see a terminal then (e.g. no colors).
+    std::string captureLogDir;
+    /// @brief size limit in MB of the cache of the patched .cbp files. 0: not set (no cache).
+    int patchCacheSizeMB = 0;
+    /// @brief the cache directory. Empty: $XDG_CACHE_HOME/xcmake or ~/.cache/xcmake.
+    std::string patchCacheDir;
 };
 
 struct JProject : public JSharedConfig {
@@ -43,11 +87,59 @@ bool selectProject(const JConfig &in, const std::string &projectOrBuildDir, JPro
 /// @brief will check if the build directories actually exist in the file system when updating.
 bool updateProject(const std::string &projectDir, const std::string &buildDir, JConfig &inOut);
 
+/// @brief the arguments and the environment of a command.
+/// The values are views of null terminated strings, so argv and environ are used without copying them:
+/// the strings viewed must outlive the CmdLineArgs. The values set with setArg and setEnv are stored in an
+/// overlay shared by the copies of the CmdLineArgs.
 struct CmdLineArgs {
-    std::vector<std::string> args;
-    std::vector<std::string> env;
+    std::vector<std::string_view> args;
+    std::vector<std::string_view> env;
     std::string home;
     std::string pwd;
+
+    /// @brief replace the argument with a copy of the value.
+    void setArg(size_t index, std::string_view value);
+
+    /// @brief set a "KEY=value" variable: the first variable with the same key is replaced, otherwise it is added.
+    /// The keys are found with a hashed index of env, built by the first call.
+    void setEnv(std::string_view keyValue);
+
+  private:
+    /// @brief copy the value into the overlay.
+    std::string_view store(std::string_view value);
+
+    /// @brief build the index of env if it is not valid anymore.
+    void indexEnv();
+
+    std::shared_ptr<std::deque<std::string>> _overlay;
+    /// @brief open addressing table of the keys of env: the slots hold the index in env + 1 (0: empty).
+    /// It is valid while env is not changed by other means than setEnv.
+    std::vector<uint32_t> _envIndex;
+    const std::string_view *_indexedData = nullptr;
+    size_t _indexedSize = 0;
+};
+
+/// @brief the exit status of the wrapped command and the resources it used, as reported by wait4.
+struct ChildUsage {
+    /// @brief the status of the wait, -1 if the command was not waited for.
+    int status = -1;
+    /// @brief the exit code if the command exited, -1 otherwise.
+    int exitCode = -1;
+    /// @brief the signal that terminated the command, 0 if it exited.
+    int termSignal = 0;
+    /// @brief from the spawn to the end of the wait.
+    double wallSeconds = 0;
+    double userSeconds = 0;
+    double systemSeconds = 0;
+    /// @brief the largest resident set of the command and of its waited descendants.
+    int64_t maxRssKB = 0;
+    int64_t majorFaults = 0;
+    int64_t minorFaults = 0;
+    int64_t voluntarySwitches = 0;
+    int64_t involuntarySwitches = 0;
+    /// @brief the blocks read and written by the file systems.
+    int64_t blockInputs = 0;
+    int64_t blockOutputs = 0;
 };
 
 struct ExecutionPlan {
@@ -61,12 +153,28 @@ struct ExecutionPlan {
     std::string sdkDir;
     std::vector<std::string> extraAddDirectory;
     std::set<std::string> gccClangFixes;
+    int patchWorkers = 0;
+    std::string patchEngine;
+    std::vector<JPatchRule> patchRules;
+    std::vector<std::string> sdkRewriteRoots;
+    bool retargetSdk = false;
+    bool patchCompileCommands = false;
+    bool fileApi = false;
+    std::string captureLogDir;
+    /// @brief the log written by the capture of this invocation.
+    std::string captureLogPath;
+    int patchCacheSizeMB = 0;
+    std::string patchCacheDir;
+
+    /// @brief filled by the run of the command.
+    ChildUsage childUsage;
 
     std::vector<std::string> output;
     std::vector<std::string> log;
 };
 
 std::ostream &operator<<(std::ostream &os, const CmdLineArgs &in);
+std::ostream &operator<<(std::ostream &os, const ChildUsage &in);
 std::ostream &operator<<(std::ostream &os, const ExecutionPlan &in);
 
 std::string serialize(const ExecutionPlan &in);
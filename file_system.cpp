@@ -4,6 +4,11 @@
 #include <fstream>
 #include <memory>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
 #ifdef _WIN32
 #include <io.h>
 #define access _access_s
@@ -188,7 +193,7 @@ class Directory {
 
 // ==== helpers ====
 
-inline void sumBSandS(const std::string &path, int &nBS, int &nS) {
+inline void sumBSandS(std::string_view path, int &nBS, int &nS) {
     for (char c : path) {
         if (c == '\\') {
             nBS++;
@@ -198,6 +203,56 @@ inline void sumBSandS(const std::string &path, int &nBS, int &nS) {
     }
 }
 
+/// @brief called with the path of the temp file. Return false to discard the temp file.
+using OnWriteTempFile = std::function<bool(const std::string &)>;
+
+/// @brief write the temp file and rename it to the filePath.
+inline bool replaceWithTempFile(const std::string &filePath, const OnWriteTempFile &writeTempFile) {
+    auto getTempFilePath = [](const std::string &filePath_) {
+        std::string fpTmp_;
+        for (int i = 0; i < 3; i++) {
+            fpTmp_ = filePath_ + std::to_string(10000 + (std::rand() % 100000));
+            if (!pathExists(fpTmp_)) {
+                break;
+            }
+
+            fpTmp_ = "";
+        }
+        return fpTmp_;
+    };
+
+    int r = -1;
+    for (;;) {
+        std::string filePathTmp = getTempFilePath(filePath);
+        if (filePathTmp.empty()) {
+            break;
+        }
+
+        if (!writeTempFile(filePathTmp)) {
+            std::remove(filePathTmp.c_str());
+            break;
+        }
+
+        r = 0;
+        std::string filePathTmpOld;
+        if (pathExists(filePath)) {
+            filePathTmpOld = getTempFilePath(filePath);
+            r = std::rename(filePath.c_str(), filePathTmpOld.c_str());
+            if (r != 0) {
+                break;
+            }
+        }
+
+        r = std::rename(filePathTmp.c_str(), filePath.c_str());
+
+        if (!filePathTmpOld.empty()) {
+            std::remove(filePathTmpOld.c_str());
+        }
+        break;
+    }
+    return (r == 0);
+}
+
 // ==== public ====
 
 void findInDirectory(const std::string &rootPath, OnChildEntry onChildEntry, const DirectorySearch &filter) {
@@ -229,51 +284,128 @@ bool readFile(const std::string &inFile, std::string &outBytes) {
 }
 
 bool writeFile(const std::string &filePath, const std::string &inBytes) {
-    auto getTempFilePath = [](const std::string &filePath_) {
-        std::string fpTmp_;
-        for (int i = 0; i < 3; i++) {
-            fpTmp_ = filePath_ + std::to_string(10000 + (std::rand() % 100000));
-            if (!pathExists(fpTmp_)) {
-                break;
-            }
-
-            fpTmp_ = "";
-        }
-        return fpTmp_;
-    };
-
-    int r = -1;
-    for (;;) {
-        std::string filePathTmp = getTempFilePath(filePath);
-        if (filePathTmp.empty()) {
-            break;
-        }
+    return writeFile(filePath, [&inBytes](std::ostream &file) {
+        file.write(inBytes.c_str(), inBytes.size());
+        return true;
+    });
+}
 
+bool writeFile(const std::string &filePath, const OnWriteFile &writer) {
+    return replaceWithTempFile(filePath, [&writer](const std::string &filePathTmp) {
         std::ofstream file(filePathTmp, std::ifstream::out | std::ifstream::binary);
         if (!file) {
-            break;
+            return false;
         }
-        file.write(inBytes.c_str(), inBytes.size());
+        bool keep = writer(file);
         file.close();
+        return keep && static_cast<bool>(file);
+    });
+}
 
-        int r = 0;
-        std::string filePathTmpOld;
-        if (pathExists(filePath)) {
-            filePathTmpOld = getTempFilePath(filePath);
-            r = std::rename(filePath.c_str(), filePathTmpOld.c_str());
-            if (r != 0) {
-                break;
-            }
+bool writeFileHandle(const std::string &filePath, const OnWriteFileHandle &writer) {
+    return replaceWithTempFile(filePath, [&writer](const std::string &filePathTmp) {
+        FILE *file = fopen(filePathTmp.c_str(), "wb");
+        if (file == nullptr) {
+            return false;
         }
+        // The writer sees the buffered handle, the bytes are copied once from its buffer to the file.
+        std::unique_ptr<char[]> buffer(new char[WRITE_BUFFER_SIZE]);
+        setvbuf(file, buffer.get(), _IOFBF, WRITE_BUFFER_SIZE);
+        bool keep = writer(file);
+        bool ok = (ferror(file) == 0);
+        ok = (fclose(file) == 0) && ok;
+        return keep && ok;
+    });
+}
 
-        r = std::rename(filePathTmp.c_str(), filePath.c_str());
+bool getFileStat(const std::string &path, FileStat &out) {
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) != 0) {
+        return false;
+    }
 
-        if (!filePathTmpOld.empty()) {
-            std::remove(filePathTmpOld.c_str());
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.inode = static_cast<uint64_t>(st.st_ino);
+#if defined(__APPLE__)
+    out.mtimeNs = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    out.mtimeNs = static_cast<int64_t>(st.st_mtime) * 1000000000;
+#else
+    out.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+    return true;
+}
+
+bool operator==(const FileStat &lhs, const FileStat &rhs) {
+    return lhs.size == rhs.size && lhs.mtimeNs == rhs.mtimeNs && lhs.inode == rhs.inode;
+}
+
+bool operator!=(const FileStat &lhs, const FileStat &rhs) { return !(lhs == rhs); }
+
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string &filePath) {
+    close();
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = false;
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+        _size = static_cast<size_t>(st.st_size);
+        if (_size == 0) {
+            // An empty file cannot be mapped
+            _data = "";
+            ok = true;
+        } else {
+            void *p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                madvise(p, _size, MADV_SEQUENTIAL);
+                _data = static_cast<const char *>(p);
+                _mapped = true;
+                ok = true;
+            }
         }
-        break;
     }
-    return (r == 0);
+    ::close(fd);
+
+    if (!ok) {
+        _data = nullptr;
+        _size = 0;
+    }
+    return ok;
+}
+
+void MappedFile::close() {
+    if (_mapped) {
+        munmap(const_cast<char *>(_data), _size);
+    }
+    _data = nullptr;
+    _size = 0;
+    _mapped = false;
+}
+
+uint64_t hashBytes(const char *data, size_t size, uint64_t seed) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL ^ seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string toHex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; i--) {
+        hex[static_cast<size_t>(i)] = digits[value & 0xF];
+        value >>= 4;
+    }
+    return hex;
 }
 
 bool pathExists(const std::string &path) {
@@ -284,6 +416,24 @@ bool pathExists(const std::string &path) {
     return exists;
 }
 
+bool createDirectories(const std::string &path) {
+    if (path.empty()) {
+        return false;
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        return S_ISDIR(st.st_mode);
+    }
+
+    std::string parent = getParent(path);
+    if (!parent.empty() && parent != path && !createDirectories(parent)) {
+        return false;
+    }
+    // Another process may have created it in the meantime.
+    return (mkdir(path.c_str(), S_IRWXU) == 0) || (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+}
+
 const char *getFileExtension(const char *filePath) {
     if (filePath == nullptr) {
         return nullptr;
@@ -407,7 +557,13 @@ std::string getParent(const std::string &path) {
 }
 
 std::string combine(const std::string &a, const std::string &b) {
-    std::string r(a);
+    std::string r;
+    combine(a, b, r);
+    return r;
+}
+
+void combine(std::string_view a, std::string_view b, std::string &out) {
+    out.assign(a.data(), a.size());
 
     size_t n = a.size();
     size_t m = b.size();
@@ -416,25 +572,29 @@ std::string combine(const std::string &a, const std::string &b) {
         bool aPS = isPathSeparator(a.back());
         bool bPS = isPathSeparator(b.front());
         if (aPS && bPS) {
-            r += b.substr(1);
+            out.append(b.data() + 1, m - 1);
         } else if (!aPS && !bPS) {
             int nBS = 0, nS = 0;
             sumBSandS(a, nBS, nS);
             sumBSandS(b, nBS, nS);
-            r += (nBS > 0) ? '\\' : '/';
-            r += b;
+            out += (nBS > 0) ? '\\' : '/';
+            out.append(b.data(), m);
         } else {
-            r += b;
+            out.append(b.data(), m);
         }
     } else {
-        r += b;
+        out.append(b.data(), m);
     }
-
-    return r;
 }
 
 std::vector<std::string> splitPath(const std::string &path) {
-    std::vector<std::string> parts;
+    std::vector<std::string_view> views;
+    splitPath(path, views);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+void splitPath(std::string_view path, std::vector<std::string_view> &outParts) {
+    outParts.clear();
     size_t start = 0;
     size_t end = 0;
 
@@ -453,7 +613,7 @@ std::vector<std::string> splitPath(const std::string &path) {
         if (isPathSeparator(path[i])) {
             end = i;
             if (start < end) {
-                parts.push_back(path.substr(start, end - start));
+                outParts.push_back(path.substr(start, end - start));
 
                 size_t j = i + 1;
                 for (; j < n; j++) {
@@ -469,9 +629,8 @@ std::vector<std::string> splitPath(const std::string &path) {
     }
 
     if (start >= end && start + 1 < n) {
-        parts.push_back(path.substr(start));
+        outParts.push_back(path.substr(start));
     }
-    return parts;
 }
 
 bool getRelativePath(const std::string &fromDirPath, const std::string &toDirPath, std::string &out) {
@@ -528,59 +687,63 @@ bool getRelativePath(const std::string &fromDirPath, const std::string &toDirPat
     return ok;
 }
 
-bool getSimplePath(const std::string &path, std::string &out) {
-    bool ok = false;
-    std::string result;
-
+bool getSimplePath(std::string_view path, std::string &out) {
     int nBS = 0;
     int nS = 0;
     sumBSandS(path, nBS, nS);
-    if ((nBS == 0 && nS != 0) || (nBS != 0 && nS == 0)) {
-        const char separator = (nBS > 0) ? '\\' : '/';
-        const bool isAbs = isAbsolutePath(path);
-        const size_t nFixed = isAbs && (path[0] != separator) ? 1 : 0;
-        std::vector<std::string> parts = splitPath(path);
-        std::deque<size_t> normalIndexes;
-
-        for (size_t i = 0; i < parts.size(); i++) {
-            if (parts[i] == ".") {
-                parts.erase(parts.begin() + i);
-                i--;
-            } else if (parts[i] == "..") {
-                if (normalIndexes.size() > nFixed) {
-                    parts.erase(parts.begin() + i);
-                    parts.erase(parts.begin() + normalIndexes.back());
-                    normalIndexes.pop_back();
-                    i -= 2;
-                } else if (isAbs) {
-                    parts.erase(parts.begin() + i);
-                    i--;
-                }
-            } else {
-                normalIndexes.push_back(i);
-            }
-        }
+    if (!((nBS == 0 && nS != 0) || (nBS != 0 && nS == 0))) {
+        return false;
+    }
 
-        size_t n = parts.size();
-        if (n > 0) {
-            if (isAbs && nFixed == 0) {
-                result += separator;
-            }
-            result += parts[0];
+    // The buffers of the thread are reused, the path can be a view of out.
+    thread_local std::vector<std::string_view> parts;
+    thread_local std::vector<std::string_view> simpleParts;
+    thread_local std::string result;
 
-            for (size_t i = 1; i < n; i++) {
-                result += separator;
-                result += parts[i];
+    const char separator = (nBS > 0) ? '\\' : '/';
+    const bool isAbs = isAbsolutePath(path);
+    const size_t nFixed = isAbs && (path[0] != separator) ? 1 : 0;
+    splitPath(path, parts);
+
+    // ".." removes the last normal part, the ".." that cannot remove a part are kept in relative paths.
+    simpleParts.clear();
+    size_t nNormal = 0;
+    for (std::string_view part : parts) {
+        if (part == ".") {
+            continue;
+        }
+        if (part == "..") {
+            if (nNormal > nFixed) {
+                simpleParts.pop_back();
+                nNormal--;
+            } else if (!isAbs) {
+                simpleParts.push_back(part);
             }
+        } else {
+            simpleParts.push_back(part);
+            nNormal++;
+        }
+    }
+
+    result.clear();
+    size_t n = simpleParts.size();
+    if (n > 0) {
+        if (isAbs && nFixed == 0) {
+            result += separator;
         }
+        result.append(simpleParts[0].data(), simpleParts[0].size());
 
-        out = result;
-        ok = true;
+        for (size_t i = 1; i < n; i++) {
+            result += separator;
+            result.append(simpleParts[i].data(), simpleParts[i].size());
+        }
     }
-    return ok;
+
+    out.assign(result);
+    return true;
 }
 
-bool isAbsolutePath(const std::string &path) {
+bool isAbsolutePath(std::string_view path) {
     size_t n = path.size();
     if (n == 0) {
         return false;
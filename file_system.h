@@ -1,8 +1,12 @@
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <functional>
+#include <ostream>
 #include <set>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace ga {
@@ -42,9 +46,69 @@ bool readFile(const std::string &inFile, std::string &outBytes);
 /// @brief write the bytes to a file in an atomic way (by writing to a temp file and doing a rename).
 bool writeFile(const std::string &filePath, const std::string &inBytes);
 
+/// @brief called with the stream of the temp file. Return false to discard the temp file.
+using OnWriteFile = std::function<bool(std::ostream &)>;
+
+/// @brief write a file in an atomic way, the content is streamed by the writer into the temp file.
+/// The file is replaced only if the writer returns true.
+bool writeFile(const std::string &filePath, const OnWriteFile &writer);
+
+/// @brief the size of the buffer of the handle given to an OnWriteFileHandle.
+const size_t WRITE_BUFFER_SIZE = 256 * 1024;
+
+/// @brief called with the handle of the temp file. Return false to discard the temp file.
+using OnWriteFileHandle = std::function<bool(FILE *)>;
+
+/// @brief write a file in an atomic way, the writer writes into the buffered handle of the temp file.
+/// The file is replaced only if the writer returns true.
+bool writeFileHandle(const std::string &filePath, const OnWriteFileHandle &writer);
+
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtimeNs = 0;
+    uint64_t inode = 0;
+};
+
+bool operator==(const FileStat &lhs, const FileStat &rhs);
+bool operator!=(const FileStat &lhs, const FileStat &rhs);
+
+/// @brief get the size, modification time and inode of a file without opening it.
+bool getFileStat(const std::string &path, FileStat &out);
+
+/// @brief a file mapped read-only in memory.
+class MappedFile {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &filePath);
+    void close();
+
+    const char *data() const { return _data; }
+    size_t size() const { return _size; }
+
+  private:
+    const char *_data = nullptr;
+    size_t _size = 0;
+    bool _mapped = false;
+};
+
+/// @brief 64 bit FNV-1a hash of the bytes.
+uint64_t hashBytes(const char *data, size_t size, uint64_t seed = 0);
+
+/// @brief format the value as 16 lowercase hex digits.
+std::string toHex(uint64_t value);
+
 /// @brief returs true if the path exists (but does not check for read or write permissions on the file or dir).
 bool pathExists(const std::string &path);
 
+/// @brief create the directory and its missing parents.
+/// @return true if the directory exists at the end.
+bool createDirectories(const std::string &path);
+
 const char *getFileExtension(const char *filePath);
 
 std::string getFileExtension(const std::string &filePath);
@@ -55,13 +119,19 @@ std::string getParent(const std::string &path);
 
 std::string combine(const std::string &a, const std::string &b);
 
+/// @brief combine into out, which keeps its capacity (out must not be viewed by a or b).
+void combine(std::string_view a, std::string_view b, std::string &out);
+
 std::vector<std::string> splitPath(const std::string &path);
 
+/// @brief split without copying the parts, they are views of the path.
+void splitPath(std::string_view path, std::vector<std::string_view> &outParts);
+
 bool getRelativePath(const std::string &fromDirPath, const std::string &toDirPath, std::string &out);
 
-bool getSimplePath(const std::string &path, std::string &out);
+bool getSimplePath(std::string_view path, std::string &out);
 
-bool isAbsolutePath(const std::string &path);
+bool isAbsolutePath(std::string_view path);
 
 bool isPathSeparator(char value);
 
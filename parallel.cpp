@@ -0,0 +1,119 @@
+#include "parallel.h"
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace ga {
+
+namespace detail {
+
+class TaskDeque {
+  public:
+    void push(size_t taskIndex) { _tasks.push_back(taskIndex); }
+
+    /// @brief the owner takes the tasks from the front.
+    bool popFront(size_t &outTaskIndex) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_tasks.empty()) {
+            return false;
+        }
+        outTaskIndex = _tasks.front();
+        _tasks.pop_front();
+        return true;
+    }
+
+    /// @brief other workers steal from the back.
+    bool stealBack(size_t &outTaskIndex) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_tasks.empty()) {
+            return false;
+        }
+        outTaskIndex = _tasks.back();
+        _tasks.pop_back();
+        return true;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::deque<size_t> _tasks;
+};
+
+} // namespace detail
+
+size_t getDefaultWorkerCount() {
+    size_t n = std::thread::hardware_concurrency();
+    return (n > 0) ? n : 1;
+}
+
+void parallelFor(size_t taskCount, size_t workerCount, const OnParallelTask &onTask) {
+    if (workerCount > taskCount) {
+        workerCount = taskCount;
+    }
+    if (workerCount <= 1) {
+        for (size_t i = 0; i < taskCount; i++) {
+            onTask(0, i);
+        }
+        return;
+    }
+
+    std::vector<std::unique_ptr<detail::TaskDeque>> deques;
+    for (size_t w = 0; w < workerCount; w++) {
+        deques.emplace_back(new detail::TaskDeque());
+    }
+    // Round robin, so that neighbouring tasks (usually of similar size) end up on different workers.
+    for (size_t i = 0; i < taskCount; i++) {
+        deques[i % workerCount]->push(i);
+    }
+
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    auto work = [&](size_t workerIndex) {
+        for (;;) {
+            size_t taskIndex = 0;
+            bool found = deques[workerIndex]->popFront(taskIndex);
+            for (size_t d = 1; !found && d < workerCount; d++) {
+                found = deques[(workerIndex + d) % workerCount]->stealBack(taskIndex);
+            }
+            if (!found) {
+                // No task is created while running, so empty deques mean that we are done.
+                break;
+            }
+
+            try {
+                onTask(workerIndex, taskIndex);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workerCount - 1);
+    try {
+        for (size_t w = 1; w < workerCount; w++) {
+            threads.emplace_back(work, w);
+        }
+    } catch (const std::system_error &) {
+        // The deques of the missing workers are emptied by stealing
+    }
+    // The calling thread is also a worker.
+    work(0);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace ga
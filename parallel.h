@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace ga {
+
+/// @brief called with the index of the worker running the task and the index of the task.
+using OnParallelTask = std::function<void(size_t workerIndex, size_t taskIndex)>;
+
+/// @brief get the number of workers to use when the configured value is -1 (hardware concurrency, at least 1).
+size_t getDefaultWorkerCount();
+
+/// @brief run the tasks [0, taskCount) on workerCount threads and wait for all of them to finish.
+/// Every worker owns a deque of tasks. Idle workers steal from the back of the other deques,
+/// so a single slow task does not keep the remaining tasks of its worker waiting.
+/// If workerCount <= 1 the tasks are executed in order on the calling thread.
+/// If a thread cannot be created, the tasks run on the workers already started.
+/// The first exception thrown by a task is rethrown after all the workers finished.
+void parallelFor(size_t taskCount, size_t workerCount, const OnParallelTask &onTask);
+
+} // namespace ga
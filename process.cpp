@@ -0,0 +1,297 @@
+#include "process.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+namespace ga {
+
+int spawnProcess(const char *file, const char *const *argv, const char *const *envp, pid_t &outPid, int outFd,
+                 int errFd) {
+    outPid = -1;
+    if (outFd < 0 && errFd < 0) {
+        return posix_spawnp(&outPid, file, nullptr, nullptr, const_cast<char *const *>(argv),
+                            const_cast<char *const *>(envp));
+    }
+
+    posix_spawn_file_actions_t fileActions;
+    int r = posix_spawn_file_actions_init(&fileActions);
+    if (r != 0) {
+        return r;
+    }
+    // The other descriptors of the pipes are closed on exec
+    if (outFd >= 0) {
+        r = posix_spawn_file_actions_adddup2(&fileActions, outFd, STDOUT_FILENO);
+    }
+    if (r == 0 && errFd >= 0) {
+        r = posix_spawn_file_actions_adddup2(&fileActions, errFd, STDERR_FILENO);
+    }
+    if (r == 0) {
+        r = posix_spawnp(&outPid, file, &fileActions, nullptr, const_cast<char *const *>(argv),
+                         const_cast<char *const *>(envp));
+    }
+    posix_spawn_file_actions_destroy(&fileActions);
+    return r;
+}
+
+bool waitProcess(pid_t pid, int &outStatus) {
+    outStatus = 0;
+    pid_t r = -1;
+    do {
+        r = waitpid(pid, &outStatus, 0);
+    } while (r == -1 && errno == EINTR);
+    return r == pid;
+}
+
+bool waitProcess(pid_t pid, int &outStatus, rusage &outUsage) {
+    outStatus = 0;
+    outUsage = rusage();
+    pid_t r = -1;
+    do {
+        r = wait4(pid, &outStatus, 0, &outUsage);
+    } while (r == -1 && errno == EINTR);
+    return r == pid;
+}
+
+uint64_t getMonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/// @brief write all the bytes, the writes interrupted by a signal are restarted.
+inline bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t w = write(fd, data, size);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += w;
+        size -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+/// @brief read exactly size bytes (they are known to be in the pipe).
+inline bool readAll(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t r = read(fd, data, size);
+        if (r <= 0) {
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += r;
+        size -= static_cast<size_t>(r);
+    }
+    return true;
+}
+
+OutputCapture::~OutputCapture() {
+    for (Stream &stream : _streams) {
+        closeStream(stream);
+    }
+}
+
+void OutputCapture::closeStream(Stream &stream) {
+    for (int i = 0; i < 2; i++) {
+        closeFd(stream.pipe[i]);
+        closeFd(stream.teePipe[i]);
+    }
+    stream.open = false;
+}
+
+void OutputCapture::closeFd(int &fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool OutputCapture::open() {
+    for (Stream &stream : _streams) {
+        if (pipe2(stream.pipe, O_CLOEXEC) != 0) {
+            return false;
+        }
+        // Without the tee pipe the bytes are read and written
+        if (pipe2(stream.teePipe, O_CLOEXEC) != 0) {
+            stream.zeroCopy = false;
+        }
+    }
+    return true;
+}
+
+bool OutputCapture::forward(int outFd, int errFd, const OnCapturedLine &onLine) {
+    _streams[0].destFd = outFd;
+    _streams[1].destFd = errFd;
+    _destFailed = false;
+    for (Stream &stream : _streams) {
+        closeFd(stream.pipe[1]);
+        stream.open = stream.pipe[0] >= 0;
+    }
+
+    bool ok = true;
+    for (;;) {
+        pollfd fds[2];
+        int streamIndices[2];
+        nfds_t nfds = 0;
+        for (int i = 0; i < 2; i++) {
+            if (_streams[i].open) {
+                fds[nfds].fd = _streams[i].pipe[0];
+                fds[nfds].events = POLLIN;
+                fds[nfds].revents = 0;
+                streamIndices[nfds] = i;
+                nfds++;
+            }
+        }
+        if (nfds == 0) {
+            break;
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = false;
+            for (Stream &stream : _streams) {
+                closeStream(stream);
+            }
+            break;
+        }
+        for (nfds_t f = 0; f < nfds; f++) {
+            if (fds[f].revents != 0) {
+                Stream &stream = _streams[streamIndices[f]];
+                if (!forwardAvailable(stream, streamIndices[f] + 1, onLine)) {
+                    ok = false;
+                    closeStream(stream);
+                }
+            }
+        }
+    }
+
+    // The last lines without a line feed
+    for (int i = 0; i < 2; i++) {
+        Stream &stream = _streams[i];
+        if (!stream.pending.empty() && onLine) {
+            onLine(CapturedLine{i + 1, stream.pendingTimeNs, stream.pending});
+        }
+        stream.pending.clear();
+    }
+    return ok && !_destFailed;
+}
+
+bool OutputCapture::forwardAvailable(Stream &stream, int streamIndex, const OnCapturedLine &onLine) {
+    if (stream.zeroCopy && stream.destFd >= 0) {
+        ssize_t n = 0;
+        if (onLine) {
+            // The copy for the lines, the bytes stay in the pipe of the child
+            n = tee(stream.pipe[0], stream.teePipe[1], sizeof(_buffer), SPLICE_F_NONBLOCK);
+        } else {
+            n = splice(stream.pipe[0], nullptr, stream.destFd, nullptr, sizeof(_buffer), SPLICE_F_MOVE);
+            if (n > 0) {
+                splicedBytes += static_cast<uint64_t>(n);
+                return true;
+            }
+        }
+        if (n == 0) {
+            closeStream(stream);
+            return true;
+        }
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                return true;
+            }
+            stream.zeroCopy = false;
+            return forwardAvailable(stream, streamIndex, onLine);
+        }
+
+        size_t remaining = static_cast<size_t>(n);
+        while (remaining > 0 && stream.zeroCopy) {
+            ssize_t s = splice(stream.pipe[0], nullptr, stream.destFd, nullptr, remaining, SPLICE_F_MOVE);
+            if (s < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                stream.zeroCopy = false;
+                break;
+            }
+            splicedBytes += static_cast<uint64_t>(s);
+            remaining -= static_cast<size_t>(s);
+        }
+        if (remaining > 0) {
+            // The destination does not support splice: the rest of the bytes of the tee are read and written
+            if (!readAll(stream.pipe[0], _buffer, remaining)) {
+                return false;
+            }
+            writeToDest(stream, _buffer, remaining);
+        }
+
+        if (!readAll(stream.teePipe[0], _buffer, static_cast<size_t>(n))) {
+            return false;
+        }
+        addBytes(stream, streamIndex, _buffer, static_cast<size_t>(n), onLine);
+        return true;
+    }
+
+    ssize_t r = read(stream.pipe[0], _buffer, sizeof(_buffer));
+    if (r == 0) {
+        closeStream(stream);
+        return true;
+    }
+    if (r < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    writeToDest(stream, _buffer, static_cast<size_t>(r));
+    if (onLine) {
+        addBytes(stream, streamIndex, _buffer, static_cast<size_t>(r), onLine);
+    }
+    return true;
+}
+
+void OutputCapture::writeToDest(Stream &stream, const char *data, size_t size) {
+    if (stream.destFd < 0) {
+        return;
+    }
+    if (!writeAll(stream.destFd, data, size)) {
+        stream.destFd = -1;
+        _destFailed = true;
+        return;
+    }
+    copiedBytes += size;
+}
+
+void OutputCapture::addBytes(Stream &stream, int streamIndex, const char *data, size_t size,
+                             const OnCapturedLine &onLine) {
+    // The lines of a read share its time
+    uint64_t timeNs = getMonotonicNs();
+    const char *end = data + size;
+    while (data < end) {
+        const char *lineFeed = static_cast<const char *>(std::memchr(data, '\n', static_cast<size_t>(end - data)));
+        if (lineFeed == nullptr) {
+            if (stream.pending.empty()) {
+                stream.pendingTimeNs = timeNs;
+            }
+            stream.pending.append(data, static_cast<size_t>(end - data));
+            break;
+        }
+        if (stream.pending.empty()) {
+            onLine(CapturedLine{streamIndex, timeNs, std::string_view(data, static_cast<size_t>(lineFeed - data))});
+        } else {
+            stream.pending.append(data, static_cast<size_t>(lineFeed - data));
+            onLine(CapturedLine{streamIndex, stream.pendingTimeNs, stream.pending});
+            stream.pending.clear();
+        }
+        data = lineFeed + 1;
+    }
+}
+
+} // namespace ga
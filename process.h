@@ -0,0 +1,109 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace ga {
+
+/// @brief start the program in a new process, the program is searched in the PATH like execvpe does.
+/// posix_spawnp does not copy the page tables of the parent (glibc starts the child with
+/// clone(CLONE_VM | CLONE_VFORK) and the parent is suspended only until the exec), so the cost of the launch
+/// does not depend on the memory of the parent. argv and envp must be ready before the call.
+/// @param outFd, errFd if set, the stdout and stderr of the child (e.g. the write ends of an OutputCapture).
+/// @return 0 and the pid of the child, or the error number (e.g. ENOENT if the program is not found).
+int spawnProcess(const char *file, const char *const *argv, const char *const *envp, pid_t &outPid, int outFd = -1,
+                 int errFd = -1);
+
+/// @brief wait until the child exits (the waits interrupted by a signal are restarted).
+/// @return false if the child cannot be waited for.
+bool waitProcess(pid_t pid, int &outStatus);
+
+/// @brief wait until the child exits and collect the resources it used (wait4).
+/// @return false if the child cannot be waited for.
+bool waitProcess(pid_t pid, int &outStatus, rusage &outUsage);
+
+/// @brief the nanoseconds of the monotonic clock.
+uint64_t getMonotonicNs();
+
+/// @brief a line written by the child, without the line feed.
+struct CapturedLine {
+    /// @brief 1: stdout, 2: stderr.
+    int stream;
+    /// @brief the monotonic time when the first bytes of the line were read.
+    uint64_t timeNs;
+    std::string_view text;
+};
+
+using OnCapturedLine = std::function<void(const CapturedLine &)>;
+
+/// @brief capture the stdout and stderr of a child through pipes and forward them to other file descriptors.
+/// The bytes are moved to the destination with splice and duplicated for the lines with tee, so the forwarded
+/// output is not copied through user space. If the destination does not support splice (e.g. a terminal on
+/// recent kernels) the bytes are read once and written to the destination.
+class OutputCapture {
+  public:
+    OutputCapture() = default;
+    OutputCapture(const OutputCapture &) = delete;
+    OutputCapture &operator=(const OutputCapture &) = delete;
+    ~OutputCapture();
+
+    /// @brief create the pipes. @return false if a pipe cannot be created.
+    bool open();
+
+    /// @brief the write ends, given to the child as its stdout and stderr (see spawnProcess).
+    int getChildOut() const { return _streams[0].pipe[1]; }
+    int getChildErr() const { return _streams[1].pipe[1]; }
+
+    /// @brief forward the output of the child until it closes both pipes, the lines are given to onLine.
+    /// The write ends of the parent are closed first, so the pipes are closed when the child exits.
+    /// If a destination cannot be written, the output of its stream is still read for the lines (the child never
+    /// blocks on a full pipe). If a pipe cannot be read or polled, it is closed at once.
+    /// @return false if the output cannot be read or forwarded.
+    bool forward(int outFd, int errFd, const OnCapturedLine &onLine);
+
+    /// @brief the number of bytes forwarded with splice and with read/write.
+    uint64_t splicedBytes = 0;
+    uint64_t copiedBytes = 0;
+
+  private:
+    struct Stream {
+        /// @brief the pipe of the child.
+        int pipe[2] = {-1, -1};
+        /// @brief the pipe that receives the copy made by tee, read for the lines.
+        int teePipe[2] = {-1, -1};
+        /// @brief -1 once a write failed: the bytes are read and dropped.
+        int destFd = -1;
+        /// @brief false once tee or splice failed: the bytes are read and written.
+        bool zeroCopy = true;
+        bool open = false;
+        /// @brief the incomplete last line and the time of its first bytes.
+        std::string pending;
+        uint64_t pendingTimeNs = 0;
+    };
+
+    /// @brief move the available bytes of the stream. @return false if the pipe cannot be read.
+    bool forwardAvailable(Stream &stream, int streamIndex, const OnCapturedLine &onLine);
+
+    /// @brief write the bytes read from the stream, the destination is dropped on failure.
+    void writeToDest(Stream &stream, const char *data, size_t size);
+
+    /// @brief close the pipes of the stream, the child gets EPIPE instead of blocking on a full pipe.
+    static void closeStream(Stream &stream);
+
+    /// @brief split the bytes read for the stream into lines.
+    void addBytes(Stream &stream, int streamIndex, const char *data, size_t size, const OnCapturedLine &onLine);
+
+    static void closeFd(int &fd);
+
+    Stream _streams[2];
+    /// @brief a destination could not be written during forward.
+    bool _destFailed = false;
+    char _buffer[64 * 1024];
+};
+
+} // namespace ga
@@ -1,9 +1,16 @@
 #include <CMaker.h>
+#include <CbpFileApi.h>
+#include <CbpManifest.h>
+#include <CbpStreamPatcher.h>
+#include <CompileCommandsPatcher.h>
 
 #include <Config.h>
 #include <file_system.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <csignal>
+
 namespace gatools {
 
 static std::string g_xcmakeJson;
@@ -54,6 +61,18 @@ void CMakerTests::createTestDir() {
     mkdir(_buildDir.c_str(), S_IRWXU);
 
     remove(_cbpFilePath.c_str());
+    remove(ga::combine(_buildDir, CbpManifest::FILENAME).c_str());
+}
+
+/// @brief the expected .cbp for another SDK of the test project.
+static std::string getExpectedCbp(const std::string &sdkVersion) {
+    std::string expectedCbp = g_expectedCbp;
+    for (std::string_view from : {"sdks/v42", "sdks\\v42"}) {
+        for (size_t idx = expectedCbp.find(from); idx != std::string::npos; idx = expectedCbp.find(from, idx)) {
+            expectedCbp.replace(idx + from.size() - 3, 3, sdkVersion);
+        }
+    }
+    return expectedCbp;
 }
 
 void CMakerTests::createCbpFile() { ga::writeFile("/tmp/xcmake/test/build/proj42.cbp", g_inputCbp); }
@@ -140,6 +159,471 @@ TEST_F(CMakerTests, CMAKE_BASH) {
     }
 }
 
+TEST_F(CMakerTests, ParallelPatch) {
+    createTestDir();
+
+    const size_t nFiles = 12;
+    auto writeCbpFiles = [this, nFiles]() {
+        for (size_t i = 0; i < nFiles; i++) {
+            std::string cbpFilePath = ga::combine(_buildDir, "proj42_" + std::to_string(i) + ".cbp");
+            remove((cbpFilePath + ".bak").c_str());
+            ga::writeFile(cbpFilePath, g_inputCbp);
+        }
+    };
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+
+    std::vector<std::vector<std::string>> patchLogs;
+    const std::vector<std::pair<int, std::string>> patchModes = {{1, ""}, {4, ""}, {4, "stream"}, {4, "dom"}};
+    for (const auto &patchMode : patchModes) {
+        const int patchWorkers = patchMode.first;
+        JConfig config = deserialize(g_xcmakeJson);
+        config.patchWorkers = patchWorkers;
+        config.patchEngine = patchMode.second;
+        ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+        writeCbpFiles();
+
+        ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+        ASSERT_EQ(patchWorkers, cmaker.getExecutionPlan()->patchWorkers);
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        std::vector<std::string> patchLog;
+        for (size_t i = logStart; i < log.size(); i++) {
+            // The counters of the rewrite cache depend on the scheduling, only the default splice engine uses snapshots
+            if (log[i].find(" workers") == std::string::npos && log[i].find("rewrite cache:") == std::string::npos &&
+                log[i].find("subtrees reused:") == std::string::npos) {
+                patchLog.push_back(log[i]);
+            }
+        }
+        patchLogs.push_back(patchLog);
+
+        for (size_t i = 0; i < nFiles; i++) {
+            std::string actualCbp;
+            ga::readFile(ga::combine(_buildDir, "proj42_" + std::to_string(i) + ".cbp"), actualCbp);
+            ASSERT_EQ(g_expectedCbp, actualCbp);
+        }
+    }
+
+    // The log does not depend on the number of workers or on the patch engine
+    ASSERT_EQ(patchLogs[0], patchLogs[1]);
+    ASSERT_EQ(patchLogs[0], patchLogs[2]);
+    ASSERT_EQ(patchLogs[0], patchLogs[3]);
+
+    for (size_t i = 0; i < nFiles; i++) {
+        std::string cbpFilePath = ga::combine(_buildDir, "proj42_" + std::to_string(i) + ".cbp");
+        remove(cbpFilePath.c_str());
+        remove((cbpFilePath + ".bak").c_str());
+        remove((cbpFilePath + CbpSubtreeSnapshot::EXTENSION).c_str());
+    }
+}
+
+TEST_F(CMakerTests, SkipUnchangedCbp) {
+    createTestDir();
+    ga::writeFile(_cbpFilePath, g_inputCbp);
+    remove((_cbpFilePath + ".bak").c_str());
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+
+    auto patch = [this, &cmdLineArgs](std::vector<std::string> &patchLog) {
+        ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        patchLog.assign(log.begin() + logStart, log.end());
+    };
+    auto contains = [](const std::vector<std::string> &patchLog, const std::string &text) {
+        for (const std::string &line : patchLog) {
+            if (line.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<std::string> patchLog;
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, "PatchResult: Changed"));
+    ASSERT_TRUE(ga::pathExists(ga::combine(_buildDir, CbpManifest::FILENAME)));
+
+    // The second run does not open the file
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, "unchanged since the last patch"));
+    ASSERT_FALSE(contains(patchLog, "PatchResult"));
+
+    std::string actualCbp;
+    ga::readFile(_cbpFilePath, actualCbp);
+    ASSERT_EQ(g_expectedCbp, actualCbp);
+
+    // A regenerated file is patched again
+    ga::writeFile(_cbpFilePath, g_inputCbp);
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, "PatchResult: Changed"));
+    ga::readFile(_cbpFilePath, actualCbp);
+    ASSERT_EQ(g_expectedCbp, actualCbp);
+
+    remove(_cbpFilePath.c_str());
+    remove((_cbpFilePath + ".bak").c_str());
+}
+
+TEST_F(CMakerTests, PatchCache) {
+    createTestDir();
+    std::string cacheDir = ga::combine(_tmpDir, "cache");
+    ga::findInDirectory(cacheDir, [](const ga::ChildEntry &entry) { remove(entry.path); });
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+
+    const std::vector<std::string> patchEngines = {"", "stream", "splice", "stream"};
+    for (size_t run = 0; run < patchEngines.size(); run++) {
+        JConfig config = deserialize(g_xcmakeJson);
+        config.patchCacheSizeMB = 1;
+        config.patchCacheDir = cacheDir;
+        config.patchEngine = patchEngines[run];
+        ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+        // cmake regenerated the same .cbp
+        ga::writeFile(_cbpFilePath, g_inputCbp);
+        remove((_cbpFilePath + ".bak").c_str());
+
+        ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+
+        bool cached = false;
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        for (size_t i = logStart; i < log.size(); i++) {
+            cached = cached || (log[i].find("PatchResult: Changed (cached)") != std::string::npos);
+        }
+        // The engine is part of the key, "" is "splice"
+        ASSERT_EQ(run > 1, cached);
+
+        std::string actualCbp;
+        ga::readFile(_cbpFilePath, actualCbp);
+        ASSERT_EQ(g_expectedCbp, actualCbp);
+    }
+
+    remove(_cbpFilePath.c_str());
+    remove((_cbpFilePath + ".bak").c_str());
+}
+
+TEST_F(CMakerTests, IncrementalPatch) {
+    createTestDir();
+    std::string snapshotFile = _cbpFilePath + CbpSubtreeSnapshot::EXTENSION;
+    remove(snapshotFile.c_str());
+    remove(ga::combine(_buildDir, CbpManifest::FILENAME).c_str());
+
+    JConfig config = deserialize(g_xcmakeJson);
+    config.patchEngine = "splice";
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+
+    auto patch = [this, &cmdLineArgs](const std::string &inputCbp, std::string &outCounters) {
+        ga::writeFile(_cbpFilePath, inputCbp);
+        ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        outCounters.clear();
+        for (size_t i = logStart; i < log.size(); i++) {
+            size_t pos = log[i].find("subtrees reused: ");
+            if (pos != std::string::npos) {
+                outCounters = log[i].substr(pos);
+            }
+        }
+    };
+
+    std::string counters;
+    patch(g_inputCbp, counters);
+    ASSERT_EQ("subtrees reused: 0, transformed: 2", counters);
+    ASSERT_TRUE(ga::pathExists(snapshotFile));
+
+    // cmake regenerated the project with one more source file: only the new Unit is transformed
+    const std::string newUnit = "        <Unit filename=\"/tmp/xcmake/test/testproj/main.cpp\"/>\n";
+    std::string inputCbp = g_inputCbp;
+    inputCbp.insert(inputCbp.rfind("    </Project>"), newUnit);
+    patch(inputCbp, counters);
+    ASSERT_EQ("subtrees reused: 2, transformed: 1", counters);
+
+    std::string expectedCbp = g_expectedCbp;
+    expectedCbp.insert(expectedCbp.rfind("    </Project>"), newUnit);
+    std::string actualCbp;
+    ga::readFile(_cbpFilePath, actualCbp);
+    ASSERT_EQ(expectedCbp, actualCbp);
+
+    remove(_cbpFilePath.c_str());
+    remove((_cbpFilePath + ".bak").c_str());
+    remove(snapshotFile.c_str());
+}
+
+TEST_F(CMakerTests, PatchCompileCommands) {
+    createTestDir();
+    ga::writeFile(_cbpFilePath, g_inputCbp);
+    remove((_cbpFilePath + ".bak").c_str());
+    remove(ga::combine(_buildDir, CbpManifest::FILENAME).c_str());
+    std::string compileCommandsPath = ga::combine(_buildDir, COMPILE_COMMANDS_FILENAME);
+    remove((compileCommandsPath + ".bak").c_str());
+    const std::string compileCommands = "[\n{\n  \"directory\": \"" + _buildDir +
+                                        "\",\n  \"command\": \"/usr/bin/c++ -I/usr/include/qt5 -c main.cpp\",\n"
+                                        "  \"file\": \"main.cpp\"\n}\n]\n";
+    ga::writeFile(compileCommandsPath, compileCommands);
+
+    JConfig config = deserialize(g_xcmakeJson);
+    config.patchCompileCommands = true;
+    config.patchWorkers = 2;
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+
+    auto patch = [this, &cmdLineArgs](std::vector<std::string> &patchLog) {
+        ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+        ASSERT_TRUE(cmaker.getExecutionPlan()->patchCompileCommands);
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        patchLog.assign(log.begin() + logStart, log.end());
+    };
+    auto contains = [](const std::vector<std::string> &patchLog, const std::string &text) {
+        for (const std::string &line : patchLog) {
+            if (line.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<std::string> patchLog;
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, compileCommandsPath + " PatchResult: Changed"));
+
+    // The paths are relocated like in the .cbp, the compiler is not changed
+    std::string actual;
+    ga::readFile(compileCommandsPath, actual);
+    ASSERT_NE(std::string::npos, actual.find("\"/usr/bin/c++ -gcc1 -gcc2 -I/extra1 -I/extra2 "
+                                             "-I/tmp/xcmake/test/sdks/v42/usr/include/qt5 -c main.cpp\""));
+    std::string original;
+    ga::readFile(compileCommandsPath + ".bak", original);
+    ASSERT_EQ(compileCommands, original);
+    std::string actualCbp;
+    ga::readFile(_cbpFilePath, actualCbp);
+    ASSERT_EQ(g_expectedCbp, actualCbp);
+
+    // The second run does not open the file
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, compileCommandsPath + " is unchanged since the last patch"));
+
+    remove(_cbpFilePath.c_str());
+    remove((_cbpFilePath + ".bak").c_str());
+    remove(compileCommandsPath.c_str());
+    remove((compileCommandsPath + ".bak").c_str());
+}
+
+TEST_F(CMakerTests, FileApi) {
+    createTestDir();
+    std::string cbpFilePath = ga::combine(_buildDir, "fapi.cbp");
+    std::string replyDir = ga::combine(_buildDir, FILE_API_REPLY_DIR);
+    remove(cbpFilePath.c_str());
+    remove((cbpFilePath + ".bak").c_str());
+    remove(ga::combine(_buildDir, FILE_API_QUERY).c_str());
+
+    JConfig config = deserialize(g_xcmakeJson);
+    config.fileApi = true;
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "-GNinja"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+
+    // The query is written before cmake runs
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_TRUE(cmaker.getExecutionPlan()->fileApi);
+    ASSERT_TRUE(ga::pathExists(ga::combine(_buildDir, FILE_API_QUERY)));
+
+    // The reply cmake writes when it configures
+    ga::createDirectories(replyDir);
+    ga::writeFile(ga::combine(replyDir, "index-2026-01-01T10-00-00-0000.json"),
+                  "{\"cmake\": {\"paths\": {\"cmake\": \"/usr/bin/cmake\"}}, \"objects\": [{\"kind\": "
+                  "\"codemodel\", \"version\": {\"major\": 2, \"minor\": 0}, \"jsonFile\": \"codemodel.json\"}]}");
+    ga::writeFile(ga::combine(replyDir, "codemodel.json"),
+                  "{\"paths\": {\"source\": \"" + _projectDir + "\", \"build\": \"" + _buildDir +
+                      "\"}, \"configurations\": [{\"directories\": [{\"source\": \".\"}], "
+                      "\"projects\": [{\"name\": \"fapi\"}], \"targets\": [{\"jsonFile\": \"app.json\"}]}]}");
+    ga::writeFile(ga::combine(replyDir, "app.json"),
+                  "{\"name\": \"app\", \"type\": \"EXECUTABLE\", \"paths\": {\"build\": \".\"}, "
+                  "\"compileGroups\": [{\"includes\": [{\"path\": \"/usr/include/qt5\"}]}], "
+                  "\"sources\": [{\"path\": \"main.cpp\"}]}");
+
+    auto patch = [this](std::vector<std::string> &patchLog) {
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        patchLog.assign(log.begin() + logStart, log.end());
+    };
+    auto contains = [](const std::vector<std::string> &patchLog, const std::string &text) {
+        for (const std::string &line : patchLog) {
+            if (line.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<std::string> patchLog;
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, "file api: generated " + cbpFilePath + " with 1 targets"));
+    ASSERT_TRUE(contains(patchLog, cbpFilePath + " PatchResult: Changed"));
+
+    // The .bak is the generated .cbp, the .cbp is patched for the SDK
+    std::string generated;
+    ga::readFile(cbpFilePath + ".bak", generated);
+    ASSERT_NE(std::string::npos, generated.find("<Add directory=\"/usr/include/qt5\"/>"));
+    std::string actual;
+    ga::readFile(cbpFilePath, actual);
+    ASSERT_NE(std::string::npos, actual.find("<Add directory=\"/tmp/xcmake/test/sdks/v42/usr/include/qt5\"/>"));
+    ASSERT_NE(std::string::npos, actual.find("<Add option=\"-gcc1\"/>"));
+
+    // The same codemodel does not generate the .cbp again
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    patch(patchLog);
+    ASSERT_TRUE(contains(patchLog, "file api: " + cbpFilePath + " is up to date"));
+    ASSERT_TRUE(contains(patchLog, cbpFilePath + " is unchanged since the last patch"));
+
+    remove(cbpFilePath.c_str());
+    remove((cbpFilePath + ".bak").c_str());
+    remove(ga::combine(replyDir, "index-2026-01-01T10-00-00-0000.json").c_str());
+    remove(ga::combine(_buildDir, FILE_API_QUERY).c_str());
+}
+
+TEST_F(CMakerTests, RetargetSdk) {
+    createTestDir();
+    ga::writeFile(_cbpFilePath, g_inputCbp);
+    remove((_cbpFilePath + ".bak").c_str());
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_EQ(0, cmaker.patch());
+
+    // The SDK of the project changed, the file patched for v42 is moved to v43
+    std::string expectedCbp = getExpectedCbp("v43");
+    for (bool retargetSdk : {false, true}) {
+        JConfig config = deserialize(g_xcmakeJson);
+        config.projects[0].sdkPath = "/tmp/xcmake/test/sdks/v43";
+        config.retargetSdk = retargetSdk;
+        ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+        ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+        size_t logStart = cmaker.getExecutionPlan()->log.size();
+        ASSERT_EQ(0, cmaker.patch());
+
+        bool retargeted = false;
+        const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+        for (size_t i = logStart; i < log.size(); i++) {
+            retargeted = retargeted || (log[i].find("PatchResult: Changed (retarget from") != std::string::npos);
+        }
+        ASSERT_EQ(retargetSdk, retargeted);
+
+        std::string actualCbp;
+        ga::readFile(_cbpFilePath, actualCbp);
+        ASSERT_EQ(retargetSdk ? expectedCbp : g_expectedCbp, actualCbp);
+    }
+
+    // The paths do not start with the SDK of the note: the original is patched again
+    std::string movedCbp = g_expectedCbp;
+    for (size_t idx = movedCbp.find("sdks/v42/"); idx != std::string::npos; idx = movedCbp.find("sdks/v42/", idx)) {
+        movedCbp.replace(idx, 8, "sdks/v40");
+    }
+    ga::writeFile(_cbpFilePath, movedCbp);
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_EQ(0, cmaker.patch());
+    std::string actualCbp;
+    ga::readFile(_cbpFilePath, actualCbp);
+    ASSERT_EQ(getExpectedCbp("v43"), actualCbp);
+
+    // The original file generated by cmake is kept
+    std::string bakCbp;
+    ga::readFile(_cbpFilePath + ".bak", bakCbp);
+    ASSERT_EQ(g_inputCbp, bakCbp);
+
+    remove(_cbpFilePath.c_str());
+    remove((_cbpFilePath + ".bak").c_str());
+}
+
+TEST_F(CMakerTests, RepatchProject) {
+    createTestDir();
+    std::vector<std::string> buildDirs = {_buildDir, ga::combine(_tmpDir, "build2"), ga::combine(_tmpDir, "build3")};
+    JConfig config = deserialize(g_xcmakeJson);
+    config.projects[0].sdkPath = "/tmp/xcmake/test/sdks/v43";
+    config.projects[0].patchWorkers = 4;
+    for (const std::string &buildDir : buildDirs) {
+        mkdir(buildDir.c_str(), S_IRWXU);
+        remove(ga::combine(buildDir, CbpManifest::FILENAME).c_str());
+        // Patched for the previous SDK and generated again by cmake
+        ga::writeFile(ga::combine(buildDir, "proj42.cbp"), g_expectedCbp);
+        ga::writeFile(ga::combine(buildDir, "proj42_new.cbp"), g_inputCbp);
+        config.projects[0].buildPaths.insert(buildDir);
+    }
+    config.projects[0].buildPaths.insert(ga::combine(_tmpDir, "removed_build"));
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", CMaker::REPATCH_PROJECT_ARG, _projectDir};
+    cmdLineArgs.pwd = _tmpDir;
+    cmdLineArgs.home = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_EQ(0, cmaker.run());
+    ASSERT_EQ(0, cmaker.patch());
+
+    // One timing per directory, in the order of the directories
+    const std::vector<std::string> &output = cmaker.getExecutionPlan()->output;
+    ASSERT_EQ(buildDirs.size() + 1, output.size());
+    for (size_t i = 0; i < buildDirs.size(); i++) {
+        ASSERT_EQ(0, output[i].find(buildDirs[i] + ": 2 .cbp files in "));
+    }
+    ASSERT_EQ(0, output.back().find("Repatched 3 build directories in "));
+
+    const std::string expectedCbp = getExpectedCbp("v43");
+    for (const std::string &buildDir : buildDirs) {
+        for (const char *filename : {"proj42.cbp", "proj42_new.cbp"}) {
+            std::string cbpFilePath = ga::combine(buildDir, filename);
+            std::string actualCbp;
+            ga::readFile(cbpFilePath, actualCbp);
+            ASSERT_EQ(expectedCbp, actualCbp);
+            remove(cbpFilePath.c_str());
+            remove((cbpFilePath + ".bak").c_str());
+        }
+    }
+
+    // The configuration is not changed
+    std::string configJson;
+    ga::readFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), configJson);
+    ASSERT_EQ(serialize(config), configJson);
+
+    // A project without a SDK cannot be patched
+    cmdLineArgs.args = {"xcmake", CMaker::REPATCH_PROJECT_ARG, "/nonexistent/project"};
+    config.projects.pop_back();
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+    ASSERT_NE(0, cmaker.init(cmdLineArgs));
+}
+
 TEST_F(CMakerTests, CMAKE_CP_TO_BUILD) {
     createTestDir();
 
@@ -159,6 +643,139 @@ TEST_F(CMakerTests, CMAKE_CP_TO_BUILD) {
     ASSERT_EQ(actualCbp, g_expectedCbp);
 }
 
+TEST_F(CMakerTests, SpawnMissingCommand) {
+    createTestDir();
+
+    // The replacement of xcmake is not installed in the test SDK
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_NE(0, cmaker.run());
+    const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+    ASSERT_EQ(0, log.back().find("cannot spawn /tmp/xcmake/test/sdks/v42/usr/bin/cmaker: "));
+}
+
+TEST_F(CMakerTests, ExecInPlace) {
+    createTestDir();
+    JConfig config = deserialize(g_xcmakeJson);
+    config.cmdReplacement["xexit"] = {"/bin/sh", "/bin/sh"};
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    // The .cbp files are patched after cmake, it runs in a child
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xcmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = _buildDir;
+    cmdLineArgs.home = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_FALSE(cmaker.canExecInPlace());
+    ASSERT_NE(0, cmaker.exec());
+
+    // Nothing is done after the command, it replaces the process and its exit code is kept
+    cmdLineArgs.args = {"xexit", "-c", "exit 3"};
+    cmdLineArgs.pwd = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_TRUE(cmaker.canExecInPlace());
+    EXPECT_EXIT(cmaker.exec(), ::testing::ExitedWithCode(3), "");
+
+    // A command without a replacement and without a build directory is rejected before the configuration is parsed
+    cmdLineArgs.args = {"/usr/bin/xunknown"};
+    ASSERT_NE(0, cmaker.init(cmdLineArgs));
+    const std::vector<std::string> &log = cmaker.getExecutionPlan()->log;
+    const std::string rejected =
+        "cmdReplacement for: /usr/bin/xunknown does not exist in " + ga::combine(_tmpDir, CMaker::CONFIG_FILENAME);
+    ASSERT_NE(log.end(), std::find(log.begin(), log.end(), rejected));
+    ASSERT_FALSE(cmaker.canExecInPlace());
+
+    // A replacement keyed by a full path is found for the file name
+    config.cmdReplacement["/opt/tools/bin/xfull"] = {"/bin/sh", "/bin/sh"};
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+    cmdLineArgs.args = {"xfull", "-c", "exit 4"};
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_EQ("/bin/sh", cmaker.getExecutionPlan()->exePath);
+    EXPECT_EXIT(cmaker.exec(), ::testing::ExitedWithCode(4), "");
+
+    // An escaped key is found once the configuration is parsed
+    config.cmdReplacement["/opt/tools/bin/xesc"] = {"/bin/sh", "/bin/sh"};
+    std::string jStr = serialize(config);
+    const std::string key = "\"/opt/tools/bin/xesc\"";
+    jStr.replace(jStr.find(key), key.size(), "\"\\/opt\\/tools\\/bin\\/x\\u0065sc\"");
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), jStr);
+    cmdLineArgs.args = {"xesc", "-c", "exit 5"};
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    EXPECT_EXIT(cmaker.exec(), ::testing::ExitedWithCode(5), "");
+
+    // The build directory of a command without a replacement is still registered
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+    std::string buildDir = ga::combine(_tmpDir, "build_unknown");
+    mkdir(buildDir.c_str(), S_IRWXU);
+    cmdLineArgs.args = {"/usr/bin/xunknownmake", _projectDir, "'-GCodeBlocks - Unix Makefiles'"};
+    cmdLineArgs.pwd = buildDir;
+    ASSERT_NE(0, cmaker.init(cmdLineArgs));
+    std::string updated;
+    ASSERT_TRUE(ga::readFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), updated));
+    ASSERT_EQ(1, deserialize(updated).projects[0].buildPaths.count(buildDir));
+}
+
+TEST_F(CMakerTests, CaptureOutput) {
+    createTestDir();
+    std::string logDir = ga::combine(_tmpDir, "logs");
+    JConfig config = deserialize(g_xcmakeJson);
+    config.captureLogDir = logDir;
+    config.cmdReplacement["xsh"] = {"/bin/sh", "/bin/sh"};
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xsh", "-c", "echo out; echo err >&2; printf partial"};
+    cmdLineArgs.pwd = _tmpDir;
+    cmdLineArgs.home = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    // The output goes through xcmake, the command cannot replace it
+    ASSERT_FALSE(cmaker.canExecInPlace());
+    ASSERT_EQ(0, cmaker.run());
+
+    const ExecutionPlan *ep = cmaker.getExecutionPlan();
+    ASSERT_EQ(0, ep->captureLogPath.find(ga::combine(logDir, "xcmake-")));
+    std::string log;
+    ASSERT_TRUE(ga::readFile(ep->captureLogPath, log));
+    ASSERT_EQ(0, log.find("# /bin/sh -c echo out; echo err >&2; printf partial (" + _tmpDir + ")\n"));
+    ASSERT_NE(std::string::npos, log.find(" o out\n"));
+    ASSERT_NE(std::string::npos, log.find(" e err\n"));
+    // The last line has no end of line
+    ASSERT_NE(std::string::npos, log.find(" o partial\n# exit 0 after "));
+}
+
+TEST_F(CMakerTests, ChildUsage) {
+    createTestDir();
+    JConfig config = deserialize(g_xcmakeJson);
+    config.cmdReplacement["xsh"] = {"/bin/sh", "/bin/sh"};
+    ga::writeFile(ga::combine(_tmpDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xsh", "-c", "exit 3"};
+    cmdLineArgs.pwd = _tmpDir;
+    cmdLineArgs.home = _tmpDir;
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    const ExecutionPlan *ep = cmaker.getExecutionPlan();
+    ASSERT_EQ(-1, ep->childUsage.status);
+    ASSERT_EQ(0, cmaker.run());
+    ASSERT_EQ(3, ep->childUsage.exitCode);
+    ASSERT_EQ(0, ep->childUsage.termSignal);
+    ASSERT_LT(0, ep->childUsage.wallSeconds);
+    ASSERT_LT(0, ep->childUsage.maxRssKB);
+    ASSERT_NE(std::string::npos, serialize(ep).find("\"exitCode\": 3"));
+    ASSERT_EQ(0, ep->log.back().find("usage of "));
+
+    // Killed by a signal
+    cmdLineArgs.args = {"xsh", "-c", "kill -TERM $$"};
+    ASSERT_EQ(0, cmaker.init(cmdLineArgs));
+    ASSERT_EQ(0, cmaker.run());
+    ASSERT_EQ(-1, ep->childUsage.exitCode);
+    ASSERT_EQ(SIGTERM, ep->childUsage.termSignal);
+    ASSERT_NE(std::string::npos, ep->log.back().find(": signal: 15 wall: "));
+}
+
 TEST_F(CMakerTests, WriteDefaultConfig) {
     createTestDir();
 
@@ -0,0 +1,87 @@
+#include <CbpCache.h>
+
+#include <file_system.h>
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+namespace gatools {
+
+class CbpCacheTests : public ::testing::Test {
+  public:
+    void SetUp() override;
+
+    /// @brief set the last use of the entry of the key.
+    void setLastUse(const std::string &key, int64_t seconds);
+
+    std::string _cacheDir = "/tmp/xcmake/test_cache";
+};
+
+void CbpCacheTests::SetUp() {
+    ga::createDirectories(_cacheDir);
+    ga::findInDirectory(_cacheDir, [](const ga::ChildEntry &entry) { remove(entry.path); });
+}
+
+void CbpCacheTests::setLastUse(const std::string &key, int64_t seconds) {
+    struct timespec times[2];
+    times[0].tv_sec = times[1].tv_sec = seconds;
+    times[0].tv_nsec = times[1].tv_nsec = 0;
+    std::string entryPath = ga::combine(_cacheDir, key + ".cbp");
+    ASSERT_EQ(0, utimensat(AT_FDCWD, entryPath.c_str(), times, 0));
+}
+
+TEST_F(CbpCacheTests, GetDefaultDir) {
+    ASSERT_EQ("/home/user/.cache/xcmake", CbpCache::getDefaultDir({"PATH=/usr/bin"}, "/home/user"));
+    ASSERT_EQ("/tmp/cache/xcmake", CbpCache::getDefaultDir({"XDG_CACHE_HOME=/tmp/cache"}, "/home/user"));
+}
+
+TEST_F(CbpCacheTests, GetKey) {
+    std::string key = CbpCache::getKey("<cbp/>", "profile1");
+    ASSERT_EQ(key, CbpCache::getKey("<cbp/>", "profile1"));
+    ASSERT_NE(key, CbpCache::getKey("<cbp/>", "profile2"));
+    ASSERT_NE(key, CbpCache::getKey("<cbp />", "profile1"));
+}
+
+TEST_F(CbpCacheTests, PutGet) {
+    CbpCache cache(_cacheDir, 1 << 20);
+    ASSERT_TRUE(cache.open());
+
+    std::string key = CbpCache::getKey("input", "profile");
+    std::string bytes;
+    ASSERT_FALSE(cache.get(key, bytes));
+
+    ASSERT_EQ(0, cache.getPutCount());
+    ASSERT_TRUE(cache.put(key, "output"));
+    ASSERT_TRUE(cache.get(key, bytes));
+    ASSERT_EQ("output", bytes);
+
+    ASSERT_TRUE(cache.put(key, "output"));
+    ASSERT_TRUE(cache.get(key, bytes));
+    ASSERT_EQ("output", bytes);
+    ASSERT_EQ(2, cache.getPutCount());
+}
+
+TEST_F(CbpCacheTests, EvictLeastRecentlyUsed) {
+    CbpCache cache(_cacheDir, 250);
+    ASSERT_TRUE(cache.open());
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3; i++) {
+        keys.push_back(CbpCache::getKey("input" + std::to_string(i), "profile"));
+        ASSERT_TRUE(cache.put(keys.back(), std::string(100, 'a' + i)));
+        setLastUse(keys.back(), 1000 + i);
+    }
+    ASSERT_EQ(0u, CbpCache(_cacheDir, 300).evict());
+
+    // Using the oldest entry makes it the most recent one
+    std::string bytes;
+    ASSERT_TRUE(cache.get(keys[0], bytes));
+
+    ASSERT_EQ(1u, cache.evict());
+    ASSERT_TRUE(cache.get(keys[0], bytes));
+    ASSERT_FALSE(cache.get(keys[1], bytes));
+    ASSERT_TRUE(cache.get(keys[2], bytes));
+}
+
+} // namespace gatools
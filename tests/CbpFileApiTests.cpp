@@ -0,0 +1,228 @@
+#include <CbpFileApi.h>
+#include <CbpPatcher.h>
+
+#include <file_system.h>
+#include <gtest/gtest.h>
+
+namespace gatools {
+
+class CbpFileApiTests : public ::testing::Test {
+  public:
+    CbpFileApiTests();
+
+    void writeReply();
+
+    std::string _sourceDir;
+    std::string _buildDir;
+    std::string _replyDir;
+};
+
+CbpFileApiTests::CbpFileApiTests()
+    : _sourceDir("/tmp/xcmake/test/fileapi/src")
+    , _buildDir("/tmp/xcmake/test/fileapi/build")
+    , _replyDir(ga::combine(_buildDir, FILE_API_REPLY_DIR)) {}
+
+void CbpFileApiTests::writeReply() {
+    ga::createDirectories(_replyDir);
+    // An index left by an older configure points to a reply that does not exist anymore
+    ga::writeFile(ga::combine(_replyDir, "index-2026-01-01T10-00-00-0000.json"),
+                  "{\"objects\": [{\"kind\": \"codemodel\", \"version\": {\"major\": 2, \"minor\": 0}, "
+                  "\"jsonFile\": \"codemodel-v2-old.json\"}]}");
+    ga::writeFile(ga::combine(_replyDir, "index-2026-01-02T10-00-00-0000.json"),
+                  "{\"cmake\": {\"paths\": {\"cmake\": \"/usr/bin/cmake\"}}, \"objects\": ["
+                  "{\"kind\": \"cache\", \"version\": {\"major\": 2, \"minor\": 0}, \"jsonFile\": \"cache.json\"}, "
+                  "{\"kind\": \"codemodel\", \"version\": {\"major\": 2, \"minor\": 3}, "
+                  "\"jsonFile\": \"codemodel-v2-1.json\"}]}");
+    ga::writeFile(ga::combine(_replyDir, "codemodel-v2-1.json"),
+                  "{\"paths\": {\"source\": \"" + _sourceDir + "\", \"build\": \"" + _buildDir +
+                      "\"}, \"configurations\": [{\"name\": \"Debug\", "
+                      "\"directories\": [{\"source\": \".\"}, {\"source\": \"lib/core\"}], "
+                      "\"projects\": [{\"name\": \"fapi\"}, {\"name\": \"sub\", \"parentIndex\": 0}], "
+                      "\"targets\": [{\"name\": \"app\", \"jsonFile\": \"target-app.json\"}, "
+                      "{\"name\": \"core\", \"jsonFile\": \"target-core.json\"}, "
+                      "{\"name\": \"docs\", \"jsonFile\": \"target-docs.json\"}]}]}");
+    ga::writeFile(ga::combine(_replyDir, "target-app.json"),
+                  "{\"name\": \"app\", \"type\": \"EXECUTABLE\", \"paths\": {\"source\": \".\", \"build\": \".\"}, "
+                  "\"artifacts\": [{\"path\": \"app\"}], \"compileGroups\": [{\"language\": \"CXX\", "
+                  "\"includes\": [{\"path\": \"/usr/include/qt5\"}, {\"path\": \"" +
+                      _sourceDir +
+                      "/lib\"}], \"defines\": [{\"define\": \"NAME=\\\"a\\\"\"}]}], "
+                      "\"sources\": [{\"path\": \"main.cpp\"}, {\"path\": \"lib/core/shared.cpp\"}]}");
+    ga::writeFile(ga::combine(_replyDir, "target-core.json"),
+                  "{\"name\": \"core\", \"type\": \"STATIC_LIBRARY\", \"paths\": {\"build\": \"lib/core\"}, "
+                  "\"artifacts\": [{\"path\": \"lib/core/libcore.a\"}], \"compileGroups\": ["
+                  "{\"includes\": [{\"path\": \"/usr/include/qt5\"}], \"defines\": [{\"define\": \"CORE\"}]}, "
+                  "{\"includes\": [{\"path\": \"/usr/include/qt5\"}], \"defines\": [{\"define\": \"CORE\"}]}], "
+                  "\"sources\": [{\"path\": \"lib/core/shared.cpp\"}, {\"path\": \"lib/core/core.cpp\"}]}");
+    ga::writeFile(ga::combine(_replyDir, "target-docs.json"),
+                  "{\"name\": \"docs\", \"type\": \"UTILITY\", \"paths\": {\"build\": \".\"}}");
+}
+
+TEST_F(CbpFileApiTests, Query) {
+    ASSERT_TRUE(writeFileApiQuery(_buildDir));
+    ASSERT_TRUE(ga::pathExists(ga::combine(_buildDir, FILE_API_QUERY)));
+    // The query is kept between the runs
+    ASSERT_TRUE(writeFileApiQuery(_buildDir));
+}
+
+TEST_F(CbpFileApiTests, ReadReply) {
+    writeReply();
+
+    for (size_t workerCount : {1, 4}) {
+        FileApiCodemodel codemodel;
+        std::string error;
+        ASSERT_TRUE(readFileApiReply(_buildDir, workerCount, codemodel, error)) << error;
+        ASSERT_EQ("/usr/bin/cmake", codemodel.cmakePath);
+        ASSERT_EQ("fapi", codemodel.projectName);
+        ASSERT_EQ("fapi.cbp", getGeneratedCBPFilename(codemodel));
+        ASSERT_EQ(std::vector<std::string>({".", "lib/core"}), codemodel.directories);
+        ASSERT_EQ(3, codemodel.targets.size());
+
+        const FileApiTarget &core = codemodel.targets[1];
+        ASSERT_EQ("core", core.name);
+        ASSERT_EQ(_buildDir + "/lib/core", core.buildDir);
+        ASSERT_EQ(_buildDir + "/lib/core/libcore.a", core.output);
+        // The compile groups are merged
+        ASSERT_EQ(std::vector<std::string>({"CORE"}), core.defines);
+        ASSERT_EQ(std::vector<std::string>({"/usr/include/qt5"}), core.includes);
+        ASSERT_EQ(std::vector<std::string>({_sourceDir + "/lib/core/shared.cpp", _sourceDir + "/lib/core/core.cpp"}),
+                  core.sources);
+    }
+
+    ga::writeFile(ga::combine(_replyDir, "target-docs.json"), "{\"name\": ");
+    FileApiCodemodel codemodel;
+    std::string error;
+    ASSERT_FALSE(readFileApiReply(_buildDir, 2, codemodel, error));
+    ASSERT_EQ(ga::combine(_replyDir, "target-docs.json") + " is not a json object", error);
+    ASSERT_FALSE(readFileApiReply("/tmp/xcmake/test/fileapi/none", 2, codemodel, error));
+}
+
+TEST_F(CbpFileApiTests, GenerateCBP) {
+    writeReply();
+    FileApiCodemodel codemodel;
+    std::string error;
+    ASSERT_TRUE(readFileApiReply(_buildDir, 2, codemodel, error)) << error;
+
+    const std::string build = "&quot;/usr/bin/cmake&quot; --build &quot;" + _buildDir + "&quot; --target ";
+    const std::string expected =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<CodeBlocks_project_file>\n"
+        "\t<FileVersion major=\"1\" minor=\"6\"/>\n"
+        "\t<Project>\n"
+        "\t\t<Option title=\"fapi\"/>\n"
+        "\t\t<Option makefile_is_custom=\"1\"/>\n"
+        "\t\t<Option compiler=\"gcc\"/>\n"
+        "\t\t<Option virtualFolders=\"CMake Files\\;CMake Files\\lib\\;CMake Files\\lib\\core\\;\"/>\n"
+        "\t\t<Build>\n"
+        "\t\t\t<Target title=\"all\">\n"
+        "\t\t\t\t<Option working_dir=\"" +
+        _buildDir +
+        "\"/>\n"
+        "\t\t\t\t<Option type=\"4\"/>\n"
+        "\t\t\t\t<MakeCommands>\n"
+        "\t\t\t\t\t<Build command=\"" +
+        build + "all\"/>\n\t\t\t\t\t<Clean command=\"" + build + "clean\"/>\n\t\t\t\t\t<DistClean command=\"" + build +
+        "clean\"/>\n"
+        "\t\t\t\t</MakeCommands>\n"
+        "\t\t\t</Target>\n"
+        "\t\t\t<Target title=\"app\">\n"
+        "\t\t\t\t<Option output=\"" +
+        _buildDir +
+        "/app\" prefix_auto=\"0\" extension_auto=\"0\"/>\n"
+        "\t\t\t\t<Option working_dir=\"" +
+        _buildDir +
+        "\"/>\n"
+        "\t\t\t\t<Option object_output=\"./\"/>\n"
+        "\t\t\t\t<Option type=\"1\"/>\n"
+        "\t\t\t\t<Option compiler=\"gcc\"/>\n"
+        "\t\t\t\t<Compiler>\n"
+        "\t\t\t\t\t<Add option=\"-DNAME=&quot;a&quot;\"/>\n"
+        "\t\t\t\t\t<Add directory=\"/usr/include/qt5\"/>\n"
+        "\t\t\t\t\t<Add directory=\"" +
+        _sourceDir +
+        "/lib\"/>\n"
+        "\t\t\t\t</Compiler>\n"
+        "\t\t\t\t<MakeCommands>\n"
+        "\t\t\t\t\t<Build command=\"" +
+        build + "app\"/>\n\t\t\t\t\t<Clean command=\"" + build + "clean\"/>\n\t\t\t\t\t<DistClean command=\"" + build +
+        "clean\"/>\n"
+        "\t\t\t\t</MakeCommands>\n"
+        "\t\t\t</Target>\n"
+        "\t\t\t<Target title=\"core\">\n"
+        "\t\t\t\t<Option output=\"" +
+        _buildDir +
+        "/lib/core/libcore.a\" prefix_auto=\"0\" extension_auto=\"0\"/>\n"
+        "\t\t\t\t<Option working_dir=\"" +
+        _buildDir +
+        "/lib/core\"/>\n"
+        "\t\t\t\t<Option object_output=\"./\"/>\n"
+        "\t\t\t\t<Option type=\"2\"/>\n"
+        "\t\t\t\t<Option compiler=\"gcc\"/>\n"
+        "\t\t\t\t<Compiler>\n"
+        "\t\t\t\t\t<Add option=\"-DCORE\"/>\n"
+        "\t\t\t\t\t<Add directory=\"/usr/include/qt5\"/>\n"
+        "\t\t\t\t</Compiler>\n"
+        "\t\t\t\t<MakeCommands>\n"
+        "\t\t\t\t\t<Build command=\"" +
+        build + "core\"/>\n\t\t\t\t\t<Clean command=\"" + build + "clean\"/>\n\t\t\t\t\t<DistClean command=\"" + build +
+        "clean\"/>\n"
+        "\t\t\t\t</MakeCommands>\n"
+        "\t\t\t</Target>\n"
+        "\t\t\t<Target title=\"docs\">\n"
+        "\t\t\t\t<Option working_dir=\"" +
+        _buildDir +
+        "\"/>\n"
+        "\t\t\t\t<Option type=\"4\"/>\n"
+        "\t\t\t\t<MakeCommands>\n"
+        "\t\t\t\t\t<Build command=\"" +
+        build + "docs\"/>\n\t\t\t\t\t<Clean command=\"" + build + "clean\"/>\n\t\t\t\t\t<DistClean command=\"" + build +
+        "clean\"/>\n"
+        "\t\t\t\t</MakeCommands>\n"
+        "\t\t\t</Target>\n"
+        "\t\t</Build>\n"
+        "\t\t<Unit filename=\"" +
+        _sourceDir +
+        "/CMakeLists.txt\">\n"
+        "\t\t\t<Option virtualFolder=\"CMake Files\\\"/>\n"
+        "\t\t</Unit>\n"
+        "\t\t<Unit filename=\"" +
+        _sourceDir +
+        "/lib/core/CMakeLists.txt\">\n"
+        "\t\t\t<Option virtualFolder=\"CMake Files\\lib\\core\\\"/>\n"
+        "\t\t</Unit>\n"
+        "\t\t<Unit filename=\"" +
+        _sourceDir +
+        "/lib/core/core.cpp\">\n"
+        "\t\t\t<Option target=\"core\"/>\n"
+        "\t\t</Unit>\n"
+        "\t\t<Unit filename=\"" +
+        _sourceDir +
+        "/lib/core/shared.cpp\">\n"
+        "\t\t\t<Option target=\"app\"/>\n"
+        "\t\t\t<Option target=\"core\"/>\n"
+        "\t\t</Unit>\n"
+        "\t\t<Unit filename=\"" +
+        _sourceDir +
+        "/main.cpp\">\n"
+        "\t\t\t<Option target=\"app\"/>\n"
+        "\t\t</Unit>\n"
+        "\t</Project>\n"
+        "</CodeBlocks_project_file>\n";
+    std::string cbp = generateCBP(codemodel);
+    ASSERT_EQ(expected, cbp);
+
+    // The generated .cbp is patched by the same rules as the .cbp written by cmake
+    CbpPatchContext context;
+    context.buildDir = _buildDir;
+    context.projectDir = _sourceDir;
+    context.sdkDir = "/tmp/xcmake/test/sdks/v42";
+    context.gccClangFixes.insert("-gcc1");
+    ASSERT_EQ(tinyxml2::XML_SUCCESS, context.inOutXml.Parse(cbp.data(), cbp.size()));
+    std::string patched;
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &patched));
+    ASSERT_NE(std::string::npos, patched.find("<Add directory=\"/tmp/xcmake/test/sdks/v42/usr/include/qt5\"/>"));
+    ASSERT_NE(std::string::npos, patched.find("<Add option=\"-gcc1\"/>"));
+    ASSERT_EQ(std::string::npos, patched.find("\"/usr/include/qt5\""));
+}
+
+} // namespace gatools
@@ -1,7 +1,12 @@
+#include <CbpPatchRules.h>
+#include <CbpPatchSession.h>
 #include <CbpPatcher.h>
+#include <CbpRewriteCache.h>
+#include <CbpRewriteRoots.h>
 
 #include <file_system.h>
 #include <gtest/gtest.h>
+#include <random>
 
 namespace gatools {
 
@@ -49,6 +54,50 @@ TEST_F(CbpPatcherTests, VirtualFoldersChange) {
     ASSERT_EQ(expected, value);
 }
 
+TEST_F(CbpPatcherTests, RewriteCache) {
+    context.virtualFolderPrefix = "..\\..\\sdk\\v43";
+    auto rewriteCache = std::make_shared<CbpRewriteCache>();
+
+    CbpPatchContext cachedContext;
+    cachedContext.buildDir = context.buildDir;
+    cachedContext.sdkDir = context.sdkDir;
+    cachedContext.virtualFolderPrefix = context.virtualFolderPrefix;
+    cachedContext.rewriteCache = rewriteCache;
+
+    const std::vector<std::pair<RewriteKind, std::string>> values = {
+        {RewriteKind::SdkPrefix, "/usr/include/lib"},
+        {RewriteKind::SdkPrefix, "/home/user/include"},
+        {RewriteKind::VirtualFolder, "CMake Files\\..\\..\\..\\..\\usr\\include\\someotherlib"},
+        {RewriteKind::VirtualFolder, "CMake Files\\..\\..\\somedir\\"},
+    };
+    for (int pass = 0; pass < 2; pass++) {
+        for (const auto &kv : values) {
+            std::string expected = kv.second;
+            bool expectedChanged = rewriteValue(kv.first, context, expected);
+            std::string actual = kv.second;
+            ASSERT_EQ(expectedChanged, rewriteValue(kv.first, cachedContext, actual));
+            ASSERT_EQ(expected, actual);
+        }
+    }
+    ASSERT_EQ(values.size(), rewriteCache->getStats().misses);
+    ASSERT_EQ(values.size(), rewriteCache->getStats().hits);
+
+    // The context is part of the key
+    cachedContext.sdkDir = "/tmp/xcmake/test/sdks/v43";
+    std::string value = values[0].second;
+    ASSERT_TRUE(rewriteValue(RewriteKind::SdkPrefix, cachedContext, value));
+    ASSERT_EQ("/tmp/xcmake/test/sdks/v43/usr/include/lib", value);
+    ASSERT_EQ(values.size() + 1, rewriteCache->getStats().misses);
+
+    // So are the rewrite roots: "/home" is relocated with them, not with the default ones
+    value = values[1].second;
+    ASSERT_FALSE(rewriteValue(RewriteKind::SdkPrefix, cachedContext, value));
+    cachedContext.rewriteRoots = CbpRewriteRoots::compile({"/usr", "/home"});
+    ASSERT_TRUE(rewriteValue(RewriteKind::SdkPrefix, cachedContext, value));
+    ASSERT_EQ("/tmp/xcmake/test/sdks/v43/home/user/include", value);
+    ASSERT_EQ(values.size() + 3, rewriteCache->getStats().misses);
+}
+
 TEST_F(CbpPatcherTests, PatchCBPs) {
     std::string expectedTestprojectCbpOutput;
     ASSERT_TRUE(ga::readFile("testproject_output.cbp.xml", expectedTestprojectCbpOutput));
@@ -64,8 +113,334 @@ TEST_F(CbpPatcherTests, PatchCBPs) {
     // Already transformed. Nothing will be done
     patchResult = patchCBP(context, &outXml);
 
-    ASSERT_EQ(PatchResult::Unchanged, patchResult);
+    ASSERT_EQ(PatchResult::AlreadyPatched, patchResult);
     ASSERT_EQ("", outXml);
+
+    // Transformed for another SDK
+    context.sdkDir = "/tmp/xcmake/test/sdks/v43";
+    patchResult = patchCBP(context, &outXml);
+
+    ASSERT_EQ(PatchResult::DifferentSDK, patchResult);
+    ASSERT_EQ("", outXml);
+}
+
+TEST_F(CbpPatcherTests, PatchCBPToFile) {
+    std::string expected;
+    ASSERT_TRUE(ga::readFile("testproject_output.cbp.xml", expected));
+
+    const std::string filePath = "/tmp/xcmake/test_output.cbp";
+    ga::createDirectories("/tmp/xcmake");
+    context.inOutXml.LoadFile("testproject_input.cbp");
+    ASSERT_TRUE(ga::writeFileHandle(
+        filePath, [this](FILE *output) { return patchCBP(context, output) == PatchResult::Changed; }));
+
+    std::string actual;
+    ASSERT_TRUE(ga::readFile(filePath, actual));
+    ASSERT_EQ(expected, actual);
+
+    // Nothing is written if the document is not changed
+    context.inOutXml.Parse(expected.c_str(), expected.size());
+    ASSERT_FALSE(ga::writeFileHandle(
+        filePath, [this](FILE *output) { return patchCBP(context, output) == PatchResult::Changed; }));
+    ASSERT_TRUE(ga::readFile(filePath, actual));
+    ASSERT_EQ(expected, actual);
+    remove(filePath.c_str());
+}
+
+TEST_F(CbpPatcherTests, ElementWorkers) {
+    std::vector<JPatchRule> userRules = {
+        {"Unit", "filename", "replace", "header", "header2"},
+        {"Unit/Option", "virtualFolder", "replace", "CMake Files", "Files"},
+    };
+    context.patchRules = CbpPatchRules::compile(userRules);
+
+    tinyxml2::XMLDocument doc;
+    ASSERT_EQ(tinyxml2::XML_SUCCESS, doc.LoadFile("testproject_input.cbp"));
+    XmlElemPtr project = doc.FirstChildElement()->FirstChildElement("Project");
+    for (size_t i = 0; i < 2 * PARALLEL_REWRITE_MIN; i++) {
+        XmlElemPtr unit = project->InsertNewChildElement("Unit");
+        std::string filename = "/usr/include/lib" + std::to_string(i) + "/header.h";
+        unit->SetAttribute("filename", filename.c_str());
+        XmlElemPtr option = unit->InsertNewChildElement("Option");
+        std::string virtualFolder = "CMake Files\\..\\..\\..\\..\\usr\\include\\lib" + std::to_string(i);
+        option->SetAttribute("virtualFolder", virtualFolder.c_str());
+    }
+    tinyxml2::XMLPrinter printer;
+    doc.Print(&printer);
+    std::string input = printer.CStr();
+
+    std::string expected;
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &expected));
+    ASSERT_NE(std::string::npos, expected.find("v42/usr/include/lib9/header2.h"));
+
+    // The values computed in parallel give the same document
+    context.elementWorkers = 4;
+    std::string actual;
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &actual));
+    ASSERT_EQ(expected, actual);
+}
+
+TEST_F(CbpPatcherTests, Prescan) {
+    std::string input;
+    std::string output;
+    ASSERT_TRUE(ga::readFile("testproject_input.cbp", input));
+    ASSERT_TRUE(ga::readFile("testproject_output.cbp.xml", output));
+
+    PatchResult patchResult = PatchResult::Error;
+    ASSERT_FALSE(prescanCBP(context, input.data(), input.size(), patchResult));
+
+    ASSERT_TRUE(prescanCBP(context, output.data(), output.size(), patchResult));
+    ASSERT_EQ(PatchResult::AlreadyPatched, patchResult);
+
+    context.sdkDir = "/tmp/xcmake/test/sdks/v43";
+    ASSERT_TRUE(prescanCBP(context, output.data(), output.size(), patchResult));
+    ASSERT_EQ(PatchResult::DifferentSDK, patchResult);
+    ASSERT_EQ("/tmp/xcmake/test/sdks/v42", context.oldSdkPrefix);
+    ASSERT_EQ("..\\sdks\\v42", context.oldVirtualFolderPrefix);
+
+    // Same result as the full parse
+    context.inOutXml.Parse(output.c_str(), output.size());
+    ASSERT_EQ(PatchResult::DifferentSDK, patchCBP(context));
+
+    // Anything else than the note created by patchCBP is left to the full parse
+    std::string commented = "<!-- <Project> -->" + output;
+    ASSERT_FALSE(prescanCBP(context, commented.data(), commented.size(), patchResult));
+    ASSERT_FALSE(prescanCBP(context, output.data(), output.find("]]>"), patchResult));
+}
+
+TEST_F(CbpPatcherTests, PatchSession) {
+    std::string input;
+    std::string expected;
+    ASSERT_TRUE(ga::readFile("testproject_input.cbp", input));
+    ASSERT_TRUE(ga::readFile("testproject_output.cbp.xml", expected));
+
+    auto profile = std::make_shared<CbpPatchProfile>();
+    profile->projectDir = context.projectDir;
+    profile->buildDir = context.buildDir;
+    profile->sdkDir = context.sdkDir;
+    profile->extraAddDirectory = context.extraAddDirectory;
+    profile->gccClangFixes = context.gccClangFixes;
+    CbpPatchSession session(profile);
+
+    // The state of a file does not leak into the next one
+    const std::vector<std::pair<std::string *, PatchResult>> files = {
+        {&input, PatchResult::Changed},
+        {&expected, PatchResult::AlreadyPatched},
+        {&input, PatchResult::Changed},
+    };
+    for (const auto &file : files) {
+        CbpPatchContext &sessionContext = session.begin(context.cbpFilePath);
+        ASSERT_TRUE(sessionContext.oldSdkPrefix.empty());
+        ASSERT_EQ(tinyxml2::XML_SUCCESS, sessionContext.inOutXml.Parse(file.first->c_str(), file.first->size()));
+        ASSERT_EQ(file.second, patchCBP(sessionContext, &session.getOutput()));
+        if (file.second == PatchResult::Changed) {
+            ASSERT_EQ(expected, session.getOutput());
+        }
+    }
+    ASSERT_EQ(files.size(), session.getFileCount());
+}
+
+TEST_F(CbpPatcherTests, PatchRules) {
+    std::vector<JPatchRule> userRules = {
+        {"MakeCommands/Build", "command", "replace", "/usr/bin/make", "/tmp/xcmake/test/sdks/v42/usr/bin/make"},
+        {"*/CompileFile", "command", "replace", "/usr/bin/make", "make"},
+        {"MakeCommands/Clean", "command", "unknownAction", "", ""},
+        {"Project/Option", "virtualFolders", "projectOption", "", ""},
+        {"Build/Target/Option", "working_dir", "sdkPrefix", "", ""},
+    };
+    std::vector<std::string> errors;
+    context.patchRules = CbpPatchRules::compile(userRules, &errors);
+    ASSERT_EQ(3, errors.size());
+
+    context.inOutXml.LoadFile("testproject_input.cbp");
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context));
+
+    XmlElemPtr makeCommands = context.inOutXml.FirstChildElement()
+                                  ->FirstChildElement("Project")
+                                  ->FirstChildElement("Build")
+                                  ->FirstChildElement("Target")
+                                  ->FirstChildElement("MakeCommands");
+    std::string actual;
+    ASSERT_TRUE(getAttribute(makeCommands->FirstChildElement("Build"), "command", actual));
+    ASSERT_EQ(0, actual.find("/tmp/xcmake/test/sdks/v42/usr/bin/make -j8"));
+    ASSERT_TRUE(getAttribute(makeCommands->FirstChildElement("CompileFile"), "command", actual));
+    ASSERT_EQ(0, actual.find("make -j8"));
+    ASSERT_TRUE(getAttribute(makeCommands->FirstChildElement("Clean"), "command", actual));
+    ASSERT_EQ(0, actual.find("/usr/bin/make -j8"));
+}
+
+TEST_F(CbpPatcherTests, RewriteRoots) {
+    std::vector<std::string> errors;
+    auto roots = CbpRewriteRoots::compile({"/usr", "/opt/", "/lib", "/lib64", "/opt", "relative", "/"}, &errors);
+    ASSERT_EQ(2, errors.size());
+    ASSERT_EQ((std::vector<std::string>{"/usr", "/opt", "/lib", "/lib64"}), roots->getRoots());
+
+    ASSERT_EQ(0, roots->find("/usr"));
+    ASSERT_EQ(0, roots->find("/lib64/libc.so"));
+    ASSERT_EQ(2, roots->find("-I/opt/vendor/include"));
+    ASSERT_EQ(CbpRewriteRoots::NOT_FOUND, roots->find("-I/opt"));
+    ASSERT_EQ(CbpRewriteRoots::NOT_FOUND, roots->find("/library/usr"));
+    ASSERT_EQ(CbpRewriteRoots::NOT_FOUND, roots->find("/home/user/lib32/x"));
+    ASSERT_TRUE(roots->contains("/lib"));
+    ASSERT_TRUE(roots->contains("/opt/vendor"));
+    ASSERT_FALSE(roots->contains("/optional"));
+    ASSERT_FALSE(roots->contains("/home/opt/vendor"));
+
+    std::string value = "/opt/vendor/include";
+    ASSERT_TRUE(addPrefix(value, context.sdkDir, *roots));
+    ASSERT_EQ("/tmp/xcmake/test/sdks/v42/opt/vendor/include", value);
+    value = "/opt/vendor/include";
+    ASSERT_FALSE(addPrefix(value, context.sdkDir));
+
+    context.rewriteRoots = roots;
+    context.virtualFolderPrefix = "..\\..\\sdk\\v43";
+    value = "CMake Files\\..\\..\\..\\..\\opt\\vendor\\;CMake Files\\..\\..\\..\\..\\optional";
+    ASSERT_TRUE(addPrefixToVirtualFolder(context, value));
+    ASSERT_EQ("CMake Files\\..\\..\\sdk\\v43\\opt\\vendor\\;CMake Files\\..\\..\\..\\..\\optional\\", value);
+
+    // No valid root: the default roots are used
+    ASSERT_EQ(CbpRewriteRoots::getDefaultRoots(), CbpRewriteRoots::compile({"usr"})->getRoots());
+}
+
+TEST_F(CbpPatcherTests, ScanModes) {
+    using tinyxml2::XMLUtil;
+    const XMLUtil::ScanMode defaultMode = XMLUtil::GetScanMode();
+    std::vector<XMLUtil::ScanMode> modes;
+    for (XMLUtil::ScanMode mode : {XMLUtil::SCAN_SCALAR, XMLUtil::SCAN_SSE2, XMLUtil::SCAN_AVX2}) {
+        if (XMLUtil::SetScanMode(mode)) {
+            modes.push_back(mode);
+        }
+    }
+    ASSERT_EQ(XMLUtil::SCAN_SCALAR, modes[0]);
+
+    // Random text at every alignment, the vectorized modes must find the same bytes as the scalar one
+    std::mt19937 random(42);
+    const char alphabet[] = " \t\n\r\v\f<>\"&ab\x80\xff";
+    std::string text(200, ' ');
+    for (int i = 0; i < 2000; i++) {
+        for (char &c : text) {
+            c = alphabet[random() % (sizeof(alphabet) - 1)];
+        }
+        text[random() % text.size()] = 0;
+        for (size_t offset = 0; offset < 64; offset++) {
+            const char *p = text.c_str() + offset;
+            XMLUtil::SetScanMode(XMLUtil::SCAN_SCALAR);
+            int expectedLines = 0;
+            const char *expectedRun = XMLUtil::SkipWhiteSpaceRun(p, &expectedLines);
+            const char *expectedFirst = XMLUtil::FindFirstOf(p, '"', '\n', '&');
+            for (XMLUtil::ScanMode mode : modes) {
+                XMLUtil::SetScanMode(mode);
+                int lines = 0;
+                ASSERT_EQ(expectedRun, XMLUtil::SkipWhiteSpaceRun(p, &lines));
+                ASSERT_EQ(expectedLines, lines);
+                ASSERT_EQ(expectedFirst, XMLUtil::FindFirstOf(p, '"', '\n', '&'));
+            }
+        }
+    }
+
+    // The documents are the same, with the same line numbers
+    std::string input;
+    ASSERT_TRUE(ga::readFile("testproject_input.cbp", input));
+    input.insert(input.find("<Project>"), "<!-- a\r\ncomment -->\r\n\t  \r\n<![CDATA[ x ]]>\r\n");
+    input.insert(input.find("</Project>"), "<Unit filename=\"a &amp; b\r\n &lt;&#65;&gt;\">\n  text &quot;\r\n</Unit>");
+    std::string expected;
+    int expectedLine = 0;
+    for (XMLUtil::ScanMode mode : modes) {
+        XMLUtil::SetScanMode(mode);
+        tinyxml2::XMLDocument doc;
+        ASSERT_EQ(tinyxml2::XML_SUCCESS, doc.Parse(input.c_str(), input.size()));
+        tinyxml2::XMLPrinter printer;
+        doc.Print(&printer);
+        int line = doc.FirstChildElement()->FirstChildElement("Project")->LastChildElement("Unit")->GetLineNum();
+        if (mode == XMLUtil::SCAN_SCALAR) {
+            expected = printer.CStr();
+            expectedLine = line;
+        }
+        ASSERT_EQ(expected, printer.CStr());
+        ASSERT_EQ(expectedLine, line);
+    }
+    XMLUtil::SetScanMode(defaultMode);
+}
+
+TEST_F(CbpPatcherTests, RetargetCBP) {
+    std::string input;
+    ASSERT_TRUE(ga::readFile("testproject_input.cbp", input));
+    // Not in the SDK: a directory whose name starts with the name of the SDK
+    input.insert(input.find("</Project>"), "<Unit filename=\"/tmp/xcmake/test/sdks/v421/a.h\"/>\n");
+
+    std::string patched42;
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &patched42));
+
+    auto initContext = [this](CbpPatchContext &other) {
+        other.cbpFilePath = context.cbpFilePath;
+        other.buildDir = context.buildDir;
+        other.projectDir = context.projectDir;
+        other.sdkDir = "/tmp/xcmake/test/sdks/v43";
+        other.gccClangFixes = context.gccClangFixes;
+        other.extraAddDirectory = context.extraAddDirectory;
+    };
+    CbpPatchContext context43;
+    initContext(context43);
+    std::string patched43;
+    context43.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context43, &patched43));
+
+    CbpPatchContext retarget;
+    initContext(retarget);
+    PatchResult prescanResult = PatchResult::Error;
+    ASSERT_TRUE(prescanCBP(retarget, patched42.data(), patched42.size(), prescanResult));
+    ASSERT_EQ(PatchResult::DifferentSDK, prescanResult);
+
+    std::string retargeted;
+    ASSERT_EQ(PatchResult::Changed, retargetCBP(retarget, patched42.data(), patched42.size(), retargeted));
+    ASSERT_EQ(patched43, retargeted);
+    ASSERT_NE(std::string::npos, retargeted.find("/tmp/xcmake/test/sdks/v421/a.h"));
+
+    // The retargeted file is recognized as patched for the new SDK
+    ASSERT_TRUE(prescanCBP(retarget, retargeted.data(), retargeted.size(), prescanResult));
+    ASSERT_EQ(PatchResult::AlreadyPatched, prescanResult);
+
+    // Without the note of the old SDK nothing is done
+    retarget.oldSdkPrefix = "/tmp/xcmake/test/sdks/v41";
+    ASSERT_EQ(PatchResult::Error, retargetCBP(retarget, patched42.data(), patched42.size(), retargeted));
+
+    // No path starts with the SDK of the note: only the note would be moved
+    std::string moved42 = patched42;
+    for (size_t idx = moved42.find("sdks/v42/"); idx != std::string::npos; idx = moved42.find("sdks/v42/", idx)) {
+        moved42.replace(idx, 8, "sdks/v40");
+    }
+    ASSERT_TRUE(prescanCBP(retarget, moved42.data(), moved42.size(), prescanResult));
+    ASSERT_EQ(PatchResult::DifferentSDK, retargetCBP(retarget, moved42.data(), moved42.size(), retargeted));
+    ASSERT_TRUE(retargeted.empty());
+
+    // The SDK paths end with a separator on both sides, the result is the one of a fresh patch
+    std::string patched42Slash;
+    context.sdkDir = "/tmp/xcmake/test/sdks/v42/";
+    ASSERT_TRUE(initVirtualFolderPrefix(context));
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &patched42Slash));
+
+    CbpPatchContext context43Slash;
+    initContext(context43Slash);
+    context43Slash.sdkDir = "/tmp/xcmake/test/sdks/v43/";
+    ASSERT_TRUE(initVirtualFolderPrefix(context43Slash));
+    std::string patched43Slash;
+    context43Slash.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context43Slash, &patched43Slash));
+    ASSERT_EQ(std::string::npos, patched43Slash.find("//"));
+
+    CbpPatchContext retargetSlash;
+    initContext(retargetSlash);
+    retargetSlash.sdkDir = context43Slash.sdkDir;
+    ASSERT_TRUE(initVirtualFolderPrefix(retargetSlash));
+    ASSERT_TRUE(prescanCBP(retargetSlash, patched42Slash.data(), patched42Slash.size(), prescanResult));
+    ASSERT_EQ(PatchResult::DifferentSDK, prescanResult);
+    ASSERT_EQ(PatchResult::Changed,
+              retargetCBP(retargetSlash, patched42Slash.data(), patched42Slash.size(), retargeted));
+    ASSERT_EQ(patched43Slash, retargeted);
 }
 
 } // namespace gatools
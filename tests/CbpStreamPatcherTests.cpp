@@ -0,0 +1,198 @@
+#include <CbpPatchRules.h>
+#include <CbpStreamPatcher.h>
+
+#include <file_system.h>
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace gatools {
+
+class CbpStreamPatcherTests : public ::testing::Test {
+  public:
+    CbpStreamPatcherTests();
+
+    /// @brief create a .cbp bigger than the stream window by appending units to the test project.
+    std::string createBigCbp(int nUnits);
+
+    PatchResult patchStream(const std::string &input, std::string &output);
+
+    CbpPatchContext context;
+};
+
+CbpStreamPatcherTests::CbpStreamPatcherTests() {
+    context.cbpFilePath = "/tmp/xcmake/test/build/proj.cbp";
+    context.buildDir = "/tmp/xcmake/test/build";
+    context.projectDir = "/tmp/xcmake/test/project";
+    context.sdkDir = "/tmp/xcmake/test/sdks/v42";
+    context.gccClangFixes.insert("-gcc1");
+    context.gccClangFixes.insert("-gcc2");
+    context.extraAddDirectory.push_back("/extra1");
+    context.extraAddDirectory.push_back("/extra2");
+}
+
+std::string CbpStreamPatcherTests::createBigCbp(int nUnits) {
+    tinyxml2::XMLDocument doc;
+    doc.LoadFile("testproject_input.cbp");
+    XmlElemPtr project = doc.FirstChildElement()->FirstChildElement("Project");
+    XmlElemPtr build = project->FirstChildElement("Build");
+
+    XmlElemPtr target = build->InsertNewChildElement("Target");
+    target->SetAttribute("title", "empty_compiler");
+    target->InsertNewChildElement("Compiler");
+
+    for (int i = 0; i < nUnits; i++) {
+        XmlElemPtr unit = project->InsertNewChildElement("Unit");
+        std::string filename = "/usr/include/lib" + std::to_string(i) + "/header.h";
+        unit->SetAttribute("filename", filename.c_str());
+        XmlElemPtr option = unit->InsertNewChildElement("Option");
+        std::string virtualFolder = "CMake Files\\..\\..\\..\\..\\usr\\include\\lib" + std::to_string(i);
+        option->SetAttribute("virtualFolder", virtualFolder.c_str());
+    }
+
+    tinyxml2::XMLPrinter printer;
+    doc.Print(&printer);
+    return printer.CStr();
+}
+
+PatchResult CbpStreamPatcherTests::patchStream(const std::string &input, std::string &output) {
+    std::istringstream in(input);
+    std::ostringstream out;
+    PatchResult patchResult = patchCBPStream(context, in, out);
+    output = out.str();
+    return patchResult;
+}
+
+TEST_F(CbpStreamPatcherTests, PatchCBP) {
+    std::string input;
+    std::string expected;
+    ASSERT_TRUE(ga::readFile("testproject_input.cbp", input));
+    ASSERT_TRUE(ga::readFile("testproject_output.cbp.xml", expected));
+
+    std::string output;
+    ASSERT_EQ(PatchResult::Changed, patchStream(input, output));
+    ASSERT_EQ(expected, output);
+
+    // Already transformed. Nothing will be done
+    std::string output2;
+    ASSERT_EQ(PatchResult::AlreadyPatched, patchStream(output, output2));
+
+    // Transformed for another SDK
+    context.sdkDir = "/tmp/xcmake/test/sdks/v43";
+    ASSERT_EQ(PatchResult::DifferentSDK, patchStream(output, output2));
+    ASSERT_EQ("/tmp/xcmake/test/sdks/v42", context.oldSdkPrefix);
+    ASSERT_EQ("..\\sdks\\v42", context.oldVirtualFolderPrefix);
+}
+
+TEST_F(CbpStreamPatcherTests, SameResultAsDom) {
+    std::string input = createBigCbp(2000);
+    ASSERT_GT(input.size(), 3 * 64 * 1024);
+
+    std::string expected;
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &expected));
+
+    std::string output;
+    ASSERT_EQ(PatchResult::Changed, patchStream(input, output));
+    ASSERT_EQ(expected, output);
+}
+
+TEST_F(CbpStreamPatcherTests, SplicedEdits) {
+    std::string input = createBigCbp(2000);
+
+    std::string expected;
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &expected));
+
+    std::vector<CbpEdit> edits;
+    ASSERT_EQ(PatchResult::Changed, findCBPEdits(context, input.data(), input.size(), edits));
+
+    // Only the patched values are replaced
+    size_t replaced = 0;
+    for (const CbpEdit &edit : edits) {
+        replaced += edit.end - edit.start;
+    }
+    ASSERT_LT(replaced, input.size() / 2);
+
+    std::ostringstream output;
+    ASSERT_TRUE(writeCBPEdits(input.data(), input.size(), edits, output));
+    ASSERT_EQ(expected, output.str());
+
+    // Already transformed. Nothing will be done
+    std::string patched = output.str();
+    ASSERT_EQ(PatchResult::AlreadyPatched, findCBPEdits(context, patched.data(), patched.size(), edits));
+}
+
+TEST_F(CbpStreamPatcherTests, IncrementalEdits) {
+    const std::string profile = "profile1";
+    std::string input = createBigCbp(200);
+
+    CbpSubtreeSnapshot snapshot;
+    std::vector<CbpEdit> edits;
+    ASSERT_EQ(PatchResult::Changed, findCBPEdits(context, input.data(), input.size(), edits, &snapshot));
+    ASSERT_EQ(0u, snapshot.reused);
+    ASSERT_LT(200u, snapshot.transformed);
+
+    std::vector<CbpEdit> fullEdits;
+    ASSERT_EQ(PatchResult::Changed, findCBPEdits(context, input.data(), input.size(), fullEdits));
+    std::ostringstream expected;
+    std::ostringstream output;
+    ASSERT_TRUE(writeCBPEdits(input.data(), input.size(), fullEdits, expected));
+    ASSERT_TRUE(writeCBPEdits(input.data(), input.size(), edits, output));
+    ASSERT_EQ(expected.str(), output.str());
+
+    // cmake regenerated the project with one more source file
+    std::string saved = snapshot.save(profile);
+    CbpSubtreeSnapshot loaded;
+    ASSERT_FALSE(loaded.load(saved, "profile2"));
+    ASSERT_EQ(0u, loaded.size());
+    ASSERT_TRUE(loaded.load(saved, profile));
+    ASSERT_EQ(snapshot.size(), loaded.size());
+
+    std::string input2 = createBigCbp(201);
+    ASSERT_EQ(PatchResult::Changed, findCBPEdits(context, input2.data(), input2.size(), edits, &loaded));
+    ASSERT_LE(200u, loaded.reused);
+    ASSERT_GE(2u, loaded.transformed);
+
+    ASSERT_EQ(PatchResult::Changed, findCBPEdits(context, input2.data(), input2.size(), fullEdits));
+    std::ostringstream expected2;
+    std::ostringstream output2;
+    ASSERT_TRUE(writeCBPEdits(input2.data(), input2.size(), fullEdits, expected2));
+    ASSERT_TRUE(writeCBPEdits(input2.data(), input2.size(), edits, output2));
+    ASSERT_EQ(expected2.str(), output2.str());
+
+    // The snapshot only keeps the subtrees of the last input
+    ASSERT_EQ(PatchResult::Changed, findCBPEdits(context, input.data(), input.size(), edits, &loaded));
+    ASSERT_EQ(0u, loaded.transformed);
+    ASSERT_EQ(PatchResult::Error, findCBPEdits(context, input.data(), 100, edits, &loaded));
+    ASSERT_EQ(snapshot.size(), loaded.size());
+}
+
+TEST_F(CbpStreamPatcherTests, SameResultAsDomWithUserRules) {
+    std::vector<JPatchRule> userRules = {
+        {"MakeCommands/Build", "command", "replace", "/usr/bin/make", "/tmp/xcmake/test/sdks/v42/usr/bin/make"},
+        {"Unit", "filename", "replace", "header", "header2"},
+    };
+    context.patchRules = CbpPatchRules::compile(userRules);
+    std::string input = createBigCbp(10);
+
+    std::string expected;
+    context.inOutXml.Parse(input.c_str(), input.size());
+    ASSERT_EQ(PatchResult::Changed, patchCBP(context, &expected));
+    ASSERT_NE(std::string::npos, expected.find("v42/usr/include/lib9/header2.h"));
+
+    std::string output;
+    ASSERT_EQ(PatchResult::Changed, patchStream(input, output));
+    ASSERT_EQ(expected, output);
+}
+
+TEST_F(CbpStreamPatcherTests, Unchanged) {
+    std::string input = "<?xml version=\"1.0\"?>\n<CodeBlocks_project_file>\n    <Project>\n"
+                        "        <Unit filename=\"/home/user/main.cpp\"/>\n    </Project>\n</CodeBlocks_project_file>\n";
+    std::string output;
+    ASSERT_EQ(PatchResult::Unchanged, patchStream(input, output));
+    ASSERT_EQ(input, output);
+
+    ASSERT_EQ(PatchResult::Error, patchStream("<CodeBlocks_project_file><Project>", output));
+}
+
+} // namespace gatools
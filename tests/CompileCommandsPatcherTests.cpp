@@ -0,0 +1,117 @@
+#include <CbpRewriteRoots.h>
+#include <CompileCommandsPatcher.h>
+
+#include <gtest/gtest.h>
+#include <sstream>
+
+namespace gatools {
+
+class CompileCommandsPatcherTests : public ::testing::Test {
+  public:
+    CompileCommandsPatcherTests();
+
+    PatchResult patch(const std::string &input, std::string &output);
+
+    CbpPatchContext context;
+};
+
+CompileCommandsPatcherTests::CompileCommandsPatcherTests() {
+    context.buildDir = "/tmp/xcmake/test/build";
+    context.projectDir = "/tmp/xcmake/test/project";
+    context.sdkDir = "/tmp/xcmake/test/sdks/v42";
+    context.gccClangFixes.insert("-gcc1");
+    context.extraAddDirectory.push_back("/usr/extra");
+}
+
+PatchResult CompileCommandsPatcherTests::patch(const std::string &input, std::string &output) {
+    std::istringstream in(input);
+    std::ostringstream out;
+    PatchResult patchResult = patchCompileCommands(context, in, out);
+    output = out.str();
+    return patchResult;
+}
+
+TEST_F(CompileCommandsPatcherTests, Command) {
+    const std::string input = "[\n"
+                              "{\n"
+                              "  \"directory\": \"/tmp/xcmake/test/build\",\n"
+                              "  \"command\": \"/usr/bin/c++ -DNAME=\\\\\\\"a b\\\\\\\" -I/usr/include/qt5 "
+                              "-isystem /usr/include/glib-2.0 --sysroot=/usr -I/tmp/xcmake/test/project/src "
+                              "-o main.o -c /tmp/xcmake/test/project/src/main.cpp\",\n"
+                              "  \"file\": \"/tmp/xcmake/test/project/src/main.cpp\",\n"
+                              "  \"output\": \"main.o\"\n"
+                              "},\n"
+                              "{\n"
+                              "  \"directory\": \"/tmp/xcmake/test/build\",\n"
+                              "  \"command\": \"/usr/bin/cc -c /usr/src/usr/lib.c\",\n"
+                              "  \"file\": \"/usr/src/usr/lib.c\"\n"
+                              "}\n"
+                              "]\n";
+    const std::string expected = "[\n"
+                                 "{\n"
+                                 "  \"directory\": \"/tmp/xcmake/test/build\",\n"
+                                 "  \"command\": \"/usr/bin/c++ -gcc1 -I/tmp/xcmake/test/sdks/v42/usr/extra "
+                                 "-DNAME=\\\\\\\"a b\\\\\\\" -I/tmp/xcmake/test/sdks/v42/usr/include/qt5 "
+                                 "-isystem /tmp/xcmake/test/sdks/v42/usr/include/glib-2.0 "
+                                 "--sysroot=/tmp/xcmake/test/sdks/v42/usr -I/tmp/xcmake/test/project/src "
+                                 "-o main.o -c /tmp/xcmake/test/project/src/main.cpp\",\n"
+                                 "  \"file\": \"/tmp/xcmake/test/project/src/main.cpp\",\n"
+                                 "  \"output\": \"main.o\"\n"
+                                 "},\n"
+                                 "{\n"
+                                 "  \"directory\": \"/tmp/xcmake/test/build\",\n"
+                                 "  \"command\": \"/usr/bin/cc -gcc1 -I/tmp/xcmake/test/sdks/v42/usr/extra "
+                                 "-c /tmp/xcmake/test/sdks/v42/usr/src/usr/lib.c\",\n"
+                                 "  \"file\": \"/tmp/xcmake/test/sdks/v42/usr/src/usr/lib.c\"\n"
+                                 "}\n"
+                                 "]\n";
+
+    std::string output;
+    ASSERT_EQ(PatchResult::Changed, patch(input, output));
+    ASSERT_EQ(expected, output);
+
+    // Already patched. Nothing will be done
+    std::string output2;
+    ASSERT_EQ(PatchResult::Unchanged, patch(output, output2));
+    ASSERT_EQ(output, output2);
+}
+
+TEST_F(CompileCommandsPatcherTests, Arguments) {
+    const std::string input = "[{\"directory\": \"/tmp/xcmake/test/build\", \"arguments\": [\"/usr/bin/c++\", "
+                              "\"-I/usr/include/qt5\", \"-c\", \"main.cpp\"], \"file\": \"main.cpp\"}, "
+                              "{\"directory\": \"/tmp/xcmake/test/build\", \"arguments\": [\"/usr/bin/c++\"], "
+                              "\"file\": \"empty.cpp\"}]";
+    const std::string expected = "[\n"
+                                 "{\n"
+                                 "  \"directory\": \"/tmp/xcmake/test/build\",\n"
+                                 "  \"arguments\": [\"/usr/bin/c++\", \"-gcc1\", "
+                                 "\"-I/tmp/xcmake/test/sdks/v42/usr/extra\", "
+                                 "\"-I/tmp/xcmake/test/sdks/v42/usr/include/qt5\", \"-c\", \"main.cpp\"],\n"
+                                 "  \"file\": \"main.cpp\"\n"
+                                 "},\n"
+                                 "{\n"
+                                 "  \"directory\": \"/tmp/xcmake/test/build\",\n"
+                                 "  \"arguments\": [\"/usr/bin/c++\", \"-gcc1\", "
+                                 "\"-I/tmp/xcmake/test/sdks/v42/usr/extra\"],\n"
+                                 "  \"file\": \"empty.cpp\"\n"
+                                 "}\n"
+                                 "]\n";
+
+    std::string output;
+    ASSERT_EQ(PatchResult::Changed, patch(input, output));
+    ASSERT_EQ(expected, output);
+
+    std::string output2;
+    ASSERT_EQ(PatchResult::Unchanged, patch(output, output2));
+    ASSERT_EQ(output, output2);
+
+    // Without settings to insert only the paths are relocated
+    context.gccClangFixes.clear();
+    context.extraAddDirectory.clear();
+    ASSERT_EQ(PatchResult::Changed, patch(input, output));
+    ASSERT_NE(std::string::npos, output.find("[\"/usr/bin/c++\", \"-I/tmp/xcmake/test/sdks/v42/usr/include/qt5\""));
+
+    ASSERT_EQ(PatchResult::Error, patch("[{\"command\": ", output));
+}
+
+} // namespace gatools
@@ -1,5 +1,6 @@
 #include <Config.h>
 #include <gtest/gtest.h>
+#include <sstream>
 
 namespace gatools {
 
@@ -41,6 +42,18 @@ TEST_F(ConfigTests, JsonSerialization) {
     std::string s = serialize(expected);
     JConfig actual = deserialize(s);
     ASSERT_EQ(expected, actual);
+
+    // The optional settings are not written when they are not set
+    for (const char *key : {"patchWorkers", "patchEngine", "patchRules", "sdkRewriteRoots", "retargetSdk",
+                            "patchCompileCommands", "fileApi", "captureLogDir", "patchCacheSizeMB", "patchCacheDir"}) {
+        ASSERT_EQ(std::string::npos, s.find(key)) << key;
+    }
+    expected.projects[1].patchWorkers = -1;
+    expected.fileApi = true;
+    s = serialize(expected);
+    ASSERT_NE(std::string::npos, s.find("\"patchWorkers\": -1"));
+    ASSERT_NE(std::string::npos, s.find("\"fileApi\": true"));
+    ASSERT_EQ(expected, deserialize(s));
 }
 
 TEST_F(ConfigTests, Simplify) {
@@ -154,4 +167,110 @@ TEST_F(ConfigTests, UpdateProjectInexistent) {
     ASSERT_EQ(expected, actual);
 }
 
+TEST_F(ConfigTests, SelectProjectPatchRules) {
+    JConfig config = createConfig();
+    config.patchRules.push_back({"MakeCommands/Build", "command", "replace", "/usr/bin/make", "${sdkPath}make"});
+    config.projects[0].patchRules.push_back({"Unit", "filename", "sdkPrefix", "", ""});
+
+    JConfig actualConfig = deserialize(serialize(config));
+    ASSERT_EQ(1, actualConfig.patchRules.size());
+    ASSERT_EQ("${sdkPath}make", actualConfig.patchRules[0].to);
+
+    JProject actualProject;
+    ASSERT_TRUE(selectProject(actualConfig, "/home/testuser/project0", actualProject));
+    ASSERT_EQ(2, actualProject.patchRules.size());
+    ASSERT_EQ("MakeCommands/Build", actualProject.patchRules[0].path);
+    ASSERT_EQ("/home/testuser/sdks/v42/make", actualProject.patchRules[0].to);
+    ASSERT_EQ("Unit", actualProject.patchRules[1].path);
+}
+
+TEST_F(ConfigTests, SelectProjectSdkRewriteRoots) {
+    JConfig config = createConfig();
+    config.sdkRewriteRoots = {"/usr", "/opt"};
+    config.projects[2].sdkRewriteRoots = {"/usr", "/lib64"};
+
+    JConfig actualConfig = deserialize(serialize(config));
+    ASSERT_EQ(config.sdkRewriteRoots, actualConfig.sdkRewriteRoots);
+
+    // The roots of the project replace the global ones
+    JProject actualProject;
+    ASSERT_TRUE(selectProject(actualConfig, "/home/testuser/project0", actualProject));
+    ASSERT_EQ(config.sdkRewriteRoots, actualProject.sdkRewriteRoots);
+    ASSERT_TRUE(selectProject(actualConfig, "/home/testuser/project2", actualProject));
+    ASSERT_EQ(config.projects[2].sdkRewriteRoots, actualProject.sdkRewriteRoots);
+}
+
+TEST_F(ConfigTests, CmdLineArgsOverlay) {
+    const char *argv[] = {"xcmake", "/home/testuser/project0", nullptr};
+    const char *environ[] = {"PATH=/usr/bin", "E1=0", "HOME=/home/testuser", "E1=duplicate", nullptr};
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args.assign(argv, argv + 2);
+    cmdLineArgs.env.assign(environ, environ + 4);
+
+    CmdLineArgs replaced = cmdLineArgs;
+    replaced.setArg(0, "/home/testuser/sdks/v42/cmake");
+    replaced.setEnv("E1=1");
+    replaced.setEnv("E2=2");
+    replaced.setEnv("E2=3");
+    for (size_t i = 0; i < 100; i++) {
+        replaced.setEnv("V" + std::to_string(i) + "=" + std::to_string(i));
+    }
+
+    // The first variable of a key is replaced, the values that are not replaced still view argv and environ
+    ASSERT_EQ(105, replaced.env.size());
+    ASSERT_EQ("E1=1", replaced.env[1]);
+    ASSERT_EQ("E1=duplicate", replaced.env[3]);
+    ASSERT_EQ("E2=3", replaced.env[4]);
+    ASSERT_EQ("V99=99", replaced.env[104]);
+    ASSERT_EQ(environ[0], replaced.env[0].data());
+    ASSERT_EQ(argv[1], replaced.args[1].data());
+    ASSERT_EQ("/home/testuser/sdks/v42/cmake", replaced.args[0]);
+    // The values are null terminated
+    ASSERT_STREQ("/home/testuser/sdks/v42/cmake", replaced.args[0].data());
+    ASSERT_STREQ("E1=1", replaced.env[1].data());
+
+    // The original is not changed
+    ASSERT_EQ("xcmake", cmdLineArgs.args[0]);
+    ASSERT_EQ("E1=0", cmdLineArgs.env[1]);
+
+    // The env changed by other means is indexed again
+    replaced.env.erase(replaced.env.begin() + 1);
+    replaced.setEnv("E1=4");
+    ASSERT_EQ("E1=4", replaced.env[2]);
+    ASSERT_EQ(104, replaced.env.size());
+}
+
+TEST_F(ConfigTests, CmdLineArgsLog) {
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xecho", "a \"b\"\\c\n"};
+    cmdLineArgs.env = {"E1=\t\x01"};
+    cmdLineArgs.home = "/home/testuser";
+    cmdLineArgs.pwd = "/tmp";
+
+    std::stringstream ss;
+    ss << cmdLineArgs;
+    ASSERT_EQ("{\"args\":[\"xecho\",\"a \\\"b\\\"\\\\c\\n\"],\"env\":[\"E1=\\t\\u0001\"],"
+              "\"home\":\"/home/testuser\",\"pwd\":\"/tmp\"}",
+              ss.str());
+
+    // The same text is in the execution plan
+    ExecutionPlan executionPlan;
+    executionPlan.cmdLineArgs = cmdLineArgs;
+    ASSERT_NE(std::string::npos, serialize(executionPlan).find("\"E1=\\t\\u0001\""));
+}
+
+TEST_F(ConfigTests, ChildUsageLog) {
+    ChildUsage usage;
+    usage.exitCode = 2;
+    usage.wallSeconds = 1.5;
+    usage.maxRssKB = 1024;
+
+    std::stringstream ss;
+    ss << usage << ' ' << 0.25;
+    ASSERT_EQ("exit: 2 wall: 1.500 s user: 0.000 s sys: 0.000 s maxRss: 1024 KB faults: 0/0 switches: 0/0 "
+              "blocks: 0/0 0.25",
+              ss.str());
+}
+
 } // namespace gatools
@@ -0,0 +1,109 @@
+#include <process.h>
+
+#include <file_system.h>
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+namespace gatools {
+
+class ProcessTests : public ::testing::Test {
+  public:
+    /// @brief run the shell script with its output captured into the files.
+    void runCaptured(const char *script, int flags, std::string &outStdout, std::string &outStderr);
+
+    std::vector<ga::CapturedLine> lines;
+    std::vector<std::string> lineTexts;
+    uint64_t splicedBytes = 0;
+    uint64_t copiedBytes = 0;
+};
+
+void ProcessTests::runCaptured(const char *script, int flags, std::string &outStdout, std::string &outStderr) {
+    mkdir("/tmp/xcmake/", S_IRWXU);
+    const std::string outPath = "/tmp/xcmake/capture_stdout.txt";
+    const std::string errPath = "/tmp/xcmake/capture_stderr.txt";
+    int outFd = open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | flags, S_IRUSR | S_IWUSR);
+    int errFd = open(errPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | flags, S_IRUSR | S_IWUSR);
+    ASSERT_LE(0, outFd);
+    ASSERT_LE(0, errFd);
+
+    ga::OutputCapture capture;
+    ASSERT_TRUE(capture.open());
+    const char *argv[] = {"sh", "-c", script, nullptr};
+    const char *envp[] = {"PATH=/usr/bin:/bin", nullptr};
+    pid_t pid = -1;
+    ASSERT_EQ(0, ga::spawnProcess("sh", argv, envp, pid, capture.getChildOut(), capture.getChildErr()));
+
+    lines.clear();
+    lineTexts.clear();
+    ASSERT_TRUE(capture.forward(outFd, errFd, [this](const ga::CapturedLine &line) {
+        lines.push_back(line);
+        lineTexts.push_back(std::string(line.text));
+    }));
+    int status = -1;
+    ASSERT_TRUE(ga::waitProcess(pid, status));
+    ASSERT_EQ(0, status);
+    splicedBytes = capture.splicedBytes;
+    copiedBytes = capture.copiedBytes;
+
+    close(outFd);
+    close(errFd);
+    ga::readFile(outPath, outStdout);
+    ga::readFile(errPath, outStderr);
+}
+
+TEST_F(ProcessTests, CaptureOutput) {
+    const char *script = "printf 'line 1\\nline '; sleep 0.05; printf '2\\nlast'; printf 'error\\n' >&2";
+    for (int flags : {0, O_APPEND}) {
+        std::string out;
+        std::string err;
+        runCaptured(script, flags, out, err);
+        ASSERT_EQ("line 1\nline 2\nlast", out);
+        ASSERT_EQ("error\n", err);
+        ASSERT_EQ(out.size() + err.size(), splicedBytes + copiedBytes);
+
+        // The lines are complete, the last one has no line feed and is given at the end
+        ASSERT_EQ(std::vector<std::string>({"line 1", "line 2", "error", "last"}), lineTexts);
+        ASSERT_EQ(1, lines[0].stream);
+        ASSERT_EQ(2, lines[2].stream);
+        ASSERT_EQ(1, lines[3].stream);
+        // The time of a line is the time of its first bytes
+        ASSERT_EQ(lines[0].timeNs, lines[1].timeNs);
+        ASSERT_LE(lines[0].timeNs + 40000000, lines[3].timeNs);
+    }
+}
+
+TEST_F(ProcessTests, DestinationFailure) {
+    // The writes to /dev/full fail: the output is still read for the lines, the child does not block
+    int fullFd = open("/dev/full", O_WRONLY);
+    ASSERT_LE(0, fullFd);
+    ga::OutputCapture capture;
+    ASSERT_TRUE(capture.open());
+    const char *argv[] = {"sh", "-c", "yes 'a line of output' | head -n 100000", nullptr};
+    const char *envp[] = {"PATH=/usr/bin:/bin", nullptr};
+    pid_t pid = -1;
+    ASSERT_EQ(0, ga::spawnProcess("sh", argv, envp, pid, capture.getChildOut(), capture.getChildErr()));
+
+    size_t lineCount = 0;
+    ASSERT_FALSE(capture.forward(fullFd, fullFd, [&lineCount](const ga::CapturedLine &) { lineCount++; }));
+    int status = -1;
+    ASSERT_TRUE(ga::waitProcess(pid, status));
+    ASSERT_EQ(0, status);
+    ASSERT_EQ(100000, lineCount);
+    close(fullFd);
+}
+
+TEST_F(ProcessTests, SpawnError) {
+    const char *argv[] = {"xcmake-nonexistent-command", nullptr};
+    const char *envp[] = {"PATH=/usr/bin:/bin", nullptr};
+    pid_t pid = -1;
+    ASSERT_EQ(ENOENT, ga::spawnProcess(argv[0], argv, envp, pid));
+}
+
+} // namespace gatools
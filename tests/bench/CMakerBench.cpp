@@ -0,0 +1,42 @@
+#include "bench.h"
+
+#include <CMaker.h>
+#include <file_system.h>
+
+#include <string>
+#include <vector>
+
+namespace gatools {
+
+BENCHMARK(CMakerInit) {
+    const std::string benchDir = "/tmp/xcmake/bench/init";
+    ga::createDirectories(benchDir);
+    JConfig config;
+    config.cmdEnvironment = {"E1=1", "PATH=/home/user/sdks/v42/usr/bin:/usr/bin"};
+    config.cmdReplacement["xecho"] = {"/usr/bin/echo", "/usr/bin/echo"};
+    JProject project;
+    project.path = "*";
+    project.sdkPath = "/home/user/sdks/v42";
+    config.projects.push_back(project);
+    ga::writeFile(ga::combine(benchDir, CMaker::CONFIG_FILENAME), serialize(config));
+
+    // A CI environment of 300 variables
+    std::vector<std::string> environment;
+    for (size_t i = 0; i < 300; i++) {
+        environment.push_back("XCMAKE_BENCH_VARIABLE_" + std::to_string(i) + "=/home/user/sdks/v42/usr/bin:/usr/bin");
+    }
+    environment.push_back("PATH=/usr/bin:/bin");
+
+    CmdLineArgs cmdLineArgs;
+    cmdLineArgs.args = {"xecho", "--some", "--arguments"};
+    for (const std::string &var : environment) {
+        cmdLineArgs.env.push_back(var);
+    }
+    cmdLineArgs.pwd = benchDir;
+    cmdLineArgs.home = benchDir;
+
+    CMaker cmaker;
+    bench::run("CMaker::init env=301", 200, [&]() { bench::doNotOptimize(cmaker.init(cmdLineArgs)); });
+}
+
+} // namespace gatools
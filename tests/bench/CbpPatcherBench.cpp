@@ -0,0 +1,151 @@
+#include "bench.h"
+
+#include <CbpPatcher.h>
+#include <CbpRewriteRoots.h>
+#include <CbpStreamPatcher.h>
+
+namespace gatools {
+
+/// @brief a virtualFolders value of the Project with nParts folders, half of them in /usr.
+static std::string createVirtualFolders(size_t nParts) {
+    std::string value;
+    for (size_t i = 0; i < nParts; i++) {
+        value += (i % 2 == 0) ? "CMake Files\\..\\..\\..\\..\\usr\\include\\lib" : "CMake Files\\src\\module";
+        value += std::to_string(i);
+        value += ";";
+    }
+    return value;
+}
+
+BENCHMARK(AddPrefixToVirtualFolder) {
+    CbpPatchContext context;
+    context.buildDir = "/home/user/project/build";
+    context.virtualFolderPrefix = "..\\..\\sdks\\v42";
+
+    // The allocations per value do not depend on the number of parts
+    for (size_t nParts : {1, 8, 64, 512}) {
+        const std::string input = createVirtualFolders(nParts);
+        bench::run("addPrefixToVirtualFolder parts=" + std::to_string(nParts), 200000 / nParts + 100, [&]() {
+            std::string value = input;
+            bool changed = addPrefixToVirtualFolder(context, value);
+            bench::doNotOptimize(changed);
+        });
+    }
+}
+
+BENCHMARK(AddPrefix) {
+    const std::string sdkDir = "/home/user/sdks/v42";
+    for (const char *input : {"/usr/include/c++/12/bits", "/home/user/project/include"}) {
+        const std::string value = input;
+        bench::run(std::string("addPrefix ") + input, 200000, [&]() {
+            std::string copy = value;
+            bool changed = addPrefix(copy, sdkDir);
+            bench::doNotOptimize(changed);
+        });
+    }
+}
+
+BENCHMARK(RewriteRoots) {
+    // Typical attribute values: a system header, a project file and a compiler option
+    const std::vector<std::string> values = {"/usr/lib/gcc/x86_64-linux-gnu/12/include/stddef.h",
+                                             "/home/user/project/src/module/very/deep/path/source_file.cpp",
+                                             "-I/home/user/project/build/generated/include/module"};
+    size_t bytes = 0;
+    for (const std::string &value : values) {
+        bytes += value.size();
+    }
+
+    // The cost of the matcher does not grow with the number of roots, a search per root does
+    for (size_t nRoots : {1, 4, 16, 64}) {
+        std::vector<std::string> rootList = {"/usr"};
+        for (size_t i = 1; i < nRoots; i++) {
+            rootList.push_back("/vendor" + std::to_string(i));
+        }
+        auto roots = CbpRewriteRoots::compile(rootList);
+        bench::run("matcher roots=" + std::to_string(nRoots), 200000, [&]() {
+            for (const std::string &value : values) {
+                bench::doNotOptimize(roots->find(value));
+            }
+        }, bytes);
+
+        std::vector<std::string> patterns;
+        for (const std::string &root : rootList) {
+            patterns.push_back(root + "/");
+        }
+        bench::run("find per root roots=" + std::to_string(nRoots), 200000, [&]() {
+            for (const std::string &value : values) {
+                size_t idx = std::string::npos;
+                for (const std::string &pattern : patterns) {
+                    idx = std::min(idx, value.find(pattern));
+                }
+                bench::doNotOptimize(idx);
+            }
+        }, bytes);
+    }
+}
+
+BENCHMARK(RetargetCBP) {
+    CbpPatchContext context;
+    context.projectDir = "/home/user/project";
+    context.sdkDir = "/home/user/sdks/v43";
+    initVirtualFolderPrefix(context);
+    context.oldSdkPrefix = "/home/user/sdks/v42";
+    context.oldVirtualFolderPrefix = "..\\sdks\\v42";
+
+    // A .cbp patched for v42 with 16000 system headers
+    std::string cbp = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<CodeBlocks_project_file>\n\t<Project>\n"
+                      "\t\t<Option show_notes=\"0\">\n\t\t\t<notes><![CDATA[/home/user/sdks/v42\n..\\sdks\\v42]]></notes>\n"
+                      "\t\t</Option>\n";
+    for (size_t i = 0; i < 16000; i++) {
+        std::string n = std::to_string(i);
+        cbp += "\t\t<Unit filename=\"/home/user/project/src/module" + n + "/source_file_" + n + ".cpp\"/>\n";
+        cbp += "\t\t<Unit filename=\"/home/user/sdks/v42/usr/include/c++/12/bits/header_" + n + ".h\">\n";
+        cbp += "\t\t\t<Option virtualFolder=\"CMake Files\\..\\sdks\\v42\\usr\\include\\c++\\12\\bits\\\"/>\n";
+        cbp += "\t\t</Unit>\n";
+    }
+    cbp += "\t</Project>\n</CodeBlocks_project_file>\n";
+
+    std::string retargeted;
+    bench::run("retargetCBP 4MB", 50, [&]() {
+        bench::doNotOptimize(retargetCBP(context, cbp.data(), cbp.size(), retargeted));
+    }, cbp.size());
+}
+
+BENCHMARK(IncrementalEdits) {
+    CbpPatchContext context;
+    context.projectDir = "/home/user/project";
+    context.buildDir = "/home/user/project/build";
+    context.sdkDir = "/home/user/sdks/v42";
+
+    // A .cbp generated by cmake with 16000 system headers, then generated again with one more source file
+    auto createCbp = [](size_t nUnits) {
+        std::string cbp = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<CodeBlocks_project_file>\n\t<Project>\n"
+                          "\t\t<Option title=\"project\"/>\n";
+        for (size_t i = 0; i < nUnits; i++) {
+            std::string n = std::to_string(i);
+            cbp += "\t\t<Unit filename=\"/home/user/project/src/module" + n + "/source_file_" + n + ".cpp\"/>\n";
+            cbp += "\t\t<Unit filename=\"/usr/include/c++/12/bits/header_" + n + ".h\">\n";
+            cbp += "\t\t\t<Option virtualFolder=\"CMake Files\\..\\..\\usr\\include\\c++\\12\\bits\\\"/>\n";
+            cbp += "\t\t</Unit>\n";
+        }
+        cbp += "\t</Project>\n</CodeBlocks_project_file>\n";
+        return cbp;
+    };
+    const std::string inputs[] = {createCbp(16000), createCbp(16001)};
+
+    std::vector<CbpEdit> edits;
+    bench::run("findCBPEdits 4MB", 20, [&]() {
+        bench::doNotOptimize(findCBPEdits(context, inputs[0].data(), inputs[0].size(), edits));
+    }, inputs[0].size());
+
+    // Every run reuses the subtrees of the previous input, at most one Unit is transformed
+    CbpSubtreeSnapshot snapshot;
+    findCBPEdits(context, inputs[0].data(), inputs[0].size(), edits, &snapshot);
+    size_t run = 0;
+    bench::run("findCBPEdits 4MB with snapshot", 20, [&]() {
+        const std::string &input = inputs[++run % 2];
+        bench::doNotOptimize(findCBPEdits(context, input.data(), input.size(), edits, &snapshot));
+    }, inputs[0].size());
+}
+
+} // namespace gatools
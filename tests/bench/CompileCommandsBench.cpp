@@ -0,0 +1,54 @@
+#include "bench.h"
+
+#include <CompileCommandsPatcher.h>
+
+#include <sstream>
+
+namespace gatools {
+
+/// @brief a compile_commands.json with nEntries commands of a Qt project.
+static std::string createCompileCommands(size_t nEntries) {
+    std::string json = "[\n";
+    for (size_t i = 0; i < nEntries; i++) {
+        std::string n = std::to_string(i);
+        json += (i == 0) ? "{\n" : ",\n{\n";
+        json += "  \"directory\": \"/home/user/project/build\",\n";
+        json += "  \"command\": \"/usr/bin/c++ -DQT_CORE_LIB -I/home/user/project/src/module" + n +
+                " -isystem /usr/include/x86_64-linux-gnu/qt5 -isystem /usr/include/x86_64-linux-gnu/qt5/QtCore"
+                " -O2 -g -fPIC -std=gnu++17 -o CMakeFiles/app.dir/src/module" +
+                n + "/file.cpp.o -c /home/user/project/src/module" + n + "/file.cpp\",\n";
+        json += "  \"file\": \"/home/user/project/src/module" + n + "/file.cpp\"\n}";
+    }
+    json += "\n]\n";
+    return json;
+}
+
+/// @brief an output that drops the bytes, so the bench measures the patch and not the copy.
+class NullBuffer : public std::streambuf {
+  protected:
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+    int overflow(int c) override { return c; }
+};
+
+BENCHMARK(CompileCommands) {
+    CbpPatchContext context;
+    context.projectDir = "/home/user/project";
+    context.buildDir = "/home/user/project/build";
+    context.sdkDir = "/home/user/sdks/v42";
+    context.gccClangFixes.insert("-D__SDK__");
+    context.extraAddDirectory.push_back("/usr/include/sdk");
+
+    // The allocations per entry do not depend on the size of the database
+    for (size_t nEntries : {1000, 20000}) {
+        const std::string input = createCompileCommands(nEntries);
+        NullBuffer nullBuffer;
+        std::ostream output(&nullBuffer);
+        bench::Measure measure = bench::run("patchCompileCommands entries=" + std::to_string(nEntries), 5, [&]() {
+            std::istringstream in(input);
+            bench::doNotOptimize(patchCompileCommands(context, in, output));
+        }, input.size());
+        bench::doNotOptimize(measure);
+    }
+}
+
+} // namespace gatools
@@ -0,0 +1,60 @@
+#include "bench.h"
+
+#include <CaptureLog.h>
+#include <file_system.h>
+#include <process.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+namespace gatools {
+
+/// @brief run the script with its output forwarded to the descriptor, captured into lines or not.
+static void runScript(const char *script, int destFd, bool isCaptured, bool hasLines, size_t &outLineCount) {
+    const char *argv[] = {"sh", "-c", script, nullptr};
+    const char *envp[] = {"PATH=/usr/bin:/bin", nullptr};
+    pid_t pid = -1;
+    int status;
+    if (!isCaptured) {
+        if (ga::spawnProcess("sh", argv, envp, pid, destFd, destFd) == 0) {
+            ga::waitProcess(pid, status);
+        }
+        return;
+    }
+
+    ga::OutputCapture capture;
+    if (capture.open() && ga::spawnProcess("sh", argv, envp, pid, capture.getChildOut(), capture.getChildErr()) == 0) {
+        CaptureLog captureLog;
+        captureLog.open("/tmp/xcmake/bench/logs", script);
+        ga::OnCapturedLine onLine = [&captureLog, &outLineCount](const ga::CapturedLine &line) {
+            captureLog.write(line);
+            outLineCount++;
+        };
+        capture.forward(destFd, destFd, hasLines ? onLine : ga::OnCapturedLine());
+        captureLog.close("end");
+        ga::waitProcess(pid, status);
+    }
+}
+
+BENCHMARK(OutputCapture) {
+    // A make VERBOSE=1 build: 200000 compiler command lines of 200 bytes
+    const char *script = "yes '/usr/bin/c++ -DQT_CORE_LIB -I/home/user/project/src -isystem "
+                         "/usr/include/x86_64-linux-gnu/qt5 -O2 -g -fPIC -std=gnu++17 -o CMakeFiles/app.dir/src/"
+                         "file.cpp.o -c /home/user/project/src/file.cpp' | head -n 200000";
+    const size_t bytes = 200000 * 201;
+    for (const char *dest : {"/dev/null", "/tmp/xcmake/bench/capture.txt"}) {
+        ga::createDirectories("/tmp/xcmake/bench");
+        int destFd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        size_t lineCount = 0;
+        std::string suffix = std::string(" -> ") + dest;
+        bench::run("direct" + suffix, 10, [&]() { runScript(script, destFd, false, false, lineCount); }, bytes);
+        bench::run("forwarded" + suffix, 10, [&]() { runScript(script, destFd, true, false, lineCount); }, bytes);
+        bench::run("captured" + suffix, 10, [&]() { runScript(script, destFd, true, true, lineCount); }, bytes);
+        close(destFd);
+    }
+}
+
+} // namespace gatools
@@ -0,0 +1,76 @@
+#include "bench.h"
+
+#include <process.h>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace gatools {
+
+/// @brief the launcher of step2run before posix_spawn: the child copied the page tables of the parent
+/// and built argv and envp after the fork.
+static void forkExec(const std::vector<std::string> &args, const std::vector<std::string> &env) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        std::vector<const char *> cmdRaw;
+        for (const std::string &arg : args) {
+            cmdRaw.push_back(arg.c_str());
+        }
+        cmdRaw.push_back(nullptr);
+        std::vector<const char *> envRaw;
+        for (const std::string &var : env) {
+            envRaw.push_back(var.c_str());
+        }
+        envRaw.push_back(nullptr);
+        _exit(execvpe(args[0].c_str(), const_cast<char *const *>(cmdRaw.data()),
+                      const_cast<char *const *>(envRaw.data())));
+    }
+    int status;
+    waitpid(pid, &status, 0);
+}
+
+static void spawn(const std::vector<const char *> &cmdRaw, const std::vector<const char *> &envRaw) {
+    pid_t pid = -1;
+    if (ga::spawnProcess(cmdRaw[0], cmdRaw.data(), envRaw.data(), pid) == 0) {
+        int status;
+        ga::waitProcess(pid, status);
+    }
+}
+
+BENCHMARK(Spawn) {
+    // A CI environment of 300 variables
+    std::vector<std::string> args = {"true", "--some", "--arguments"};
+    std::vector<std::string> env;
+    for (size_t i = 0; i < 300; i++) {
+        env.push_back("XCMAKE_BENCH_VARIABLE_" + std::to_string(i) + "=/home/user/sdks/v42/usr/bin:/usr/bin");
+    }
+    env.push_back("PATH=/usr/bin:/bin");
+
+    std::vector<const char *> cmdRaw;
+    for (const std::string &arg : args) {
+        cmdRaw.push_back(arg.c_str());
+    }
+    cmdRaw.push_back(nullptr);
+    std::vector<const char *> envRaw;
+    for (const std::string &var : env) {
+        envRaw.push_back(var.c_str());
+    }
+    envRaw.push_back(nullptr);
+
+    // The cost of fork grows with the memory of the parent (the parsed config, the logs, the .cbp caches)
+    for (size_t ballastMB : {0, 64, 512}) {
+        std::vector<char> ballast(ballastMB << 20);
+        memset(ballast.data(), 1, ballast.size());
+        bench::doNotOptimize(ballast.data());
+
+        std::string suffix = " parentMB=" + std::to_string(ballastMB);
+        bench::run("fork+execvpe" + suffix, 100, [&]() { forkExec(args, env); });
+        bench::run("posix_spawnp" + suffix, 100, [&]() { spawn(cmdRaw, envRaw); });
+    }
+}
+
+} // namespace gatools
@@ -0,0 +1,74 @@
+#include "bench.h"
+
+#include <file_system.h>
+#include <tinyxml2.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace gatools {
+
+/// @brief a .cbp like the ones of a big project: many units, system headers in virtual folders.
+static std::string createSyntheticCbp(size_t nUnits) {
+    std::string cbp = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<CodeBlocks_project_file>\n"
+                      "\t<FileVersion major=\"1\" minor=\"6\"/>\n\t<Project>\n"
+                      "\t\t<Option title=\"project\"/>\n\t\t<Option makefile_is_custom=\"1\"/>\n"
+                      "\t\t<Build>\n\t\t\t<Target title=\"all\">\n\t\t\t\t<Compiler>\n";
+    for (size_t i = 0; i < 64; i++) {
+        cbp += "\t\t\t\t\t<Add directory=\"/usr/include/lib" + std::to_string(i) + "/include\"/>\n";
+    }
+    cbp += "\t\t\t\t</Compiler>\n\t\t\t</Target>\n\t\t</Build>\n";
+    for (size_t i = 0; i < nUnits; i++) {
+        std::string n = std::to_string(i);
+        cbp += "\t\t<Unit filename=\"/home/user/project/src/module" + n + "/source_file_" + n + ".cpp\">\n";
+        cbp += "\t\t\t<Option target=\"module" + n + "\"/>\n\t\t</Unit>\n";
+        cbp += "\t\t<Unit filename=\"/usr/include/c++/12/bits/header_" + n + ".h\">\n";
+        cbp += "\t\t\t<Option virtualFolder=\"CMake Files\\..\\..\\..\\..\\usr\\include\\c++\\12\\bits\\\"/>\n";
+        cbp += "\t\t</Unit>\n";
+    }
+    cbp += "\t</Project>\n</CodeBlocks_project_file>\n";
+    return cbp;
+}
+
+/// @brief the parse throughput of every scan mode supported by the CPU.
+static void benchParse(const std::string &name, const std::string &input, size_t iterations) {
+    using tinyxml2::XMLUtil;
+    const XMLUtil::ScanMode defaultMode = XMLUtil::GetScanMode();
+    const char *modeNames[] = {"scalar", "sse2", "avx2"};
+    for (XMLUtil::ScanMode mode : {XMLUtil::SCAN_SCALAR, XMLUtil::SCAN_SSE2, XMLUtil::SCAN_AVX2}) {
+        if (!XMLUtil::SetScanMode(mode)) {
+            continue;
+        }
+        tinyxml2::XMLDocument doc;
+        bench::run(name + " " + modeNames[mode], iterations, [&]() {
+            doc.Parse(input.c_str(), input.size());
+            bench::doNotOptimize(doc.ErrorID());
+        }, input.size());
+    }
+    XMLUtil::SetScanMode(defaultMode);
+}
+
+BENCHMARK(XmlParse) {
+    benchParse("synthetic 4MB", createSyntheticCbp(16000), 20);
+
+    // The .cbp of the tests, the files given in XCMAKE_BENCH_CBP (separated by ':') are measured too
+    std::vector<std::string> paths = {"testproject_input.cbp"};
+    const char *extraPaths = getenv("XCMAKE_BENCH_CBP");
+    for (const char *p = extraPaths; p && *p;) {
+        const char *end = strchr(p, ':');
+        paths.emplace_back(p, end ? end - p : strlen(p));
+        p = end ? end + 1 : "";
+    }
+    for (const std::string &path : paths) {
+        std::string input;
+        if (!ga::readFile(path, input)) {
+            printf("cannot read %s\n", path.c_str());
+            continue;
+        }
+        size_t iterations = std::max<size_t>(10, (size_t(64) << 20) / std::max<size_t>(1, input.size()));
+        benchParse(ga::getFilename(path), input, iterations);
+    }
+}
+
+} // namespace gatools
@@ -0,0 +1,97 @@
+#include "bench.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> g_allocationCount(0);
+
+struct Benchmark {
+    const char *name;
+    gatools::bench::OnBenchmark onBenchmark;
+};
+
+std::vector<Benchmark> &getBenchmarks() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+} // namespace
+
+void *operator new(size_t size) {
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete[](void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+namespace gatools {
+namespace bench {
+
+size_t getAllocationCount() { return g_allocationCount.load(std::memory_order_relaxed); }
+
+Measure run(const std::string &name, size_t iterations, const std::function<void()> &op, size_t bytesPerOp) {
+    // Warm-up: caches, thread local buffers and memos
+    for (size_t i = 0; i < 3; i++) {
+        op();
+    }
+
+    size_t allocationsStart = getAllocationCount();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        op();
+    }
+    auto end = std::chrono::steady_clock::now();
+    size_t allocations = getAllocationCount() - allocationsStart;
+
+    Measure measure;
+    double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    measure.nsPerOp = ns / static_cast<double>(iterations);
+    measure.allocationsPerOp = static_cast<double>(allocations) / static_cast<double>(iterations);
+
+    printf("%-56s %12.1f ns/op %10.2f allocs/op", name.c_str(), measure.nsPerOp, measure.allocationsPerOp);
+    if (bytesPerOp > 0 && measure.nsPerOp > 0) {
+        printf(" %10.1f MB/s", static_cast<double>(bytesPerOp) * 1e3 / measure.nsPerOp);
+    }
+    printf("\n");
+    return measure;
+}
+
+bool add(const char *name, const OnBenchmark &onBenchmark) {
+    getBenchmarks().push_back(Benchmark{name, onBenchmark});
+    return true;
+}
+
+} // namespace bench
+} // namespace gatools
+
+/// @brief run the benchmarks whose name contains the first argument (all of them without argument).
+int main(int argc, char **argv) {
+    const char *filter = (argc > 1) ? argv[1] : "";
+    for (const Benchmark &benchmark : getBenchmarks()) {
+        if (strstr(benchmark.name, filter) == nullptr) {
+            continue;
+        }
+        printf("== %s\n", benchmark.name);
+        benchmark.onBenchmark();
+    }
+    return 0;
+}
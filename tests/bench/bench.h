@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace gatools {
+namespace bench {
+
+/// @brief the number of calls to operator new since the start of the process.
+size_t getAllocationCount();
+
+struct Measure {
+    double nsPerOp = 0;
+    double allocationsPerOp = 0;
+};
+
+/// @brief call the operation iterations times (after a warm-up) and print the time and the allocations per call.
+/// If bytesPerOp is set the throughput is printed too.
+Measure run(const std::string &name, size_t iterations, const std::function<void()> &op, size_t bytesPerOp = 0);
+
+using OnBenchmark = std::function<void()>;
+
+/// @brief register a benchmark, use the BENCHMARK macro.
+bool add(const char *name, const OnBenchmark &onBenchmark);
+
+/// @brief keep the compiler from removing the computation of the value.
+template <typename T> inline void doNotOptimize(const T &value) { asm volatile("" : : "g"(&value) : "memory"); }
+
+} // namespace bench
+} // namespace gatools
+
+#define BENCHMARK(name)                                                                                                \
+    static void name();                                                                                                \
+    static const bool name##_added = gatools::bench::add(#name, name);                                                 \
+    static void name()
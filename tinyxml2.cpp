@@ -24,6 +24,10 @@ distribution.
 #include "tinyxml2.h"
 
 #include <new>		// yes, this one new style header, is in the Android SDK.
+#if defined(__GNUC__) && defined(__x86_64__)
+#   define TIXML_SIMD_SCAN
+#   include <immintrin.h>
+#endif
 #if defined(ANDROID_NDK) || defined(__BORLANDC__) || defined(__QNXNTO__)
 #   include <stddef.h>
 #   include <stdarg.h>
@@ -135,6 +139,139 @@ static const Entity entities[NUM_ENTITIES] = {
 };
 
 
+// --------- Scanning ----------- //
+//
+// The hot loops of the parser look for the next delimiter (or the end of a whitespace run) one byte at a time.
+// On x86-64 they compare 16 (SSE2) or 32 (AVX2) bytes at once, the instruction set is selected at runtime.
+// The vector loads are aligned: a load never crosses a page boundary, so reading the bytes around the
+// terminating zero of the buffer is safe (the same technique as strlen in the C library).
+// The bytes read around the buffer are not checked by AddressSanitizer, their bits are always masked out.
+
+struct ScanFunctions {
+    XMLUtil::ScanMode mode;
+    const char* (*findFirstOf)( const char* p, char a, char b, char c );
+    const char* (*skipWhiteSpaceRun)( const char* p, int* curLineNumPtr );
+};
+
+static const char* FindFirstOfScalar( const char* p, char a, char b, char c )
+{
+    while ( *p && *p != a && *p != b && *p != c ) {
+        ++p;
+    }
+    return p;
+}
+
+static const char* SkipWhiteSpaceRunScalar( const char* p, int* curLineNumPtr )
+{
+    while( XMLUtil::IsWhiteSpace(*p) ) {
+        if (curLineNumPtr && *p == '\n') {
+            ++(*curLineNumPtr);
+        }
+        ++p;
+    }
+    return p;
+}
+
+static const ScanFunctions SCAN_SCALAR_FUNCTIONS = { XMLUtil::SCAN_SCALAR, FindFirstOfScalar, SkipWhiteSpaceRunScalar };
+
+#ifdef TIXML_SIMD_SCAN
+
+// The whitespace of isspace in the "C" locale: ' ' and '\t' to '\r'.
+#define TIXML_SIMD_SCAN_FUNCTIONS( SUFFIX, TARGET, VEC, BYTES, MASK_T, SET1, LOAD, CMPEQ, OR, SUB, MIN, MOVEMASK ) \
+__attribute__((target(TARGET), no_sanitize_address)) \
+static const char* FindFirstOf##SUFFIX( const char* p, char a, char b, char c ) \
+{ \
+    const VEC va = SET1( a ); \
+    const VEC vb = SET1( b ); \
+    const VEC vc = SET1( c ); \
+    const VEC vz = SET1( 0 ); \
+    const size_t misalign = reinterpret_cast<uintptr_t>( p ) & ( BYTES - 1 ); \
+    const char* block = p - misalign; \
+    VEC x = LOAD( reinterpret_cast<const VEC*>( block ) ); \
+    MASK_T mask = static_cast<MASK_T>( static_cast<unsigned>( MOVEMASK( OR( OR( CMPEQ( x, va ), CMPEQ( x, vb ) ), OR( CMPEQ( x, vc ), CMPEQ( x, vz ) ) ) ) ) ); \
+    mask &= ~static_cast<MASK_T>( 0 ) << misalign; \
+    while ( !mask ) { \
+        block += BYTES; \
+        x = LOAD( reinterpret_cast<const VEC*>( block ) ); \
+        mask = static_cast<MASK_T>( static_cast<unsigned>( MOVEMASK( OR( OR( CMPEQ( x, va ), CMPEQ( x, vb ) ), OR( CMPEQ( x, vc ), CMPEQ( x, vz ) ) ) ) ) ); \
+    } \
+    return block + __builtin_ctzll( mask ); \
+} \
+\
+__attribute__((target(TARGET), no_sanitize_address)) \
+static const char* SkipWhiteSpaceRun##SUFFIX( const char* p, int* curLineNumPtr ) \
+{ \
+    const VEC vspace = SET1( ' ' ); \
+    const VEC vtab = SET1( '\t' ); \
+    const VEC vrange = SET1( '\r' - '\t' ); \
+    const VEC vlf = SET1( '\n' ); \
+    const size_t misalign = reinterpret_cast<uintptr_t>( p ) & ( BYTES - 1 ); \
+    const char* block = p - misalign; \
+    MASK_T blockBits = ~static_cast<MASK_T>( 0 ) >> ( sizeof( MASK_T ) * 8 - BYTES ); \
+    MASK_T first = ~static_cast<MASK_T>( 0 ) << misalign; \
+    for (;;) { \
+        const VEC x = LOAD( reinterpret_cast<const VEC*>( block ) ); \
+        const VEC fromTab = SUB( x, vtab ); \
+        const VEC isSpace = OR( CMPEQ( x, vspace ), CMPEQ( MIN( fromTab, vrange ), fromTab ) ); \
+        const MASK_T other = ~static_cast<MASK_T>( static_cast<unsigned>( MOVEMASK( isSpace ) ) ) & blockBits & first; \
+        const MASK_T run = other ? ( ( other & ( 0 - other ) ) - 1 ) & first : blockBits & first; \
+        if ( curLineNumPtr ) { \
+            *curLineNumPtr += __builtin_popcountll( static_cast<MASK_T>( static_cast<unsigned>( MOVEMASK( CMPEQ( x, vlf ) ) ) ) & run ); \
+        } \
+        if ( other ) { \
+            return block + __builtin_ctzll( other ); \
+        } \
+        block += BYTES; \
+        first = blockBits; \
+    } \
+}
+
+TIXML_SIMD_SCAN_FUNCTIONS( SSE2, "sse2", __m128i, 16, unsigned long long, _mm_set1_epi8, _mm_load_si128,
+                           _mm_cmpeq_epi8, _mm_or_si128, _mm_sub_epi8, _mm_min_epu8, _mm_movemask_epi8 )
+TIXML_SIMD_SCAN_FUNCTIONS( AVX2, "avx2", __m256i, 32, unsigned long long, _mm256_set1_epi8, _mm256_load_si256,
+                           _mm256_cmpeq_epi8, _mm256_or_si256, _mm256_sub_epi8, _mm256_min_epu8, _mm256_movemask_epi8 )
+
+#undef TIXML_SIMD_SCAN_FUNCTIONS
+
+static const ScanFunctions SCAN_SSE2_FUNCTIONS = { XMLUtil::SCAN_SSE2, FindFirstOfSSE2, SkipWhiteSpaceRunSSE2 };
+static const ScanFunctions SCAN_AVX2_FUNCTIONS = { XMLUtil::SCAN_AVX2, FindFirstOfAVX2, SkipWhiteSpaceRunAVX2 };
+
+#endif
+
+static const ScanFunctions* GetSupportedScanFunctions( XMLUtil::ScanMode mode )
+{
+    switch ( mode ) {
+        case XMLUtil::SCAN_SCALAR:
+            return &SCAN_SCALAR_FUNCTIONS;
+#ifdef TIXML_SIMD_SCAN
+        case XMLUtil::SCAN_SSE2:
+            return &SCAN_SSE2_FUNCTIONS;
+        case XMLUtil::SCAN_AVX2:
+            return __builtin_cpu_supports( "avx2" ) ? &SCAN_AVX2_FUNCTIONS : 0;
+#endif
+        default:
+            return 0;
+    }
+}
+
+static const ScanFunctions* SelectScanFunctions()
+{
+    const ScanFunctions* functions = GetSupportedScanFunctions( XMLUtil::SCAN_AVX2 );
+    if ( !functions ) {
+        functions = GetSupportedScanFunctions( XMLUtil::SCAN_SSE2 );
+    }
+    return functions ? functions : &SCAN_SCALAR_FUNCTIONS;
+}
+
+static const ScanFunctions* scanFunctions = SelectScanFunctions();
+
+// A document parsed by the static initializers of another file can run before scanFunctions is set.
+static inline const ScanFunctions& GetScanFunctions()
+{
+    return scanFunctions ? *scanFunctions : SCAN_SCALAR_FUNCTIONS;
+}
+
+
 StrPair::~StrPair()
 {
     Reset();
@@ -200,8 +337,12 @@ char* StrPair::ParseText( char* p, const char* endTag, int strFlags, int* curLin
     const char  endChar = *endTag;
     size_t length = strlen( endTag );
 
-    // Inner loop of text parsing.
-    while ( *p ) {
+    // Inner loop of text parsing: jump to the next end char, newline or terminating zero.
+    for (;;) {
+        p = const_cast<char*>( XMLUtil::FindFirstOf( p, endChar, '\n', endChar ) );
+        if ( !*p ) {
+            return 0;
+        }
         if ( *p == endChar && strncmp( p, endTag, length ) == 0 ) {
             Set( start, p, strFlags );
             return p + length;
@@ -211,7 +352,6 @@ char* StrPair::ParseText( char* p, const char* endTag, int strFlags, int* curLin
         ++p;
         TIXMLASSERT( p );
     }
-    return 0;
 }
 
 
@@ -273,8 +413,14 @@ const char* StrPair::GetStr()
         _flags ^= NEEDS_FLUSH;
 
         if ( _flags ) {
-            const char* p = _start;	// the read pointer
-            char* q = _start;	// the write pointer
+            // The bytes before the first one to process stay in place.
+            const char newLine = ( _flags & NEEDS_NEWLINE_NORMALIZATION ) ? LF : 0;
+            const char carriageReturn = ( _flags & NEEDS_NEWLINE_NORMALIZATION ) ? CR : 0;
+            const char ampersand = ( _flags & NEEDS_ENTITY_PROCESSING ) ? '&' : 0;
+            char* const first = const_cast<char*>( XMLUtil::FindFirstOf( _start, newLine, carriageReturn, ampersand ) );
+
+            const char* p = first;	// the read pointer
+            char* q = first;	// the write pointer
 
             while( p < _end ) {
                 if ( (_flags & NEEDS_NEWLINE_NORMALIZATION) && *p == CR ) {
@@ -369,6 +515,34 @@ const char* StrPair::GetStr()
 
 // --------- XMLUtil ----------- //
 
+const char* XMLUtil::SkipWhiteSpaceRun( const char* p, int* curLineNumPtr )
+{
+    return GetScanFunctions().skipWhiteSpaceRun( p, curLineNumPtr );
+}
+
+
+const char* XMLUtil::FindFirstOf( const char* p, char a, char b, char c )
+{
+    return GetScanFunctions().findFirstOf( p, a, b, c );
+}
+
+
+XMLUtil::ScanMode XMLUtil::GetScanMode()
+{
+    return GetScanFunctions().mode;
+}
+
+
+bool XMLUtil::SetScanMode( ScanMode mode )
+{
+    const ScanFunctions* functions = GetSupportedScanFunctions( mode );
+    if ( !functions ) {
+        return false;
+    }
+    scanFunctions = functions;
+    return true;
+}
+
 const char* XMLUtil::writeBoolTrue  = "true";
 const char* XMLUtil::writeBoolFalse = "false";
 
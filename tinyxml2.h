@@ -553,12 +553,11 @@ public:
     static const char* SkipWhiteSpace( const char* p, int* curLineNumPtr )	{
         TIXMLASSERT( p );
 
-        while( IsWhiteSpace(*p) ) {
-            if (curLineNumPtr && *p == '\n') {
-                ++(*curLineNumPtr);
-            }
-            ++p;
+        // Most calls find no whitespace at all, they do not leave the inline test.
+        if ( !IsWhiteSpace(*p) ) {
+            return p;
         }
+        p = SkipWhiteSpaceRun( p, curLineNumPtr );
         TIXMLASSERT( p );
         return p;
     }
@@ -566,6 +565,30 @@ public:
         return const_cast<char*>( SkipWhiteSpace( const_cast<const char*>(p), curLineNumPtr ) );
     }
 
+    /** Skip the whitespace from p to the next other byte, counting the newlines into curLineNumPtr if set.
+        Vectorized like FindFirstOf, the vectorized modes use the whitespace of the "C" locale.
+    */
+    static const char* SkipWhiteSpaceRun( const char* p, int* curLineNumPtr );
+
+    /** Find the first byte equal to a, b, c or to the terminating zero of the string.
+        Scans 16 or 32 bytes at once on x86-64, see ScanMode.
+    */
+    static const char* FindFirstOf( const char* p, char a, char b, char c );
+
+    /** The instruction set used by SkipWhiteSpaceRun and FindFirstOf.
+        The best one supported by the CPU is selected when the library is loaded.
+    */
+    enum ScanMode {
+        SCAN_SCALAR,
+        SCAN_SSE2,
+        SCAN_AVX2
+    };
+    static ScanMode GetScanMode();
+    /** Select the scanning instruction set, returns false if the CPU (or the build) does not support it.
+        Not thread safe: documents must not be parsed while the mode is changed.
+    */
+    static bool SetScanMode( ScanMode mode );
+
     // Anything in the high order range of UTF-8 is assumed to not be whitespace. This isn't
     // correct, but simple, and usually works.
     static bool IsWhiteSpace( char p )					{